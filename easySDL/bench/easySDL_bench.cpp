@@ -0,0 +1,279 @@
+
+/** @file
+ * @brief Microbenchmarks for the drawing calls and the main loop.
+ *
+ * Runs headless as a normal sketch, so everything goes through the real loop.
+ * Usage: easySDL_bench [3d|2d] [output.json]
+ *        easySDL_bench check   checks that filter() works over 3D meshes, exits with 1 if not
+ */
+
+#include "easySDL.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Bench {
+    const char* name;
+    int opsPerFrame;
+    void (*op)(int i);
+    bool dispatch; // Cost is in the event dispatch of the next frame, not in update()
+};
+
+struct Result {
+    std::string name;
+    double nsPerOp;
+    double fps;
+    double eventsMs;
+    double updateMs;
+    double presentMs;
+};
+
+const int warmupFrames = 10;
+const int measuredFrames = 100;
+
+bool mode2d = false;
+bool checking = false;
+bool checkFailed = false;
+const char* outputPath = "easySDL_bench.json";
+std::vector<Bench> benches;
+std::vector<Result> results;
+size_t current = 0;
+int frame = 0;
+Uint64 opTicks = 0;
+// Dispatch is timed from the first to the last handled event of a frame
+Uint32 frameEvents = 0;
+Uint64 firstEvent = 0;
+Uint64 lastEvent = 0;
+Uint64 dispatchTicks = 0;
+Uint64 dispatchedOps = 0;
+
+
+// Operations
+
+void opNothing(int) {}
+
+void opBox(int i) {
+    pushMatrix();
+    translate((float) (i % 100) * 12, (float) (i / 100 % 60) * 12);
+    box(10);
+    popMatrix();
+}
+
+void opFillStroke(int i) {
+    fill(i & 255, 128, 64);
+    stroke(64, i & 255, 128, 200);
+}
+
+void opMatrix(int) {
+    pushMatrix();
+    translate(1.0f, 2.0f, 3.0f);
+    rotateX(0.1f);
+    rotateY(0.2f);
+    rotateZ(0.3f);
+    popMatrix();
+}
+
+void opRect(int i) {
+    rect((float) (i % 100) * 12, (float) (i / 100 % 60) * 12, 10, 10);
+}
+
+void opEllipse(int i) {
+    ellipse((float) (i % 100) * 12, (float) (i / 100 % 60) * 12, 10, 10);
+}
+
+void opLine(int i) {
+    line((float) (i % 100) * 12, 0, (float) (i / 100 % 60) * 12, 720);
+}
+
+void opPushEvent(int) {
+    SDL_Event event = {};
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+}
+
+void userEvent(SDL_Event*) {
+    lastEvent = SDL_GetPerformanceCounter();
+    if (frameEvents++ == 0) firstEvent = lastEvent;
+}
+
+
+// Results
+
+void saveResults() {
+    FILE* file = fopen(outputPath, "w");
+    if (file == nullptr) {
+        printf("Can't write %s\n", outputPath);
+        return;
+    }
+    fprintf(file, "{\n  \"mode\": \"%s\",\n  \"frames\": %d,\n  \"results\": [\n", mode2d ? "2d" : "3d", measuredFrames);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"fps\": %.2f, "
+                      "\"events_ms\": %.4f, \"update_ms\": %.4f, \"present_ms\": %.4f}%s\n",
+                r.name.c_str(), r.nsPerOp, r.fps, r.eventsMs, r.updateMs, r.presentMs,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    printf("Results saved to %s\n", outputPath);
+}
+
+void finishBench(const Bench& bench) {
+    Result r;
+    r.name = bench.name;
+    double frameMs = profileMean(PROFILE_FRAME);
+    r.fps = frameMs > 0 ? 1000 / frameMs : 0;
+    r.eventsMs = profileMean(PROFILE_EVENTS);
+    r.updateMs = profileMean(PROFILE_UPDATE);
+    r.presentMs = profileMean(PROFILE_PRESENT);
+    if (bench.dispatch) {
+        double seconds = (double) dispatchTicks / SDL_GetPerformanceFrequency();
+        r.nsPerOp = dispatchedOps > 0 ? seconds * 1e9 / (double) dispatchedOps : 0;
+    } else {
+        double seconds = (double) opTicks / SDL_GetPerformanceFrequency();
+        r.nsPerOp = seconds * 1e9 / ((double) measuredFrames * bench.opsPerFrame);
+    }
+    results.push_back(r);
+    printf("%-12s %10.2f ns/op %10.2f fps   events %.3f ms  update %.3f ms  present %.3f ms\n",
+           r.name.c_str(), r.nsPerOp, r.fps, r.eventsMs, r.updateMs, r.presentMs);
+}
+
+
+// Check
+
+// filter() goes through the pixels layer, which has to draw over whatever Batch3D left bound
+void checkFilter() {
+    static Uint8 before[4], beforeBackground[4];
+    background(40);
+    fill(200, 120, 30);
+    pushMatrix();
+    translate(640, 360, 0);
+    box(300);
+    popMatrix();
+    if (frame == 1) filter(FILTER_INVERT);
+
+    // framebuffer() has the frame before this one
+    const Uint8* frameBuffer = framebuffer();
+    if (frame >= 1 && frameBuffer == nullptr) {
+        printf("check: no framebuffer\n");
+        checkFailed = true;
+    } else if (frame >= 1) {
+        size_t center = ((size_t) framebufferHeight()/2*framebufferWidth() + framebufferWidth()/2)*4;
+        const Uint8* pixel = frameBuffer + center;
+        const Uint8* corner = frameBuffer + 4*4; // Top row, off the box
+        if (frame == 1) {
+            memcpy(before, pixel, 4);
+            memcpy(beforeBackground, corner, 4);
+            if (memcmp(before, beforeBackground, 3) == 0) {
+                printf("check: the box wasn't drawn\n");
+                checkFailed = true;
+            }
+        } else {
+            for (int c = 0; c < 3; c++) {
+                if (abs(pixel[c] + before[c] - 255) > 1 || abs(corner[c] + beforeBackground[c] - 255) > 1) {
+                    printf("check: filter() after a mesh, got %d %d %d over the box, expected %d %d %d\n",
+                           pixel[0], pixel[1], pixel[2], 255 - before[0], 255 - before[1], 255 - before[2]);
+                    checkFailed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (checkFailed || frame == 2) {
+        printf("check: %s\n", checkFailed ? "FAILED" : "passed");
+        quit();
+    }
+    frame++;
+}
+
+
+// Sketch
+
+void setup() {
+    headless(true);
+    if (checking) {
+        window3d("easySDL_bench check", 1280, 720);
+        targetFrameRate(0);
+        framebuffer(); // Reading back from the first frame on
+        return;
+    }
+    if (mode2d) {
+        window("easySDL_bench", 1280, 720);
+        benches = {
+            {"loop",     1,      opNothing,    false},
+            {"rect",     10000,  opRect,       false},
+            {"ellipse",  10000,  opEllipse,    false},
+            {"line",     10000,  opLine,       false},
+            {"fill",     100000, opFillStroke, false},
+            {"matrix",   100000, opMatrix,     false},
+            {"dispatch", 10000,  opPushEvent,  true},
+        };
+    } else {
+        window3d("easySDL_bench", 1280, 720);
+        benches = {
+            {"loop",     1,      opNothing,    false},
+            {"box",      10000,  opBox,        false},
+            {"fill",     100000, opFillStroke, false},
+            {"matrix",   100000, opMatrix,     false},
+            {"dispatch", 10000,  opPushEvent,  true},
+        };
+    }
+    targetFrameRate(0);
+    registerHandler(SDL_USEREVENT, userEvent);
+}
+
+void update() {
+    if (checking) {
+        checkFilter();
+        return;
+    }
+    const Bench& bench = benches[current];
+    if (frame == warmupFrames) {
+        profileReset();
+        opTicks = 0;
+        dispatchTicks = 0;
+        dispatchedOps = 0;
+    } else if (frame > warmupFrames && frameEvents > 1) {
+        // The events pushed last frame were just handled, n events are n - 1 gaps
+        dispatchTicks += lastEvent - firstEvent;
+        dispatchedOps += frameEvents - 1;
+    }
+    frameEvents = 0;
+
+    background(200);
+    fill(255);
+    stroke(0);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < bench.opsPerFrame; i++) bench.op(i);
+    if (frame >= warmupFrames) opTicks += SDL_GetPerformanceCounter() - start;
+
+    frame++;
+    if (frame == warmupFrames + measuredFrames) {
+        finishBench(bench);
+        frame = 0;
+        current++;
+        if (current == benches.size()) {
+            saveResults();
+            quit();
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "check") == 0) checking = true;
+        else if (strcmp(argv[i], "2d") == 0) mode2d = true;
+        else if (strcmp(argv[i], "3d") == 0) mode2d = false;
+        else outputPath = argv[i];
+    }
+
+    int result = easySDL::main(setup, update);
+    return checkFailed ? 1 : result;
+}
@@ -11,7 +11,8 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
-#include <SDL2/SDL_mixer.h>
+
+#include "vecmath.h"
 
 const float TWO_PI = 6.2831855f;
 const float PI = 3.1415927f;
@@ -19,6 +20,28 @@ const float HALF_PI = 1.5707964f;
 const float QUARTER_PI = 0.7853982f;
 
 typedef void (*EventHandlerPtr)(SDL_Event*);
+typedef void (*EventContextHandlerPtr)(SDL_Event*, void* context);
+
+/// @brief Parts of a frame that are timed separately, see profilePercentile().
+enum ProfilePhase {
+    PROFILE_EVENTS,  ///< Polling and handling SDL events
+    PROFILE_UPDATE,  ///< Your fixedUpdate() steps and update()
+    PROFILE_PRESENT, ///< Flushing batched drawing and swapping buffers
+    PROFILE_FRAME    ///< Whole frame, start to start (same as frameDelta)
+};
+
+/// @brief What filter() does to each pixel, see filter().
+enum FilterKind {
+    FILTER_THRESHOLD, ///< White where the brightest channel reaches param (0 to 1, default 0.5), black elsewhere
+    FILTER_GRAY,      ///< Gray of the same brightness
+    FILTER_OPAQUE,    ///< Alpha to 255
+    FILTER_INVERT,    ///< 255 minus red, green and blue
+    FILTER_POSTERIZE, ///< param (2 to 255) levels per channel, no default
+    FILTER_BLUR,      ///< Gaussian blur, param is the standard deviation in pixels (default 1)
+    FILTER_BOX_BLUR,  ///< Average of the square param pixels around (default 1)
+    FILTER_ERODE,     ///< Lowest value of each channel in the square param pixels around (default 1)
+    FILTER_DILATE     ///< Highest value of each channel in the square param pixels around (default 1)
+};
 
 /** @class easySDL
  * @brief Helper static class, used to hide some inner mechanisms.
@@ -33,18 +56,25 @@ public:
      *
      * @param setupPtr Pointer to your setup() function.
      * @param updatePtr Pointer to your update() function.
+     * @param fixedUpdatePtr Optional, called at a fixed rate before update(), see fixedTimestep().
      */
-    static int main(void (*setupPtr)(), void (*updatePtr)());
+    static int main(void (*setupPtr)(), void (*updatePtr)(), void (*fixedUpdatePtr)() = nullptr);
 
     static void super_quit();
     static void createWindow(const char* title, int w, int h, Uint32 flags);
     static void registerHandler(SDL_EventType eventType, EventHandlerPtr handler);
+    static void registerHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context);
     static void unregisterHandler(SDL_EventType eventType);
+    static void unregisterHandler(SDL_EventType eventType, EventHandlerPtr handler);
+    static void unregisterHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context);
 
 
     // "Get" functions
     static bool get_mode3d() { return mode3d; };
     static bool get_vsync() { return vsync; };
+    static bool get_headless() { return headlessMode; };
+    static bool get_threaded() { return threaded; };
+    static float get_fixedTimestep() { return (float) (1.0 / fixedStep); };
     static bool get_windowFlags() { return SDL_GetWindowFlags(window); };
 //    static bool get_windowWidth() { int w = 0; SDL_GetWindowSize(window, &w, nullptr); return w; };
 //    static bool get_windowHeight() { int h = 0; SDL_GetWindowSize(window, nullptr, &h); return h; };
@@ -55,6 +85,13 @@ public:
 
     // Public -> private functions
     static void vsyncMode(bool enable);
+    static void set_fixedTimestep(float hz);
+    static void set_headless(bool enable);
+    static void set_threaded(bool enable);
+    static void set_targetRate(float fps);
+    static void resetMatrix();
+    static void box(GLfloat w, GLfloat h, GLfloat d, SDL_Color fill, SDL_Color stroke);
+    static void image(int img, GLfloat x, GLfloat y, GLfloat w, GLfloat h, SDL_Color tint);
     static void fill(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
     static void stroke(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
 
@@ -63,13 +100,18 @@ public:
 private: // Yeah, I'm not documenting private
     static void (*setup)();
     static void (*update)();
+    static void (*fixedUpdate)();
 
     static SDL_Window* window;
     static SDL_Renderer* renderer;
     static SDL_GLContext glcontext;
-    static EventHandlerPtr eventHandler[SDL_LASTEVENT];
+
+    friend class Sound; // Starts audio through initSubsystem()
 
     static void super_setup();
+    static bool initSubsystem(Uint32 flags, const char* stage);
+    static bool setupHeadlessVideo();
+    static void initInputFor(SDL_EventType eventType);
     static void super_update();
     static void handle_event(SDL_Event* event);
 
@@ -79,9 +121,12 @@ private: // Yeah, I'm not documenting private
     static bool quit_flag;
     static bool mode3d;
     static bool vsync;
-    static Uint32 time_step;
-    static Uint32 last_step;
-    static Uint32 frameTimes[10];
+    static bool headlessMode;
+    static bool threaded;
+    static bool targetRateSet;
+    static double fixedStep;
+    static double fixedAccumulator;
+    static float frameTimes[10];
     static SDL_Color fillColor;
     static SDL_Color strokeColor;
 };
@@ -91,24 +136,38 @@ private: // Yeah, I'm not documenting private
 
 // Global variables
 
-/// @brief How many milliseconds passed since last update() call.
-Uint32 frameDelta;
+/// @brief How many milliseconds passed since last update() call, with sub-millisecond precision.
+extern float frameDelta;
+/// @brief How far (0-1) the time is between the last fixedUpdate() and the next one. Use to interpolate.
+extern float frameAlpha;
 /// @brief How many frames were drawn, first update() is 0.
-Uint32 frameCount = 0;
+extern Uint32 frameCount;
 /// @brief FPS or frames per second, counted over 10 frames.
-float frameRate = 10;
+extern float frameRate;
 /// @brief Window width in pixels.
-Uint32 width = 1;
+extern Uint32 width;
 /// @brief Window height in pixels.
-Uint32 height = 1;
+extern Uint32 height;
+/// @brief width*height colors from color(), top row first, nullptr until loadPixels(). See loadPixels().
+extern Uint32* pixels;
 /// @brief Mouse X position in pixels relative to window.
-int mouseX = 0;
+extern int mouseX;
 /// @brief Mouse Y position in pixels relative to window.
-int mouseY = 0;
+extern int mouseY;
 /// @brief Previous mouse X position in pixels relative to window.
-int pmouseX = 0;
+extern int pmouseX;
 /// @brief Previous mouse Y position in pixels relative to window.
-int pmouseY = 0;
+extern int pmouseY;
+/// @brief Mouse buttons held this frame, test with SDL_BUTTON(SDL_BUTTON_LEFT) and etc.
+extern Uint32 mouseButtons;
+/// @brief True if any mouse button is held this frame.
+extern bool mousePressed;
+/// @brief Horizontal mouse wheel movement since the last frame, positive is right.
+extern int mouseScrollX;
+/// @brief Vertical mouse wheel movement since the last frame, positive is away from the user.
+extern int mouseScrollY;
+/// @brief State of every key, indexed by SDL_Scancode. 1 if held. Points straight at SDL's array, no copies.
+extern const Uint8* keyboardState;
 
 
 
@@ -150,6 +209,201 @@ void vsyncMode(bool enable);
  */
 bool vsyncMode();
 
+/** @brief Render offscreen, without showing a window. For machines without a display or GPU.
+ *
+ * Uses SDL's offscreen video driver (OpenGL through EGL, Mesa works) or the dummy driver
+ * with the software renderer for window(). The frame rate is uncapped, unless the sketch
+ * called targetFrameRate() itself, and vsync is off, so the sketch runs as fast as it can.
+ * Read the frames with framebuffer().
+ *
+ * Setting the EASYSDL_HEADLESS environment variable to anything but 0 does the same
+ * without changing the sketch.
+ *
+ * @note Has to be called before window() or window3d().
+ *
+ * @param enable True for headless.
+ */
+void headless(bool enable);
+
+/** @brief Get headless state.
+ *
+ * @return True if rendering offscreen.
+ */
+bool headless();
+
+/** @brief Run drawing on its own thread, so a slow update() and a slow buffer swap overlap.
+ *
+ * update() runs on the main thread as usual, but background(), box() and the matrix
+ * functions only record what to draw. A render thread owns the OpenGL context and
+ * draws the recorded frame while update() already works on the next one.
+ * fill() and stroke() work as usual, box() remembers the colors it was called with.
+ *
+ * @note Only for window3d(), call it in setup().
+ * @warning Don't call OpenGL yourself in update() in this mode, the context is on the other thread.
+ * vsyncMode() can't be changed either once the loop runs.
+ *
+ * @param enable True for a separate render thread.
+ */
+void threadedMode(bool enable);
+
+/** @brief Get threaded mode state.
+ *
+ * @return True if drawing runs on a separate thread.
+ */
+bool threadedMode();
+
+/** @brief Get the pixels of the last presented frame.
+ *
+ * The first call turns on reading back the frame, from then on every frame is copied
+ * right before it's presented (headless or not). So the first call returns nullptr,
+ * the next update() gets the previous frame. With threadedMode() the frame is one older,
+ * the render thread draws it while update() runs.
+ *
+ * @note The pixels stay valid until this update() returns, copy them to keep them longer.
+ *
+ * @return framebufferWidth()*framebufferHeight() RGBA pixels, 4 bytes each, top row first.
+ * nullptr if not available yet.
+ */
+const Uint8* framebuffer();
+
+/** @brief Get the width of the pixels framebuffer() returns.
+ *
+ * The drawable size, on HiDPI displays it can be larger than width.
+ *
+ * @return Width in pixels, 0 until framebuffer() returns a frame.
+ */
+int framebufferWidth();
+
+/** @brief Get the height of the pixels framebuffer() returns.
+ *
+ * @return Height in pixels, 0 until framebuffer() returns a frame.
+ */
+int framebufferHeight();
+
+/** @brief Save the current frame as screen-####.png, #### being frameCount.
+ *
+ * See saveFrame(const char*).
+ */
+void saveFrame();
+
+/** @brief Save the frame being drawn to an image file once it's presented.
+ *
+ * The frame is read back without waiting for the GPU where OpenGL allows it (window3d()),
+ * and written by a thread of its own, so saving doesn't hold up the sketch.
+ * The last run of '#' in path becomes frameCount, like "shots/frame-####.png".
+ * Files ending in .bmp are saved as BMP, everything else as PNG.
+ *
+ * @param path File to write.
+ */
+void saveFrame(const char* path);
+
+/** @brief Record every presented frame until stopRecording().
+ *
+ * - .y4m: YUV4MPEG2 video (4:2:0) at targetFrameRate(), ffmpeg and most players read it.
+ * - .rgb: raw rgb24 frames, the size is logged when the recording ends.
+ * - a path with '#' in it: one numbered image per frame, like "frames/####.png".
+ *
+ * Frames are read back and encoded like saveFrame() does. If the encoder or the disk can't
+ * keep up, frames are dropped instead of slowing the sketch down, see droppedFrames().
+ * Use headless() for recordings that have to keep every frame, it waits for nothing else.
+ *
+ * @param path File to record to, or the numbered image pattern.
+ * @return False if the path isn't one of the above. A running recording stops first.
+ */
+bool startRecording(const char* path);
+
+/** @brief Stop recording, the file is complete once the frames in flight are written.
+ */
+void stopRecording();
+
+/** @brief Get recording state.
+ *
+ * @return True between startRecording() and stopRecording().
+ */
+bool recording();
+
+/** @brief Get how many recorded frames were dropped so far.
+ *
+ * @return Frames that found the encoder busy or couldn't be read back, since the start.
+ */
+Uint32 droppedFrames();
+
+/** @brief Record the input of every frame to a log, for replayInput().
+ *
+ * Window, keyboard and mouse events go in as handle_event() sees them, with mouseX, mouseY,
+ * mouseButtons and frameDelta of each frame. A few bytes per event, so hours of input stay small.
+ * The random() and noise() seed is logged too, unless the sketch seeded them itself.
+ * Runs until stopInput() or the sketch quits.
+ *
+ * Setting the EASYSDL_RECORD_INPUT environment variable to a path does the same from the start.
+ *
+ * @param path File to write.
+ * @return False if the file can't be written.
+ */
+bool recordInput(const char* path);
+
+/** @brief Play a log from recordInput() back instead of the real mouse and keyboard.
+ *
+ * Events, mouse state and keyboardState come from the log, frame by frame, so the sketch runs
+ * the recorded session the same way every time. Only closing the window still works.
+ * The sketch quits at the end of the log.
+ *
+ * With fixedDelta 0 frames wait until they are due as recorded and get the recorded frameDelta.
+ * Otherwise frames run as fast as possible and every frameDelta is fixedDelta, combined with
+ * headless() that measures the frame rate of a real session, repeatably. frameRate always
+ * counts the actual frames. targetFrameRate() doesn't pace a replay, it applies again after
+ * stopInput().
+ *
+ * Setting EASYSDL_REPLAY_INPUT to a path (and EASYSDL_REPLAY_DELTA to milliseconds) does the
+ * same from the start.
+ *
+ * @param path Log to read.
+ * @param fixedDelta Milliseconds per frame, 0 for the recorded timing.
+ * @return False if the file can't be read or isn't an input log.
+ */
+bool replayInput(const char* path, float fixedDelta = 0);
+
+/** @brief Stop recording or replaying input, the real input takes over again.
+ */
+void stopInput();
+
+/** @brief Get input replay state.
+ *
+ * @return True while a log is played back.
+ */
+bool replayingInput();
+
+/** @brief Set the maximum frame rate. Default is 60.
+ *
+ * Frames are timed with the high resolution counter and the wait sleeps first,
+ * then spins for the last fraction of a millisecond. Ignored while vsync is on.
+ *
+ * @param fps Frames per second, 0 for uncapped.
+ */
+void targetFrameRate(float fps);
+
+/** @brief Get the maximum frame rate.
+ *
+ * @return Frames per second, 0 if uncapped.
+ */
+float targetFrameRate();
+
+/** @brief Set how often fixedUpdate() (the third argument of easySDL::main()) is called. Default is 60.
+ *
+ * fixedUpdate() runs as many times as needed to catch up with real time before each update(),
+ * so a simulation advances by the same step no matter the frame rate.
+ * Use frameAlpha in update() to interpolate between the last two simulation states.
+ *
+ * @param hz Simulation steps per second.
+ */
+void fixedTimestep(float hz);
+
+/** @brief Get the fixed simulation rate.
+ *
+ * @return Simulation steps per second.
+ */
+float fixedTimestep();
+
 /** @brief Set window flags.
  *
  * @param flags Window flags.
@@ -165,25 +419,64 @@ Uint32 windowFlags();
 /** @brief Register an event handler.
  *
  * For now check the SDL2 documentation to know more about events.
+ * Any number of handlers can listen to the same event type, they are called in the order they were registered.
+ *
+ * @note Consecutive SDL_MOUSEMOTION events are merged into one and so are SDL_MOUSEWHEEL events,
+ * see coalesceEvents().
  *
  * @param eventType See SDL_EventType for options.
  * @param handler This function will be called with an SDL_Event* as an argument.
  */
-void registerHandler(SDL_EventType eventType, EventHandlerPtr handler) {
-    EventHandlerPtr handlerPtr;
+void registerHandler(SDL_EventType eventType, EventHandlerPtr handler);
 
-    easySDL::registerHandler(eventType, handler);
-}
+/** @brief Register an event handler that gets a context pointer.
+ *
+ * Same as the other registerHandler(), handy for calling into an object.
+ *
+ * @param eventType See SDL_EventType for options.
+ * @param handler This function will be called with an SDL_Event* and the context.
+ * @param context Anything, passed to the handler as is.
+ */
+void registerHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context);
 
-/** @brief Unregister an event handler. Event will be 'ignored'.
+/** @brief Unregister all handlers of an event type. Event will be 'ignored'.
  *
  * For now check the SDL2 documentation to know more about events.
  *
  * @param eventType See SDL_EventType for options.
  */
-void unregisterHandler(SDL_EventType eventType) {
-    easySDL::unregisterHandler(eventType); // TODO: Add checks or something
-}
+void unregisterHandler(SDL_EventType eventType);
+
+/** @brief Unregister one event handler.
+ *
+ * @param eventType See SDL_EventType for options.
+ * @param handler The handler passed to registerHandler().
+ */
+void unregisterHandler(SDL_EventType eventType, EventHandlerPtr handler);
+
+/** @brief Unregister one event handler with a context.
+ *
+ * @param eventType See SDL_EventType for options.
+ * @param handler The handler passed to registerHandler().
+ * @param context The context passed to registerHandler().
+ */
+void unregisterHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context);
+
+/** @brief Turns merging of mouse motion and wheel events on or off. On by default.
+ *
+ * When on, a run of SDL_MOUSEMOTION events in a row becomes one event with the last position
+ * and the summed xrel/yrel, a run of SDL_MOUSEWHEEL events becomes one with the summed movement.
+ * Other events in between are never skipped or reordered.
+ *
+ * @param enable True to merge.
+ */
+void coalesceEvents(bool enable);
+
+/** @brief Get event merging state.
+ *
+ * @return True if mouse motion and wheel events are merged.
+ */
+bool coalesceEvents();
 
 /// @brief Quit with proper cleanup.
 void quit();
@@ -212,6 +505,89 @@ float radians(float degrees);
  */
 float degrees(float radians);
 
+/** @brief Get a random number from 0 up to (but not including) high.
+ *
+ * Numbers come from a fast generator with a period of 2^128 - 1, seeded differently
+ * every run unless randomSeed() is called.
+ *
+ * @param high Upper limit.
+ * @return Random number.
+ */
+float random(float high);
+/** @brief Get a random number from low up to (but not including) high.
+ *
+ * @param low Lower limit.
+ * @param high Upper limit.
+ * @return Random number, low if high isn't bigger.
+ */
+float random(float low, float high);
+/** @brief Get a random number from a normal distribution with mean 0 and standard deviation 1.
+ *
+ * About 68% of the numbers are between -1 and 1, 95% between -2 and 2.
+ * Multiply by the deviation you want and add the mean.
+ *
+ * @return Random number.
+ */
+float randomGaussian();
+/** @brief Make random() and randomGaussian() return the same numbers every run.
+ *
+ * @param seed Any number, the same one gives the same sequence.
+ */
+void randomSeed(Uint64 seed);
+
+/** @brief Get Perlin noise at a point, same as Processing's noise().
+ *
+ * Noise is a smooth random function: nearby points get similar values, so stepping
+ * through it slowly gives natural looking terrain, textures and motion. Steps of 0.005 to
+ * 0.03 work best. The same point always gives the same value, until noiseSeed() changes it.
+ * Negative coordinates mirror positive ones.
+ *
+ * @param x, y, z Coordinates in noise space.
+ * @return Value between 0 and 1, mostly around 0.5.
+ */
+float noise(float x, float y = 0, float z = 0);
+/** @brief Set how many octaves of noise are added together and how much each one counts.
+ *
+ * Every octave has twice the frequency of the one before it and falloff times the
+ * amplitude. More octaves give more detail and cost more.
+ *
+ * @param lod Number of octaves, 4 by default, up to 16.
+ * @param falloff Amplitude of each octave relative to the previous one, 0.5 by default.
+ * Values over 0.5 can make noise() return more than 1.
+ */
+void noiseDetail(int lod, float falloff = 0.5f);
+/** @brief Make noise() return the same values every run.
+ *
+ * @param seed Any number, the same one gives the same noise.
+ */
+void noiseSeed(Uint64 seed);
+/** @brief Fill a grid with noise, the fast way to get noise for a whole terrain or flow field.
+ *
+ * Gives the same values as noise(x + col*step, y + row*step), but only works out the parts
+ * that depend on one coordinate once per column and row, and fills four points at a time
+ * on every core. For example a 512x512 height map every frame:
+ * @code
+ * static float heights[512*512];
+ * noiseField(heights, 512, 512, 0, millis()/1000.0f, 0.01f);
+ * @endcode
+ *
+ * @param out Array of cols*rows values, written as out[row*cols + col].
+ * @param cols, rows Size of the grid.
+ * @param x, y Noise coordinates of the first value.
+ * @param step Distance between neighbours in noise space.
+ */
+void noiseField(float* out, int cols, int rows, float x, float y, float step);
+/** @brief Fill a 3D grid with noise.
+ *
+ * Same as noise(x + col*step, y + row*step, z + layer*step) for every value.
+ *
+ * @param out Array of cols*rows*layers values, written as out[(layer*rows + row)*cols + col].
+ * @param cols, rows, layers Size of the grid.
+ * @param x, y, z Noise coordinates of the first value.
+ * @param step Distance between neighbours in noise space.
+ */
+void noiseField(float* out, int cols, int rows, int layers, float x, float y, float z, float step);
+
 // Time
 /** @brief Wait a specified number of milliseconds before returning.
  *
@@ -224,6 +600,164 @@ void delay(Uint32 ms);
 /// @brief Returns the number of milliseconds since starting the program.
 Uint32 millis();
 
+/** @brief Print how long each stage of startup took, after the first frame.
+ *
+ * SDL subsystems are started only when needed: video in window()/window3d(), audio when
+ * sound is first used, joysticks and game controllers when a handler for their events is
+ * registered. The trace shows SDL init, each subsystem, the window, the GL context or
+ * renderer, setup() and the time until the first frame was presented.
+ *
+ * Setting the EASYSDL_STARTUP_TRACE environment variable to anything but 0 does the same.
+ *
+ * @note Call before easySDL::main() or in setup().
+ *
+ * @param enable True to print the trace.
+ */
+void startupTrace(bool enable);
+
+/** @brief Get how long a startup stage took.
+ *
+ * @param stage Name as printed by startupTrace(), for example "setup()" or "first frame".
+ * @return Milliseconds, -1 if the stage didn't happen (yet).
+ */
+float startupTime(const char* stage);
+
+// Profiling
+/** @brief Get a percentile of the time spent in a phase of the frame.
+ *
+ * Every frame is recorded into a histogram per phase, so one slow frame shows up
+ * in the p99 and the max instead of disappearing into frameRate.
+ *
+ * @param phase Which part of the frame.
+ * @param percentile 0-100, for example 50 for the median or 99 for the slowest 1%.
+ * @return Time in milliseconds (within ~3%).
+ */
+float profilePercentile(ProfilePhase phase, float percentile);
+
+/** @brief Get the slowest recorded time of a phase of the frame.
+ *
+ * @param phase Which part of the frame.
+ * @return Time in milliseconds.
+ */
+float profileMax(ProfilePhase phase);
+
+/** @brief Get the average time of a phase of the frame.
+ *
+ * @param phase Which part of the frame.
+ * @return Time in milliseconds.
+ */
+float profileMean(ProfilePhase phase);
+
+/// @brief Forget everything recorded so far, for example after loading is done.
+void profileReset();
+
+/** @brief Save count, mean, p50, p95, p99 and max of every phase (in milliseconds).
+ *
+ * @param path File name, JSON if it ends with .json, CSV otherwise.
+ * @return True on success.
+ */
+bool profileSave(const char* path);
+
+/** @brief Save the profile to path when the sketch quits. See profileSave().
+ *
+ * @param path File name, nullptr to not save.
+ */
+void profileOutput(const char* path);
+
+/** @brief Get how many GL state changes (enables, blending, colors, bound buffers, textures
+ * and programs) the last drawn frame made.
+ *
+ * easySDL keeps a copy of that state and drops calls that would set what's already set,
+ * see stateChangesSkipped(). Only counted in 3D mode (window3d()).
+ *
+ * @return Number of state changes that reached the driver.
+ */
+Uint32 stateChanges();
+
+/** @brief Get how many GL state changes the last drawn frame didn't have to make.
+ *
+ * @return Number of calls dropped because the state was already set.
+ */
+Uint32 stateChangesSkipped();
+
+// Sound
+/** @brief Load a short sound effect into memory.
+ *
+ * The whole file is decoded once, so playing it costs nothing but mixing.
+ * Audio is started the first time a sound or music is loaded.
+ * WAV always works, other formats when SDL_mixer is available.
+ *
+ * @note In headless mode the dummy audio driver is used, unless SDL_AUDIODRIVER says otherwise (e.g. disk).
+ *
+ * @param path File to load.
+ * @param voices How many copies of this sound may play at once, starting another one cuts the oldest.
+ * @return Sound id for playSound(), -1 on failure.
+ */
+int loadSound(const char* path, int voices = 4);
+
+/** @brief Start playing a sound loaded with loadSound().
+ *
+ * If all 32 voices are busy the oldest one is cut off.
+ *
+ * @param sound Id from loadSound().
+ * @param volume 0-1.
+ * @param pan -1 is left, 0 is center, 1 is right.
+ * @return Voice id for stopSound() and soundPlaying(), -1 on failure.
+ */
+int playSound(int sound, float volume = 1.0f, float pan = 0.0f);
+
+/** @brief Stop a playing sound.
+ *
+ * @param voice Id from playSound().
+ */
+void stopSound(int voice);
+
+/** @brief Check if a sound is still playing.
+ *
+ * @param voice Id from playSound().
+ * @return False once it finished, was stopped or got cut off by another sound.
+ */
+bool soundPlaying(int voice);
+
+/** @brief Open a long track for streaming.
+ *
+ * The file is memory-mapped and read as it plays, so it takes (almost) no memory however long it is.
+ *
+ * @note Only 16-bit or float WAV files, mono or stereo.
+ *
+ * @param path File to open.
+ * @return Music id for playMusic(), -1 on failure.
+ */
+int loadMusic(const char* path);
+
+/** @brief Start playing music from the beginning, replaces the music playing now.
+ *
+ * @param music Id from loadMusic().
+ * @param loop Start over at the end.
+ */
+void playMusic(int music, bool loop = true);
+
+/// @brief Stop the music.
+void stopMusic();
+
+/** @brief Set the music volume.
+ *
+ * @param volume 0-1.
+ */
+void musicVolume(float volume);
+
+/** @brief Set the volume of everything.
+ *
+ * @param volume 0-1.
+ */
+void masterVolume(float volume);
+
+/** @brief Get the length of one audio buffer.
+ *
+ * @return Milliseconds, 0 if audio isn't started.
+ */
+float audioLatency();
+
 // Color
 /** @brief Set the fill color.
  *
@@ -295,12 +829,557 @@ void background(Uint8 c);
 void background(SDL_Color color);
 
 // 2D primitives
-//void rect(GLfloat x, GLfloat y, GLfloat w, GLfloat h)
+/** @brief Draws a rectangle, (x, y) is the top left corner.
+ *
+ * Uses the fill color for the inside and the stroke color for a 1 pixel outline.
+ *
+ * @note 2D primitives only work with window() for now.
+ * @note Shapes are batched and drawn together at the end of update().
+ *
+ * @param x X coordinate of the top left corner.
+ * @param y Y coordinate of the top left corner.
+ * @param w Width of the rectangle.
+ * @param h Height of the rectangle.
+ */
+void rect(GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+
+/** @brief Draws an ellipse centered at (x, y).
+ *
+ * The number of segments is picked from the on-screen size, small ellipses are cheap.
+ *
+ * @note 2D primitives only work with window() for now.
+ *
+ * @param x X coordinate of the center.
+ * @param y Y coordinate of the center.
+ * @param w Width of the ellipse.
+ * @param h Height of the ellipse.
+ */
+void ellipse(GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+
+/** @brief Draws a circle centered at (x, y). Same as ellipse(x, y, d, d).
+ *
+ * @param x X coordinate of the center.
+ * @param y Y coordinate of the center.
+ * @param d Diameter of the circle.
+ */
+void circle(GLfloat x, GLfloat y, GLfloat d);
+
+/** @brief Draws a triangle from three points.
+ *
+ * @note 2D primitives only work with window() for now.
+ */
+void triangle(GLfloat x1, GLfloat y1, GLfloat x2, GLfloat y2, GLfloat x3, GLfloat y3);
+
+/** @brief Draws a 1 pixel wide line with the stroke color.
+ *
+ * @note 2D primitives only work with window() for now.
+ *
+ * @param x1 X coordinate of the first point.
+ * @param y1 Y coordinate of the first point.
+ * @param x2 X coordinate of the second point.
+ * @param y2 Y coordinate of the second point.
+ */
+void line(GLfloat x1, GLfloat y1, GLfloat x2, GLfloat y2);
+
+/** @brief Draws a single pixel with the stroke color.
+ *
+ * @note 2D primitives only work with window() for now.
+ *
+ * @param x X coordinate.
+ * @param y Y coordinate.
+ */
+void point(GLfloat x, GLfloat y);
 
 // 3D primitives
 void box(GLfloat w, GLfloat h, GLfloat d);
 void box(GLfloat size);
 
+/** @brief Draws a sphere centered on the origin, with the fill and stroke colors.
+ *
+ * @note 3D primitives only work with window3d().
+ *
+ * @param r Radius.
+ */
+void sphere(GLfloat r);
+
+/** @brief Draws a cylinder centered on the origin, along the y axis.
+ *
+ * @param r Radius.
+ * @param h Height.
+ */
+void cylinder(GLfloat r, GLfloat h);
+
+/** @brief Draws a cone centered on the origin, along the y axis, the tip pointing up (towards -y).
+ *
+ * @param r Radius of the base.
+ * @param h Height.
+ */
+void cone(GLfloat r, GLfloat h);
+
+/** @brief Set how many segments sphere(), cylinder() and cone() have around.
+ *
+ * By default (0) it's picked from how big the shape is on the screen: a few pixels wide sphere
+ * gets a few dozen triangles, one that fills the window a few thousand.
+ * Every detail used is tessellated once and kept on the GPU, so changing it is cheap.
+ *
+ * @param res Segments around (3 to 128, spheres get half as many rings), 0 for automatic.
+ */
+void sphereDetail(int res);
+
+/** @brief Get the detail of curved 3D primitives.
+ *
+ * @return Segments around, 0 if automatic.
+ */
+int sphereDetail();
+
+// Particles
+/** @brief Create a particle system.
+ *
+ * Particles are stored as arrays of positions, velocities, colors and remaining lives,
+ * updated with SIMD on every core and drawn as points in one draw call, so a system
+ * can hold a million of them. All memory is allocated here, never during a frame.
+ *
+ * @note Particles are only drawn with window3d().
+ *
+ * @param capacity The most particles alive at once, emitting more does nothing.
+ * @return Particle system id, -1 on failure.
+ */
+int particleSystem(int capacity);
+
+/** @brief Add one particle, with the fill color.
+ *
+ * @param system Particle system id from particleSystem().
+ * @param x, y, z Position.
+ * @param vx, vy, vz Velocity in pixels per second.
+ * @param life Seconds until it disappears.
+ */
+void emitParticle(int system, GLfloat x, GLfloat y, GLfloat z, GLfloat vx, GLfloat vy, GLfloat vz, float life);
+
+/** @brief Add particles at a point, flying off in random directions, with the fill color.
+ *
+ * @param system Particle system id from particleSystem().
+ * @param count How many.
+ * @param x, y, z Position.
+ * @param speed Fastest speed in pixels per second, the slowest ones get half of it.
+ * @param life Seconds until they disappear.
+ */
+void emitParticles(int system, int count, GLfloat x, GLfloat y, GLfloat z, float speed, float life);
+
+/** @brief Set an acceleration applied to every particle, for example particleGravity(ps, 0, 500, 0).
+ *
+ * @param system Particle system id from particleSystem().
+ * @param x, y, z Acceleration in pixels per second squared.
+ */
+void particleGravity(int system, GLfloat x, GLfloat y, GLfloat z);
+
+/** @brief Set how much of its velocity a particle loses per second.
+ *
+ * @param system Particle system id from particleSystem().
+ * @param drag 0 (default) to 1.
+ */
+void particleDrag(int system, float drag);
+
+/** @brief Set a point that pulls particles in (or pushes them away), falling off with distance squared.
+ *
+ * @param system Particle system id from particleSystem().
+ * @param index Which attractor, 0 to 7.
+ * @param x, y, z Position.
+ * @param strength Acceleration at 1 pixel away, negative to push, 0 to remove the attractor.
+ */
+void particleAttractor(int system, int index, GLfloat x, GLfloat y, GLfloat z, float strength);
+
+/** @brief Move all particles forward in time and remove the ones whose life ran out.
+ *
+ * @param system Particle system id from particleSystem().
+ * @param dt Seconds, for example frameDelta/1000.
+ */
+void updateParticles(int system, float dt);
+
+/** @brief Draw all particles as squares, in the current matrix.
+ *
+ * Particles move every frame, so this can't be recorded between beginList() and endList().
+ *
+ * @param system Particle system id from particleSystem().
+ * @param size Size in pixels.
+ */
+void drawParticles(int system, float size);
+
+/** @brief Get how many particles are alive.
+ *
+ * @param system Particle system id from particleSystem().
+ * @return Number of particles, 0 if there's no such system.
+ */
+int particleCount(int system);
+
+// Picking
+/** @brief Register a rectangle, like rect(), as something the mouse can pick this frame.
+ *
+ * Call it next to whatever you draw there, it goes through the same matrix. The objects
+ * registered in a frame can be queried from the next frame on, which is while that frame
+ * is on screen, so the queries match what the user sees.
+ *
+ * @param id Your id for the object, returned by the queries.
+ * @param x, y Top left corner.
+ * @param w, h Width and height.
+ */
+void pickable(int id, GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+
+/** @brief Register a box, like box(), as something the mouse can pick this frame.
+ *
+ * @note Only works with window3d().
+ *
+ * @param id Your id for the object, returned by the queries.
+ * @param w, h, d Width, height and depth.
+ */
+void pickable(int id, GLfloat w, GLfloat h, GLfloat d);
+
+/** @brief Get the front-most object under a point, for example pick(mouseX, mouseY).
+ *
+ * Objects are compared by their screen-space bounds. In 2D the one registered last is in
+ * front, in 3D the nearest one along the view direction.
+ *
+ * @param x, y Window coordinates.
+ * @return The object's id, -1 if there's nothing there.
+ */
+int pick(GLfloat x, GLfloat y);
+
+/** @brief Get every object under a point, front to back.
+ *
+ * @param x, y Window coordinates.
+ * @param ids Array the ids are written to.
+ * @param maxIds Size of the array.
+ * @return Number of ids written.
+ */
+int pickAll(GLfloat x, GLfloat y, int* ids, int maxIds);
+
+/** @brief Get every object overlapping a rectangle, front to back, for example for drag selection.
+ *
+ * @param x, y, w, h Rectangle in window coordinates.
+ * @param ids Array the ids are written to.
+ * @param maxIds Size of the array.
+ * @return Number of ids written.
+ */
+int pickRect(GLfloat x, GLfloat y, GLfloat w, GLfloat h, int* ids, int maxIds);
+
+/** @brief Get every object within a distance of a point, nearest first.
+ *
+ * @param x, y Window coordinates.
+ * @param radius Distance in pixels.
+ * @param ids Array the ids are written to.
+ * @param maxIds Size of the array.
+ * @return Number of ids written.
+ */
+int pickRadius(GLfloat x, GLfloat y, GLfloat radius, int* ids, int maxIds);
+
+/** @brief Get how many objects the picking functions are looking at.
+ *
+ * @return Number of objects registered with pickable() in the frame on screen.
+ */
+int pickableCount();
+
+/** @brief Enable or disable sorting of queued 3D draws by state before they're drawn.
+ *
+ * Images are grouped by texture page, so every page is bound once per frame,
+ * and without instancing 3D primitives are grouped by color.
+ * Off by default, since it changes the order translucent things are blended in.
+ *
+ * @param enable True to sort.
+ */
+void sortDraws(bool enable);
+
+/** @brief Get draw sorting state.
+ *
+ * @return True if queued 3D draws are sorted, see sortDraws(bool).
+ */
+bool sortDraws();
+
+/** @brief Enable or disable frustum culling of 3D primitives and image() in 3D mode.
+ *
+ * The bounding box of every primitive is tested against the visible volume before
+ * anything is queued, so objects entirely off-screen cost a few multiplications.
+ * On by default.
+ *
+ * @param enable True to cull.
+ */
+void frustumCulling(bool enable);
+
+/** @brief Get frustum culling state.
+ *
+ * @return True if off-screen 3D primitives are skipped.
+ */
+bool frustumCulling();
+
+/** @brief Get how many 3D primitives the last drawn frame skipped as off-screen.
+ *
+ * @return Number of culled 3D primitives and image() calls.
+ */
+Uint32 culledObjects();
+
+/** @brief Get how many 3D primitives the last drawn frame actually drew.
+ *
+ * @return Number of 3D primitives and image() calls that were at least partly visible.
+ */
+Uint32 drawnObjects();
+
+// Pixels
+/** @brief Pack a color for pixels[].
+ *
+ * @param r, g, b, a Red, green, blue and alpha, 0 to 255.
+ * @return The color as 0xAARRGGBB.
+ */
+Uint32 color(Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255);
+
+/** @brief Make pixels[] ready to read and write.
+ *
+ * pixels[] is a window sized layer of its own, pixels[y*width + x] is the pixel at (x, y).
+ * It starts out transparent and keeps what you write between frames, so a cellular
+ * automaton can read its last generation back from it. It doesn't contain what shapes
+ * and images drew, updatePixels() draws it over them.
+ *
+ * Writes go straight into memory the GPU uploads from where the renderer allows it:
+ * a persistently mapped buffer with window3d(), the texture's own memory with window()
+ * on the software renderer.
+ *
+ * @note Call it every frame before touching pixels[], with threadedMode() it waits for
+ * the render thread to finish uploading the last frame's pixels. Don't keep the pointer.
+ */
+void loadPixels();
+
+/** @brief Upload all of pixels[] and draw it over everything drawn so far this frame.
+ */
+void updatePixels();
+
+/** @brief Upload only the part of pixels[] that changed and draw all of it.
+ *
+ * Uploading is the expensive part, so when only part of the window changed, say which.
+ *
+ * @param x, y Top left corner of what changed.
+ * @param w, h Width and height of what changed.
+ */
+void updatePixels(int x, int y, int w, int h);
+
+// Filters
+/** @brief Filter everything drawn so far this frame.
+ *
+ * Like Processing's filter(): the frame is read back into pixels[] (replacing what was
+ * there), filtered there and drawn back over the window. Call it after drawing what it
+ * should apply to, loadPixels() afterwards gives the filtered frame.
+ * Filters run four pixels at a time with SSE2, split across cores.
+ *
+ * @note Reading the frame back waits for the GPU to finish it, and works at window size,
+ * use it once or twice a frame, not per object.
+ *
+ * @param kind What to do, see FilterKind.
+ */
+void filter(FilterKind kind);
+/** @brief Filter everything drawn so far this frame with a parameter.
+ *
+ * @param kind What to do, see FilterKind.
+ * @param param Threshold level, posterize levels or radius, see FilterKind. Radiuses go up to
+ * 128 pixels, FILTER_BLUR's taps reach 3 times its radius. The cost of FILTER_BOX_BLUR doesn't
+ * depend on the radius, it's the one for big blurs.
+ */
+void filter(FilterKind kind, float param);
+/** @brief Filter a buffer of colors in place, say before turning it into an image with createImage().
+ *
+ * @param buffer w*h colors from color(), top row first.
+ * @param w, h Size of the buffer in pixels.
+ * @param kind What to do, see FilterKind.
+ */
+void filter(Uint32* buffer, int w, int h, FilterKind kind);
+/// @brief Filter a buffer of colors in place with a parameter, see filter(FilterKind, float).
+void filter(Uint32* buffer, int w, int h, FilterKind kind, float param);
+
+/** @brief Convolve everything drawn so far this frame with a 3x3 or 5x5 kernel.
+ *
+ * Works like filter(). Each color channel becomes the sum of the kernel times the pixels
+ * around it, clamped to 0 to 255. Alpha is left alone. The kernel isn't normalized:
+ * {0, -1, 0, -1, 5, -1, 0, -1, 0} sharpens, nine 1/9s blur.
+ *
+ * @param kernel size*size weights, kernel[row*size + column], centered on the pixel.
+ * @param size 3 or 5.
+ */
+void convolve(const float* kernel, int size);
+/// @brief Convolve a buffer of colors in place, see convolve(const float*, int) and filter(Uint32*, int, int, FilterKind).
+void convolve(Uint32* buffer, int w, int h, const float* kernel, int size);
+
+// Images
+/** @brief Start loading an image, returns right away.
+ *
+ * Decoding happens on worker threads, so loading hundreds of images in setup() doesn't
+ * hold up the first frame. Until the image is ready image() just skips it, use
+ * imageLoaded() or waitImages() if that matters.
+ * Small images (up to 256x256) are packed together into shared textures,
+ * so drawing lots of them doesn't switch textures all the time.
+ *
+ * @note BMP always works, other formats when SDL_image is available.
+ *
+ * @param path File to load.
+ * @return Image id for image(), it is valid even if loading fails later.
+ */
+int loadImage(const char* path);
+
+/** @brief Draw an image at its own size.
+ *
+ * In 3D mode (window3d()) the image lies in the z = 0 plane of the current matrix.
+ *
+ * @param img Id from loadImage().
+ * @param x X coordinate of the top left corner.
+ * @param y Y coordinate of the top left corner.
+ */
+void image(int img, GLfloat x, GLfloat y);
+/** @brief Draw an image stretched to w*h.
+ *
+ * @param img Id from loadImage().
+ * @param x X coordinate of the top left corner.
+ * @param y Y coordinate of the top left corner.
+ * @param w Width.
+ * @param h Height.
+ */
+void image(int img, GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+
+/** @brief Check if an image is decoded.
+ *
+ * @param img Id from loadImage().
+ * @return False while it's loading or if it failed.
+ */
+bool imageLoaded(int img);
+/// @brief Width of an image in pixels, 0 until it's loaded.
+int imageWidth(int img);
+/// @brief Height of an image in pixels, 0 until it's loaded.
+int imageHeight(int img);
+
+/** @brief Make an image out of colors in memory, say a filter()ed buffer.
+ *
+ * The colors are copied, the buffer stays yours. Images made this way are never evicted.
+ *
+ * @note Main thread only.
+ *
+ * @param colors w*h colors from color(), top row first.
+ * @param w, h Size in pixels.
+ * @return Image id for image(), -1 on failure.
+ */
+int createImage(const Uint32* colors, int w, int h);
+
+/// @brief Wait until every image loaded so far is ready (or failed).
+void waitImages();
+
+/** @brief Set how much texture memory images may use, 256 MB by default.
+ *
+ * When over it, the textures that weren't drawn for the longest time are freed.
+ * Their images are loaded again (in the background) when drawn the next time.
+ *
+ * @param megabytes Budget in megabytes.
+ */
+void textureBudget(int megabytes);
+/// @brief Texture memory images use now, in megabytes.
+float textureMemory();
+
+// Text
+/** @brief Load a TrueType font.
+ *
+ * The first font loaded becomes the current one, see textFont().
+ *
+ * @note Needs SDL_ttf.
+ *
+ * @param path .ttf or .otf file.
+ * @return Font id for textFont(), -1 on failure.
+ */
+int loadFont(const char* path);
+
+/** @brief Set the font text() uses.
+ *
+ * @param font Id from loadFont().
+ */
+void textFont(int font);
+
+/** @brief Set the text size, 12 by default.
+ *
+ * @param size Height in pixels, rounded to a whole pixel.
+ */
+void textSize(float size);
+
+/** @brief Draw text in the fill color.
+ *
+ * Glyphs are rendered once per font and size, and whole strings are laid out once and
+ * remembered, so drawing the same labels every frame is cheap. '\n' starts a new line.
+ *
+ * @param str UTF-8 text.
+ * @param x X coordinate of the start of the text.
+ * @param y Y coordinate of the baseline.
+ */
+void text(const char* str, GLfloat x, GLfloat y);
+
+/** @brief Get how wide text would be in the current font and size.
+ *
+ * @param str UTF-8 text.
+ * @return Width in pixels (of the longest line), 0 without a font.
+ */
+float textWidth(const char* str);
+
+// Display lists
+/** @brief Start recording a new display list.
+ *
+ * Until endList() the drawing functions (background(), box(), the 2D primitives and
+ * the matrix functions) are recorded instead of drawn, together with the fill and stroke
+ * colors at the time of the call. drawList() then replays the whole thing with one call.
+ *
+ * @return Id of the new list, -1 on error.
+ */
+int beginList();
+
+/** @brief Record an existing display list again, replacing what was in it.
+ *
+ * @param id Id returned by beginList().
+ */
+void beginList(int id);
+
+/// @brief Stop recording the display list started with beginList().
+void endList();
+
+/** @brief Draw a display list.
+ *
+ * The current transformation applies, like when calling the recorded functions directly.
+ * Inside another beginList() the commands are copied into that list.
+ *
+ * @param id Id returned by beginList().
+ */
+void drawList(int id);
+
+/** @brief Delete a display list, its id can be reused by beginList().
+ *
+ * @param id Id returned by beginList().
+ */
+void deleteList(int id);
+
+/** @brief Don't draw or present frames that are the same as the one on screen.
+ *
+ * Every frame is recorded like a display list and hashed. If the hash matches the last
+ * presented frame nothing is drawn and the buffers aren't swapped, the window just keeps
+ * showing the old frame. Great for dashboards that change a few times a second.
+ *
+ * @note Drawing done directly with SDL or OpenGL isn't seen, call redraw() after it.
+ * Has no effect in threadedMode().
+ *
+ * @param enable True to skip unchanged frames.
+ */
+void skipUnchangedFrames(bool enable);
+
+/** @brief Get unchanged frame skipping state.
+ *
+ * @return True if unchanged frames are skipped.
+ */
+bool skipUnchangedFrames();
+
+/// @brief Draw and present the next frame even if it didn't change. See skipUnchangedFrames().
+void redraw();
+
+/** @brief Get the number of frames skipped so far. See skipUnchangedFrames().
+ *
+ * @return Frames that weren't drawn because nothing changed.
+ */
+Uint32 skippedFrames();
+
 // Matrix
 /** @brief Pushes current transformation matrix to the stack.
  *
@@ -325,7 +1404,7 @@ void popMatrix();
  * If translate() is called within update(), the transformation is reset when the loop begins again.
  * This function can be further controlled by using pushMatrix() and popMatrix().
  *
- * @note Using this function with the z parameter requires using window3d().
+ * @note Using this function with the z parameter requires using window3d(), z is ignored in 2D.
  *
  * @param x Amount to move left/right
  * @param y Amount to move up/down
@@ -366,7 +1445,7 @@ void rotateY(GLfloat angle);
  * For example, calling rotateY(PI/2) and then rotateY(PI/2) is the same as rotateY(PI).
  * If rotateY() is run within the update(), the transformation is reset when the loop begins again.
  *
- * @note Using this function requires using window3d().
+ * @note In 2D mode (window()) this is the same as rotate().
  *
  * @param angle Angle of rotation in radians.
  */
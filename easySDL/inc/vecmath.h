@@ -0,0 +1,194 @@
+
+/** @file
+ * @brief Small vector and matrix types, used by the matrix functions and free for your own math.
+ */
+
+#ifndef EASYSDL_VECMATH_H
+#define EASYSDL_VECMATH_H
+
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/** @brief 2D vector.
+ *
+ * Like Processing's PVector, but a plain value: operators return new vectors
+ * and nothing allocates, so it's fine to make millions of them per frame.
+ */
+struct vec2 {
+    float x, y;
+
+    constexpr vec2() : x(0), y(0) {};
+    constexpr vec2(float x, float y) : x(x), y(y) {};
+
+    constexpr vec2 operator+(const vec2& o) const { return {x + o.x, y + o.y}; };
+    constexpr vec2 operator-(const vec2& o) const { return {x - o.x, y - o.y}; };
+    constexpr vec2 operator-() const { return {-x, -y}; };
+    constexpr vec2 operator*(float s) const { return {x*s, y*s}; };
+    constexpr vec2 operator/(float s) const { return {x/s, y/s}; };
+    vec2& operator+=(const vec2& o) { x += o.x; y += o.y; return *this; };
+    vec2& operator-=(const vec2& o) { x -= o.x; y -= o.y; return *this; };
+    vec2& operator*=(float s) { x *= s; y *= s; return *this; };
+    vec2& operator/=(float s) { x /= s; y /= s; return *this; };
+
+    constexpr float dot(const vec2& o) const { return x*o.x + y*o.y; };
+    constexpr float magSq() const { return x*x + y*y; };
+    float mag() const { return sqrtf(magSq()); };
+    /// @brief Same direction, length 1. The zero vector stays zero.
+    vec2 normalized() const { float m = mag(); return m > 0 ? *this/m : *this; };
+    /// @brief Angle from the positive x axis in radians.
+    float heading() const { return atan2f(y, x); };
+    vec2 rotated(float angle) const { float s = sinf(angle), c = cosf(angle); return {x*c - y*s, x*s + y*c}; };
+
+    static vec2 fromAngle(float angle) { return {cosf(angle), sinf(angle)}; };
+};
+
+/** @brief 3D vector.
+ *
+ * Three floats without padding, so arrays of them can go to OpenGL as is.
+ * Use vec4 where alignment matters more than size.
+ */
+struct vec3 {
+    float x, y, z;
+
+    constexpr vec3() : x(0), y(0), z(0) {};
+    constexpr vec3(float x, float y, float z = 0) : x(x), y(y), z(z) {};
+    constexpr vec3(const vec2& v, float z = 0) : x(v.x), y(v.y), z(z) {};
+
+    constexpr vec3 operator+(const vec3& o) const { return {x + o.x, y + o.y, z + o.z}; };
+    constexpr vec3 operator-(const vec3& o) const { return {x - o.x, y - o.y, z - o.z}; };
+    constexpr vec3 operator-() const { return {-x, -y, -z}; };
+    constexpr vec3 operator*(float s) const { return {x*s, y*s, z*s}; };
+    constexpr vec3 operator/(float s) const { return {x/s, y/s, z/s}; };
+    vec3& operator+=(const vec3& o) { x += o.x; y += o.y; z += o.z; return *this; };
+    vec3& operator-=(const vec3& o) { x -= o.x; y -= o.y; z -= o.z; return *this; };
+    vec3& operator*=(float s) { x *= s; y *= s; z *= s; return *this; };
+    vec3& operator/=(float s) { x /= s; y /= s; z /= s; return *this; };
+
+    constexpr float dot(const vec3& o) const { return x*o.x + y*o.y + z*o.z; };
+    constexpr vec3 cross(const vec3& o) const { return {y*o.z - z*o.y, z*o.x - x*o.z, x*o.y - y*o.x}; };
+    constexpr float magSq() const { return x*x + y*y + z*z; };
+    float mag() const { return sqrtf(magSq()); };
+    /// @brief Same direction, length 1. The zero vector stays zero.
+    vec3 normalized() const { float m = mag(); return m > 0 ? *this/m : *this; };
+};
+
+/// @brief 4D vector, aligned so it's a single SSE load.
+struct alignas(16) vec4 {
+    float x, y, z, w;
+
+    constexpr vec4() : x(0), y(0), z(0), w(0) {};
+    constexpr vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {};
+    constexpr vec4(const vec3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {};
+
+    constexpr vec4 operator+(const vec4& o) const { return {x + o.x, y + o.y, z + o.z, w + o.w}; };
+    constexpr vec4 operator-(const vec4& o) const { return {x - o.x, y - o.y, z - o.z, w - o.w}; };
+    constexpr vec4 operator*(float s) const { return {x*s, y*s, z*s, w*s}; };
+    constexpr float dot(const vec4& o) const { return x*o.x + y*o.y + z*o.z + w*o.w; };
+    constexpr vec3 xyz() const { return {x, y, z}; };
+};
+
+constexpr vec2 operator*(float s, const vec2& v) { return v*s; }
+constexpr vec3 operator*(float s, const vec3& v) { return v*s; }
+constexpr vec4 operator*(float s, const vec4& v) { return v*s; }
+
+/// @brief Linear interpolation, t = 0 gives a and t = 1 gives b.
+constexpr vec2 lerp(const vec2& a, const vec2& b, float t) { return a + (b - a)*t; }
+constexpr vec3 lerp(const vec3& a, const vec3& b, float t) { return a + (b - a)*t; }
+inline float dist(const vec2& a, const vec2& b) { return (b - a).mag(); }
+inline float dist(const vec3& a, const vec3& b) { return (b - a).mag(); }
+
+/** @brief 4x4 matrix, column-major like OpenGL, aligned so each column is a single SSE load.
+ *
+ * The in-place functions (translate(), rotateX() and etc.) multiply from the right,
+ * same as glTranslatef()/glRotatef(), but only touch the columns that change.
+ */
+struct alignas(16) mat4 {
+    float m[16];
+
+    static constexpr mat4 identity() { return {{1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1}}; };
+    static constexpr mat4 translation(float x, float y, float z) {
+        return {{1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  x, y, z, 1}};
+    };
+    static constexpr mat4 scaling(float x, float y, float z) {
+        return {{x, 0, 0, 0,  0, y, 0, 0,  0, 0, z, 0,  0, 0, 0, 1}};
+    };
+
+    const float* data() const { return m; };
+    constexpr vec4 column(int i) const { return {m[i*4], m[i*4 + 1], m[i*4 + 2], m[i*4 + 3]}; };
+
+    /// @brief Returns this * o, i.e. o is applied first.
+    mat4 operator*(const mat4& o) const {
+        mat4 r;
+#ifdef __SSE2__
+        __m128 c0 = _mm_load_ps(m), c1 = _mm_load_ps(m + 4), c2 = _mm_load_ps(m + 8), c3 = _mm_load_ps(m + 12);
+        for (int i = 0; i < 4; i++) {
+            const float* b = o.m + i*4;
+            __m128 col = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(b[0])), _mm_mul_ps(c1, _mm_set1_ps(b[1]))),
+                                    _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(b[2])), _mm_mul_ps(c3, _mm_set1_ps(b[3]))));
+            _mm_store_ps(r.m + i*4, col);
+        }
+#else
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                r.m[i*4 + j] = m[j]*o.m[i*4] + m[4 + j]*o.m[i*4 + 1] + m[8 + j]*o.m[i*4 + 2] + m[12 + j]*o.m[i*4 + 3];
+#endif
+        return r;
+    };
+
+    vec4 operator*(const vec4& v) const {
+#ifdef __SSE2__
+        vec4 r;
+        _mm_store_ps(&r.x, _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_load_ps(m), _mm_set1_ps(v.x)), _mm_mul_ps(_mm_load_ps(m + 4), _mm_set1_ps(v.y))),
+            _mm_add_ps(_mm_mul_ps(_mm_load_ps(m + 8), _mm_set1_ps(v.z)), _mm_mul_ps(_mm_load_ps(m + 12), _mm_set1_ps(v.w)))));
+        return r;
+#else
+        return {m[0]*v.x + m[4]*v.y + m[8]*v.z + m[12]*v.w, m[1]*v.x + m[5]*v.y + m[9]*v.z + m[13]*v.w,
+                m[2]*v.x + m[6]*v.y + m[10]*v.z + m[14]*v.w, m[3]*v.x + m[7]*v.y + m[11]*v.z + m[15]*v.w};
+#endif
+    };
+
+    /// @brief Transforms a point (w = 1), without the divide by w.
+    constexpr vec3 transformPoint(const vec3& p) const {
+        return {m[0]*p.x + m[4]*p.y + m[8]*p.z + m[12],
+                m[1]*p.x + m[5]*p.y + m[9]*p.z + m[13],
+                m[2]*p.x + m[6]*p.y + m[10]*p.z + m[14]};
+    };
+
+    void translate(float x, float y, float z) {
+        for (int j = 0; j < 4; j++) m[12 + j] += m[j]*x + m[4 + j]*y + m[8 + j]*z;
+    };
+    void scale(float x, float y, float z) {
+        for (int j = 0; j < 4; j++) {
+            m[j] *= x;
+            m[4 + j] *= y;
+            m[8 + j] *= z;
+        }
+    };
+    void rotateX(float angle) { rotateColumns(4, 8, angle); };
+    void rotateY(float angle) { rotateColumns(8, 0, angle); };
+    void rotateZ(float angle) { rotateColumns(0, 4, angle); };
+
+private:
+    // Rotation around the third axis only mixes the other two columns: a' = a*c + b*s, b' = b*c - a*s
+    void rotateColumns(int a, int b, float angle) {
+        float s = sinf(angle), c = cosf(angle);
+#ifdef __SSE2__
+        __m128 ca = _mm_load_ps(m + a), cb = _mm_load_ps(m + b);
+        __m128 vs = _mm_set1_ps(s), vc = _mm_set1_ps(c);
+        _mm_store_ps(m + a, _mm_add_ps(_mm_mul_ps(ca, vc), _mm_mul_ps(cb, vs)));
+        _mm_store_ps(m + b, _mm_sub_ps(_mm_mul_ps(cb, vc), _mm_mul_ps(ca, vs)));
+#else
+        for (int j = 0; j < 4; j++) {
+            float va = m[a + j], vb = m[b + j];
+            m[a + j] = va*c + vb*s;
+            m[b + j] = vb*c - va*s;
+        }
+#endif
+    };
+};
+
+#endif //EASYSDL_VECMATH_H
@@ -0,0 +1,206 @@
+
+/** @file
+ * @brief Batched 2D primitive tessellation and submission.
+ */
+
+#include "batch2d.h"
+#include "images.h"
+#include "matrix2d.h"
+#include "internal.h"
+
+#include <cmath>
+
+SDL_Renderer* Batch2D::renderer = nullptr;
+std::vector<SDL_FPoint> Batch2D::positions;
+std::vector<SDL_Color> Batch2D::colors;
+std::vector<int> Batch2D::indices;
+std::vector<SDL_FPoint> Batch2D::uvs;
+std::vector<Batch2D::Run> Batch2D::runs;
+int Batch2D::currentPage = -1;
+SDL_FPoint Batch2D::unitCircle[Batch2D::circleLevels][128];
+
+static const float halfStroke = 0.5f; // Strokes are 1 pixel wide, centered on the outline
+
+void Batch2D::init(SDL_Renderer* r) {
+    renderer = r;
+    // Geometry without a texture uses the draw blend mode, alpha has to work like in 3D
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+    for (int level = 0; level < circleLevels; level++) {
+        int segments = 8 << level;
+        for (int i = 0; i < segments; i++) {
+            float angle = 6.2831855f * i / segments;
+            unitCircle[level][i] = {cosf(angle), sinf(angle)};
+        }
+    }
+
+    positions.reserve(4096);
+    colors.reserve(4096);
+    uvs.reserve(4096);
+    indices.reserve(8192);
+}
+
+void Batch2D::quit() {
+    positions = {}; colors = {}; indices = {}; uvs = {}; runs = {};
+    renderer = nullptr;
+}
+
+void Batch2D::background(SDL_Color color) {
+    positions.clear(); colors.clear(); indices.clear(); uvs.clear(); runs.clear();
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderClear(renderer);
+}
+
+void Batch2D::flush() {
+    if (renderer == nullptr || indices.empty()) return;
+    bool textured = false;
+    for (const Run& run : runs) textured |= run.page >= 0;
+    if (textured) Images::upload();
+
+    for (size_t i = 0; i < runs.size(); i++) {
+        const Run& run = runs[i];
+        int end = i + 1 < runs.size() ? runs[i + 1].first : (int) indices.size();
+        SDL_Texture* texture = run.page >= 0 ? Images::get_texture(run.page) : nullptr;
+        if (run.page >= 0 && texture == nullptr) continue; // Texture creation failed, already reported
+        if (SDL_RenderGeometryRaw(renderer, texture,
+                                  &positions[0].x, sizeof(SDL_FPoint),
+                                  colors.data(), sizeof(SDL_Color),
+                                  texture != nullptr ? &uvs[0].x : nullptr, sizeof(SDL_FPoint),
+                                  (int) positions.size(),
+                                  indices.data() + run.first, end - run.first, sizeof(int)) < 0) {
+            ErrorSDL("Failed to render 2D geometry!");
+            break;
+        }
+    }
+    // Capacity stays for the next frame
+    positions.clear(); colors.clear(); indices.clear(); uvs.clear(); runs.clear();
+}
+
+int Batch2D::addVertices(const SDL_FPoint* local, int count, SDL_Color color) {
+    // Always called before the indices of a primitive are added, so this is where runs start
+    if (runs.empty() || runs.back().page != currentPage) runs.push_back({currentPage, (int) indices.size()});
+
+    int first = (int) positions.size();
+    positions.resize(first + count);
+    MatrixStack2D::transformPoints(local, &positions[first], count);
+    colors.insert(colors.end(), count, color);
+    uvs.resize(first + count);
+    return first;
+}
+
+void Batch2D::addQuad(const SDL_FPoint* local, SDL_Color color) {
+    int v = addVertices(local, 4, color);
+    indices.insert(indices.end(), {v, v + 1, v + 2, v, v + 2, v + 3});
+}
+
+// Band between two closed outlines with the same vertex count
+void Batch2D::addRing(const SDL_FPoint* outer, const SDL_FPoint* inner, int count, SDL_Color color) {
+    int o = addVertices(outer, count, color);
+    int in = addVertices(inner, count, color);
+    for (int i = 0; i < count; i++) {
+        int j = (i + 1) % count;
+        indices.insert(indices.end(), {o + i, o + j, in + j, o + i, in + j, in + i});
+    }
+}
+
+// Max error of a chord is r*(1 - cos(PI/n)) ~ r*PI^2/(2n^2), keep it under half a pixel
+int Batch2D::circleLevel(float radius) {
+    const Affine2D& m = MatrixStack2D::get_current();
+    float screenRadius = radius * sqrtf(fabsf(m.a*m.d - m.b*m.c));
+    float segments = 3.1415927f * sqrtf(screenRadius);
+    int level = 0;
+    while (level < circleLevels - 1 && (8 << level) < segments) level++;
+    return level;
+}
+
+void Batch2D::rect(float x, float y, float w, float h, SDL_Color fill, SDL_Color stroke) {
+    if (fill.a != 0) {
+        SDL_FPoint quad[4] = {{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}};
+        addQuad(quad, fill);
+    }
+    if (stroke.a != 0) {
+        float s = halfStroke;
+        SDL_FPoint outer[4] = {{x - s, y - s}, {x + w + s, y - s}, {x + w + s, y + h + s}, {x - s, y + h + s}};
+        SDL_FPoint inner[4] = {{x + s, y + s}, {x + w - s, y + s}, {x + w - s, y + h - s}, {x + s, y + h - s}};
+        addRing(outer, inner, 4, stroke);
+    }
+}
+
+void Batch2D::ellipse(float x, float y, float w, float h, SDL_Color fill, SDL_Color stroke) {
+    float rx = w / 2, ry = h / 2;
+    int level = circleLevel(fabsf(rx) > fabsf(ry) ? fabsf(rx) : fabsf(ry));
+    int segments = 8 << level;
+    const SDL_FPoint* circle = unitCircle[level];
+
+    SDL_FPoint rim[128];
+    if (fill.a != 0) {
+        for (int i = 0; i < segments; i++) rim[i] = {x + circle[i].x*rx, y + circle[i].y*ry};
+        SDL_FPoint center = {x, y};
+        int c = addVertices(&center, 1, fill);
+        int r = addVertices(rim, segments, fill);
+        for (int i = 0; i < segments; i++)
+            indices.insert(indices.end(), {c, r + i, r + (i + 1) % segments});
+    }
+    if (stroke.a != 0) {
+        SDL_FPoint inner[128];
+        for (int i = 0; i < segments; i++) {
+            rim[i] = {x + circle[i].x*(rx + halfStroke), y + circle[i].y*(ry + halfStroke)};
+            inner[i] = {x + circle[i].x*(rx - halfStroke), y + circle[i].y*(ry - halfStroke)};
+        }
+        addRing(rim, inner, segments, stroke);
+    }
+}
+
+void Batch2D::triangle(float x1, float y1, float x2, float y2, float x3, float y3,
+                       SDL_Color fill, SDL_Color stroke) {
+    if (fill.a != 0) {
+        SDL_FPoint tri[3] = {{x1, y1}, {x2, y2}, {x3, y3}};
+        int v = addVertices(tri, 3, fill);
+        indices.insert(indices.end(), {v, v + 1, v + 2});
+    }
+    if (stroke.a != 0) {
+        line(x1, y1, x2, y2, stroke);
+        line(x2, y2, x3, y3, stroke);
+        line(x3, y3, x1, y1, stroke);
+    }
+}
+
+void Batch2D::line(float x1, float y1, float x2, float y2, SDL_Color stroke) {
+    if (stroke.a == 0) return;
+    float dx = x2 - x1, dy = y2 - y1;
+    float length = sqrtf(dx*dx + dy*dy);
+    if (length == 0.0f) {
+        point(x1, y1, stroke);
+        return;
+    }
+    // Perpendicular, half a pixel long
+    float nx = -dy / length * halfStroke, ny = dx / length * halfStroke;
+    SDL_FPoint quad[4] = {{x1 + nx, y1 + ny}, {x2 + nx, y2 + ny}, {x2 - nx, y2 - ny}, {x1 - nx, y1 - ny}};
+    addQuad(quad, stroke);
+}
+
+void Batch2D::point(float x, float y, SDL_Color stroke) {
+    if (stroke.a == 0) return;
+    float s = halfStroke;
+    SDL_FPoint quad[4] = {{x - s, y - s}, {x + s, y - s}, {x + s, y + s}, {x - s, y + s}};
+    addQuad(quad, stroke);
+}
+
+void Batch2D::image(int id, float x, float y, float w, float h, SDL_Color tint) {
+    ImageRegion region;
+    if (!Images::lookup(id, region)) return;
+    if (w < 0) {
+        w = (float) region.width;
+        h = (float) region.height;
+    }
+
+    SDL_FPoint quad[4] = {{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}};
+    currentPage = region.page;
+    int v = addVertices(quad, 4, tint);
+    currentPage = -1;
+    uvs[v] = {region.u0, region.v0};
+    uvs[v + 1] = {region.u1, region.v0};
+    uvs[v + 2] = {region.u1, region.v1};
+    uvs[v + 3] = {region.u0, region.v1};
+    indices.insert(indices.end(), {v, v + 1, v + 2, v, v + 2, v + 3});
+}
@@ -0,0 +1,68 @@
+
+/** @file
+ * @brief Batched 2D primitives for window() (SDL_Renderer) mode.
+ */
+
+#ifndef EASYSDL_BATCH2D_H
+#define EASYSDL_BATCH2D_H
+
+#include <SDL2/SDL.h>
+
+#include <vector>
+
+/** @class Batch2D
+ * @brief Tessellates 2D primitives into one vertex/index buffer per frame.
+ *
+ * Every primitive is turned into triangles on the CPU, transformed with MatrixStack2D
+ * and appended to the frame buffers. flush() submits the whole frame right before
+ * SDL_RenderPresent(), one SDL_RenderGeometryRaw() call per run of the same texture
+ * (images from one atlas page are a single run, plain shapes another).
+ * The buffers keep their capacity between frames, so a steady scene doesn't allocate.
+ */
+class Batch2D {
+public:
+    Batch2D() = delete;
+
+    static void init(SDL_Renderer* renderer);
+    static void quit();
+
+    /// @brief Drops everything queued (it would be covered anyway) and clears the target.
+    static void background(SDL_Color color);
+    static void flush();
+
+    static void rect(float x, float y, float w, float h, SDL_Color fill, SDL_Color stroke);
+    static void ellipse(float x, float y, float w, float h, SDL_Color fill, SDL_Color stroke);
+    static void triangle(float x1, float y1, float x2, float y2, float x3, float y3,
+                         SDL_Color fill, SDL_Color stroke);
+    static void line(float x1, float y1, float x2, float y2, SDL_Color stroke);
+    static void point(float x, float y, SDL_Color stroke);
+    /// @brief Image from loadImage(), w < 0 for its own size. Skipped while it's still loading.
+    static void image(int id, float x, float y, float w, float h, SDL_Color tint);
+
+    static Uint32 get_vertexCount() { return (Uint32) positions.size(); };
+
+private:
+    static SDL_Renderer* renderer;
+    static std::vector<SDL_FPoint> positions;
+    static std::vector<SDL_Color> colors;
+    static std::vector<int> indices;
+    static std::vector<SDL_FPoint> uvs;
+
+    /// @brief Indices from first up to the next run use the same texture page (-1 for none).
+    struct Run {
+        int page;
+        int first;
+    };
+    static std::vector<Run> runs;
+    static int currentPage;
+
+    static const int circleLevels = 5; // 8, 16, 32, 64 and 128 segments
+    static SDL_FPoint unitCircle[circleLevels][128];
+
+    static int addVertices(const SDL_FPoint* local, int count, SDL_Color color);
+    static void addQuad(const SDL_FPoint* local, SDL_Color color);
+    static void addRing(const SDL_FPoint* outer, const SDL_FPoint* inner, int count, SDL_Color color);
+    static int circleLevel(float radius);
+};
+
+#endif //EASYSDL_BATCH2D_H
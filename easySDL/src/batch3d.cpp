@@ -0,0 +1,487 @@
+
+/** @file
+ * @brief Batched 3D primitive rendering with cached meshes and a per-frame instance buffer.
+ */
+
+#include "batch3d.h"
+#include "glext.h"
+#include "glstate.h"
+#include "images.h"
+#include "internal.h"
+#include "matrix3d.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+bool Batch3D::instanced = false;
+bool Batch3D::sorting = false;
+bool Batch3D::culling = true;
+Uint32 Batch3D::culled = 0;
+Uint32 Batch3D::drawn = 0;
+std::atomic<Uint32> Batch3D::lastCulled(0);
+std::atomic<Uint32> Batch3D::lastDrawn(0);
+int Batch3D::detail = 0;
+GLuint Batch3D::program = 0;
+GLuint Batch3D::instanceVbo = 0;
+GLsizeiptr Batch3D::instanceCapacity = 0;
+std::vector<Batch3D::Mesh> Batch3D::meshes;
+int Batch3D::meshIndex[MESH_SHAPE_COUNT][Meshes::maxDetail + 1];
+size_t Batch3D::queued = 0;
+std::vector<SpriteVertex> Batch3D::sprites;
+std::vector<Batch3D::SpriteRun> Batch3D::spriteRuns;
+std::vector<SpriteVertex> Batch3D::sortedSprites;
+std::vector<Batch3D::SpriteRun> Batch3D::sortedRuns;
+
+// Attribute locations, bound before linking
+enum {
+    ATTRIB_POSITION = 0,
+    ATTRIB_MODEL0 = 1, // 1..4, one vec4 per matrix column
+    ATTRIB_COLOR = 5
+};
+
+// GLSL 1.20 so it works in the same compatibility context as the fixed-function code
+static const char* vertexShaderSource =
+    "#version 120\n"
+    "attribute vec3 position;\n"
+    "attribute vec4 model0;\n"
+    "attribute vec4 model1;\n"
+    "attribute vec4 model2;\n"
+    "attribute vec4 model3;\n"
+    "attribute vec4 color;\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    vColor = color;\n"
+    "    if (color.a == 0.0) {\n" // Fully transparent, push outside the clip volume
+    "        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    mat4 model = mat4(model0, model1, model2, model3);\n"
+    "    gl_Position = gl_ProjectionMatrix * model * vec4(position, 1.0);\n"
+    "}\n";
+
+static const char* fragmentShaderSource =
+    "#version 120\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    gl_FragColor = vColor;\n"
+    "}\n";
+
+GLuint Batch3D::compileShader(GLenum type, const char* source) {
+    GLuint shader = GLExt::CreateShader(type);
+    GLExt::ShaderSource(shader, 1, &source, nullptr);
+    GLExt::CompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    GLExt::GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[512] = {0};
+        GLExt::GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        Error(std::string("Batch3D shader compilation failed: ") + log);
+        GLExt::DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+bool Batch3D::init() {
+    if (instanced) return true;
+    for (auto& shape : meshIndex)
+        for (int& index : shape) index = -1;
+
+    const char* version = (const char*) glGetString(GL_VERSION);
+    bool instancing = SDL_GL_ExtensionSupported("GL_ARB_instanced_arrays") ||
+                      (version != nullptr && (version[0] > '3' || (version[0] == '3' && version[2] >= '3')));
+    if (!instancing || !GLExt::load()) {
+        Warn("No instancing support, box() will use immediate mode!");
+        return false;
+    }
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+    if (vs == 0 || fs == 0) {
+        if (vs) GLExt::DeleteShader(vs);
+        if (fs) GLExt::DeleteShader(fs);
+        return false;
+    }
+
+    program = GLExt::CreateProgram();
+    GLExt::AttachShader(program, vs);
+    GLExt::AttachShader(program, fs);
+    GLExt::BindAttribLocation(program, ATTRIB_POSITION, "position");
+    GLExt::BindAttribLocation(program, ATTRIB_MODEL0 + 0, "model0");
+    GLExt::BindAttribLocation(program, ATTRIB_MODEL0 + 1, "model1");
+    GLExt::BindAttribLocation(program, ATTRIB_MODEL0 + 2, "model2");
+    GLExt::BindAttribLocation(program, ATTRIB_MODEL0 + 3, "model3");
+    GLExt::BindAttribLocation(program, ATTRIB_COLOR, "color");
+    GLExt::LinkProgram(program);
+    GLExt::DeleteShader(vs); // Flagged for deletion, freed with the program
+    GLExt::DeleteShader(fs);
+
+    GLint ok = GL_FALSE;
+    GLExt::GetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[512] = {0};
+        GLExt::GetProgramInfoLog(program, sizeof(log), nullptr, log);
+        Error(std::string("Batch3D shader linking failed: ") + log);
+        GLExt::DeleteProgram(program);
+        program = 0;
+        return false;
+    }
+
+    GLExt::GenBuffers(1, &instanceVbo);
+    instanced = true;
+    return true;
+}
+
+void Batch3D::quit() {
+    sprites = {};
+    spriteRuns = {};
+    sortedSprites = {};
+    sortedRuns = {};
+    for (Mesh& mesh : meshes) {
+        if (mesh.fillVbo == 0) continue;
+        GLuint buffers[2] = {mesh.fillVbo, mesh.strokeVbo};
+        for (GLuint buffer : buffers) GLState::forgetBuffer(buffer);
+        GLExt::DeleteBuffers(2, buffers);
+    }
+    meshes = {};
+    queued = 0;
+    for (auto& shape : meshIndex)
+        for (int& index : shape) index = -1;
+    if (!instanced) return;
+    GLState::forgetBuffer(instanceVbo);
+    GLExt::DeleteBuffers(1, &instanceVbo);
+    GLState::useProgram(0);
+    GLExt::DeleteProgram(program);
+    instanceCapacity = 0;
+    instanced = false;
+}
+
+bool Batch3D::inFrustum(const float* center, const float* axes[3]) {
+    // Clip space planes are w + x >= 0, w - x >= 0 and the same for y and z. The box is outside
+    // if its center is further behind one of them than its extents projected onto its normal
+    for (int i = 0; i < 3; i++) {
+        for (float sign = -1.0f; sign <= 1.0f; sign += 2.0f) {
+            float distance = center[3] + sign*center[i];
+            float radius = 0.0f;
+            for (int a = 0; a < 3; a++) radius += fabsf(axes[a][3] + sign*axes[a][i]);
+            if (distance + radius < 0.0f) return false;
+        }
+    }
+    return true;
+}
+
+int Batch3D::findMesh(MeshShape shape, int segments) {
+    if (shape == MESH_BOX) segments = 0; // One box, whatever the detail
+    else segments = std::min(std::max(segments, (int) Meshes::minDetail), (int) Meshes::maxDetail);
+    int& index = meshIndex[shape][segments];
+    if (index >= 0) return index;
+
+    meshes.emplace_back();
+    Mesh& mesh = meshes.back();
+    mesh.data = Meshes::build(shape, segments);
+    mesh.fillVbo = mesh.strokeVbo = 0;
+    mesh.visibleFills = mesh.visibleStrokes = 0;
+    if (instanced) {
+        GLuint buffers[2];
+        GLExt::GenBuffers(2, buffers);
+        mesh.fillVbo = buffers[0]; mesh.strokeVbo = buffers[1];
+        GLState::bindBuffer(GL_ARRAY_BUFFER, mesh.fillVbo);
+        GLExt::BufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (mesh.data.triangles.size() * sizeof(GLfloat)),
+                          mesh.data.triangles.data(), GL_STATIC_DRAW);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, mesh.strokeVbo);
+        GLExt::BufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (mesh.data.lines.size() * sizeof(GLfloat)),
+                          mesh.data.lines.data(), GL_STATIC_DRAW);
+    }
+    index = (int) meshes.size() - 1;
+    return index;
+}
+
+void Batch3D::mesh(MeshShape shape, GLfloat w, GLfloat h, GLfloat d, int segments, SDL_Color fill, SDL_Color stroke) {
+    if (fill.a == 0 && stroke.a == 0) return;
+    mat4 model = MatrixStack3D::get_current();
+    model.scale(w, h, d);
+
+    if (culling) {
+        // The base matrix from resetMatrix() already maps to clip space, GL_PROJECTION stays identity
+        vec4 half[3] = {model.column(0)*0.5f, model.column(1)*0.5f, model.column(2)*0.5f};
+        const float* axes[3] = {&half[0].x, &half[1].x, &half[2].x};
+        if (!inFrustum(model.data() + 12, axes)) {
+            culled++;
+            return;
+        }
+    }
+    drawn++;
+
+    if (segments <= 0 && shape != MESH_BOX) {
+        // Widest axis on screen, clip space is 2 units across the window
+        float halfWidth = MatrixStack3D::get_width()*0.5f, halfHeight = MatrixStack3D::get_height()*0.5f;
+        float diameter = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            vec4 axis = model.column(i);
+            diameter = std::max(diameter, sqrtf(axis.x*axis.x*halfWidth*halfWidth + axis.y*axis.y*halfHeight*halfHeight));
+        }
+        segments = Meshes::autoDetail(diameter);
+    }
+    Mesh& mesh = meshes[findMesh(shape, segments)];
+
+    mesh.instances.emplace_back();
+    MeshInstance& instance = mesh.instances.back();
+    memcpy(instance.matrix, model.data(), sizeof(instance.matrix));
+    instance.fill = fill;
+    instance.stroke = stroke;
+    queued++;
+
+    if (fill.a != 0) mesh.visibleFills++;
+    if (stroke.a != 0) mesh.visibleStrokes++;
+}
+
+void Batch3D::drawInstances(GLenum mode, GLuint vbo, GLsizei vertexCount, GLsizei instanceCount,
+                            size_t base, size_t colorOffset) {
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    GLExt::VertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(MeshInstance),
+                               (const void*) (base + colorOffset));
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLExt::VertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
+
+    GLExt::DrawArraysInstanced(mode, 0, vertexCount, instanceCount);
+}
+
+void Batch3D::image(int id, GLfloat x, GLfloat y, GLfloat w, GLfloat h, SDL_Color tint) {
+    ImageRegion region;
+    if (!Images::lookup(id, region)) return;
+    if (w < 0) {
+        w = (GLfloat) region.width;
+        h = (GLfloat) region.height;
+    }
+
+    const mat4& model = MatrixStack3D::get_current();
+    if (culling) {
+        vec4 center = model*vec4(x + w*0.5f, y + h*0.5f, 0.0f, 1.0f);
+        vec4 half[3] = {model.column(0)*(w*0.5f), model.column(1)*(h*0.5f), {}};
+        const float* axes[3] = {&half[0].x, &half[1].x, &half[2].x};
+        if (!inFrustum(&center.x, axes)) {
+            culled++;
+            return;
+        }
+    }
+    drawn++;
+
+    const float* m = model.data();
+    const GLfloat corners[4][4] = {
+        {x, y, region.u0, region.v0}, {x + w, y, region.u1, region.v0},
+        {x + w, y + h, region.u1, region.v1}, {x, y + h, region.u0, region.v1}
+    };
+    SpriteVertex quad[4];
+    for (int i = 0; i < 4; i++) {
+        GLfloat cx = corners[i][0], cy = corners[i][1];
+        quad[i] = {m[0]*cx + m[4]*cy + m[12], m[1]*cx + m[5]*cy + m[13], m[2]*cx + m[6]*cy + m[14],
+                   corners[i][2], corners[i][3], tint};
+    }
+
+    if (spriteRuns.empty() || spriteRuns.back().page != region.page)
+        spriteRuns.push_back({region.page, (GLint) sprites.size()});
+    const int order[6] = {0, 1, 2, 0, 2, 3};
+    for (int i : order) sprites.push_back(quad[i]);
+}
+
+void Batch3D::endFrame() {
+    lastCulled = culled;
+    lastDrawn = drawn;
+    culled = 0;
+    drawn = 0;
+}
+
+void Batch3D::flush() {
+    drawMeshes();
+    drawSprites();
+}
+
+void Batch3D::sortSprites() {
+    // Stable, so quads on the same page keep their order
+    static std::vector<size_t> order;
+    order.resize(spriteRuns.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [](size_t a, size_t b) { return spriteRuns[a].page < spriteRuns[b].page; });
+
+    sortedSprites.clear();
+    sortedRuns.clear();
+    for (size_t i : order) {
+        const SpriteRun& run = spriteRuns[i];
+        size_t end = i + 1 < spriteRuns.size() ? (size_t) spriteRuns[i + 1].first : sprites.size();
+        if (sortedRuns.empty() || sortedRuns.back().page != run.page)
+            sortedRuns.push_back({run.page, (GLint) sortedSprites.size()});
+        sortedSprites.insert(sortedSprites.end(), sprites.begin() + run.first, sprites.begin() + end);
+    }
+    sprites.swap(sortedSprites);
+    spriteRuns.swap(sortedRuns);
+}
+
+void Batch3D::drawSprites() {
+    if (sprites.empty()) return;
+    Images::upload();
+    if (sorting && spriteRuns.size() > 1) sortSprites();
+
+    // Vertices are in eye space already
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    MatrixStack3D::invalidate();
+    GLState::useProgram(0);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0); // Client arrays point into sprites
+    GLState::set_enabled(GL_TEXTURE_2D, true);
+    GLState::set_enabled(GL_ALPHA_TEST, true); // Transparent texels don't write depth
+    GLState::alphaFunc(GL_GREATER, 0.0f);
+    GLState::set_clientState(GL_VERTEX_ARRAY, true);
+    GLState::set_clientState(GL_TEXTURE_COORD_ARRAY, true);
+    GLState::set_clientState(GL_COLOR_ARRAY, true);
+    glVertexPointer(3, GL_FLOAT, sizeof(SpriteVertex), &sprites[0].x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(SpriteVertex), &sprites[0].u);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(SpriteVertex), &sprites[0].color);
+
+    for (size_t i = 0; i < spriteRuns.size(); i++) {
+        const SpriteRun& run = spriteRuns[i];
+        GLint end = i + 1 < spriteRuns.size() ? spriteRuns[i + 1].first : (GLint) sprites.size();
+        GLState::bindTexture(Images::get_glTexture(run.page));
+        glDrawArrays(GL_TRIANGLES, run.first, end - run.first);
+    }
+    GLState::invalidateColor();
+
+    // Boxes ignore the rest, but generic attribute 0 aliases the vertex array
+    GLState::set_clientState(GL_VERTEX_ARRAY, false);
+
+    sprites.clear();
+    spriteRuns.clear();
+}
+
+void Batch3D::drawMeshes() {
+    if (queued == 0) return;
+    if (!instanced) {
+        drawMeshesImmediate();
+        return;
+    }
+
+    // Orphan the old storage instead of waiting for the GPU to finish reading it
+    GLsizeiptr bytes = (GLsizeiptr) (queued * sizeof(MeshInstance));
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    if (bytes > instanceCapacity) instanceCapacity = bytes;
+    GLExt::BufferData(GL_ARRAY_BUFFER, instanceCapacity, nullptr, GL_STREAM_DRAW);
+    size_t offset = 0;
+    for (const Mesh& mesh : meshes) {
+        if (mesh.instances.empty()) continue;
+        size_t size = mesh.instances.size() * sizeof(MeshInstance);
+        GLExt::BufferSubData(GL_ARRAY_BUFFER, (GLintptr) offset, (GLsizeiptr) size, mesh.instances.data());
+        offset += size;
+    }
+
+    GLState::useProgram(program);
+    GLState::set_clientState(GL_VERTEX_ARRAY, false); // Aliases generic attribute 0 on some drivers
+    for (int i = 0; i < 4; i++) {
+        GLExt::EnableVertexAttribArray(ATTRIB_MODEL0 + i);
+        GLExt::VertexAttribDivisor(ATTRIB_MODEL0 + i, 1);
+    }
+    GLExt::EnableVertexAttribArray(ATTRIB_COLOR);
+    GLExt::VertexAttribDivisor(ATTRIB_COLOR, 1);
+    GLExt::EnableVertexAttribArray(ATTRIB_POSITION);
+
+    offset = 0;
+    for (Mesh& mesh : meshes) {
+        if (mesh.instances.empty()) continue;
+        GLsizei count = (GLsizei) mesh.instances.size();
+        // No base instance in GL 3.3, each mesh points the per-instance attributes at its part instead
+        GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        for (int i = 0; i < 4; i++)
+            GLExt::VertexAttribPointer(ATTRIB_MODEL0 + i, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance),
+                                       (const void*) (offset + offsetof(MeshInstance, matrix) + i * 4 * sizeof(GLfloat)));
+        if (mesh.visibleFills > 0)
+            drawInstances(GL_TRIANGLES, mesh.fillVbo, (GLsizei) (mesh.data.triangles.size() / 3), count,
+                          offset, offsetof(MeshInstance, fill));
+        if (mesh.visibleStrokes > 0)
+            drawInstances(GL_LINES, mesh.strokeVbo, (GLsizei) (mesh.data.lines.size() / 3), count,
+                          offset, offsetof(MeshInstance, stroke));
+        offset += mesh.instances.size() * sizeof(MeshInstance);
+
+        mesh.instances.clear(); // Keeps capacity, no allocations next frame
+        mesh.visibleFills = 0;
+        mesh.visibleStrokes = 0;
+    }
+    queued = 0;
+
+    // Attribute arrays aren't cached, don't leave them enabled for the client array code
+    GLExt::DisableVertexAttribArray(ATTRIB_POSITION);
+    for (int i = 0; i < 4; i++) {
+        GLExt::VertexAttribDivisor(ATTRIB_MODEL0 + i, 0);
+        GLExt::DisableVertexAttribArray(ATTRIB_MODEL0 + i);
+    }
+    GLExt::VertexAttribDivisor(ATTRIB_COLOR, 0);
+    GLExt::DisableVertexAttribArray(ATTRIB_COLOR);
+}
+
+static Uint32 colorKey(SDL_Color c) {
+    return (Uint32) c.r << 24 | (Uint32) c.g << 16 | (Uint32) c.b << 8 | c.a;
+}
+
+static void emitTransformed(const std::vector<GLfloat>& vertices, const GLfloat* m) {
+    for (size_t i = 0; i < vertices.size(); i += 3) {
+        const GLfloat* v = &vertices[i];
+        glVertex3f(m[0]*v[0] + m[4]*v[1] + m[8]*v[2] + m[12],
+                   m[1]*v[0] + m[5]*v[1] + m[9]*v[2] + m[13],
+                   m[2]*v[0] + m[6]*v[1] + m[10]*v[2] + m[14]);
+    }
+}
+
+void Batch3D::drawMeshesImmediate() {
+    Uint32 visibleFills = 0, visibleStrokes = 0;
+    for (Mesh& mesh : meshes) {
+        visibleFills += mesh.visibleFills;
+        visibleStrokes += mesh.visibleStrokes;
+        if (sorting) {
+            std::stable_sort(mesh.instances.begin(), mesh.instances.end(), [](const MeshInstance& a, const MeshInstance& b) {
+                Uint64 keyA = (Uint64) colorKey(a.fill) << 32 | colorKey(a.stroke);
+                Uint64 keyB = (Uint64) colorKey(b.fill) << 32 | colorKey(b.stroke);
+                return keyA < keyB;
+            });
+        }
+    }
+
+    // Corners are transformed here, so every primitive goes into the same glBegin()
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    MatrixStack3D::invalidate();
+    GLState::useProgram(0);
+    GLState::set_enabled(GL_TEXTURE_2D, false);
+
+    if (visibleFills > 0) {
+        glBegin(GL_TRIANGLES);
+        for (const Mesh& mesh : meshes) {
+            for (const MeshInstance& instance : mesh.instances) {
+                if (instance.fill.a == 0) continue;
+                GLState::color(instance.fill); // Only reaches the driver when it differs from the last one
+                emitTransformed(mesh.data.triangles, instance.matrix);
+            }
+        }
+        glEnd();
+    }
+    if (visibleStrokes > 0) {
+        glBegin(GL_LINES);
+        for (const Mesh& mesh : meshes) {
+            for (const MeshInstance& instance : mesh.instances) {
+                if (instance.stroke.a == 0) continue;
+                GLState::color(instance.stroke);
+                emitTransformed(mesh.data.lines, instance.matrix);
+            }
+        }
+        glEnd();
+    }
+
+    for (Mesh& mesh : meshes) {
+        mesh.instances.clear();
+        mesh.visibleFills = 0;
+        mesh.visibleStrokes = 0;
+    }
+    queued = 0;
+}
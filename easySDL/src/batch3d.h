@@ -0,0 +1,127 @@
+
+/** @file
+ * @brief Batched, instanced renderer for 3D primitives (window3d() only).
+ */
+
+#ifndef EASYSDL_BATCH3D_H
+#define EASYSDL_BATCH3D_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include "meshes.h"
+
+#include <atomic>
+#include <vector>
+
+/// @brief One queued primitive: its full transform and both colors.
+struct MeshInstance {
+    GLfloat matrix[16]; // Column-major modelview with the size already applied
+    SDL_Color fill;
+    SDL_Color stroke;
+};
+
+/// @brief One corner of a queued image, already in eye space.
+struct SpriteVertex {
+    GLfloat x, y, z;
+    GLfloat u, v;
+    SDL_Color color;
+};
+
+/** @class Batch3D
+ * @brief Collects box(), sphere(), cylinder() and cone() calls and draws them instanced.
+ *
+ * Every shape and detail is tessellated by Meshes the first time it's drawn and kept in
+ * a vertex buffer from then on, every call only appends a MeshInstance to its mesh.
+ * flush() uploads all instances at once and draws fills, then strokes, two instanced
+ * draw calls per mesh used this frame. Curved shapes pick their detail from their size
+ * on screen unless set_detail() fixes it.
+ * If the context can't do instancing the meshes are still cached and queued, and flush()
+ * draws them pre-transformed inside one glBegin(GL_TRIANGLES) and one glBegin(GL_LINES).
+ *
+ * Images are queued the same way, as pre-transformed quads, and drawn after the boxes
+ * with one glDrawArrays() per run of the same texture page. That part is plain GL 1.1,
+ * so it works with or without instancing.
+ *
+ * Primitives and images entirely outside the clip volume are dropped in box() and image(),
+ * before anything is queued, see set_culling().
+ *
+ * With set_sorting() queued draws are reordered by state before drawing: images by page,
+ * immediate mode primitives by color. That changes the order translucent things blend in,
+ * so it's off by default.
+ */
+class Batch3D {
+public:
+    Batch3D() = delete;
+
+    static bool init();
+    static void quit();
+    static bool get_instanced() { return instanced; };
+    static void set_sorting(bool enable) { sorting = enable; };
+    static bool get_sorting() { return sorting; };
+    static void set_culling(bool enable) { culling = enable; };
+    static bool get_culling() { return culling; };
+    static Uint32 get_culled() { return lastCulled; };
+    static Uint32 get_drawn() { return lastDrawn; };
+    /// @brief Segments around for curved shapes, 0 to pick from the size on screen.
+    static void set_detail(int segments) { detail = segments; };
+    static int get_detail() { return detail; };
+
+    /// @brief Queues a w*h*d box using the current MatrixStack3D matrix.
+    static void box(GLfloat w, GLfloat h, GLfloat d, SDL_Color fill, SDL_Color stroke) {
+        mesh(MESH_BOX, w, h, d, 0, fill, stroke);
+    };
+    /// @brief Queues a primitive scaled to w*h*d, detail 0 for automatic (ignored by boxes).
+    static void mesh(MeshShape shape, GLfloat w, GLfloat h, GLfloat d, int detail, SDL_Color fill, SDL_Color stroke);
+    /// @brief Queues an image from loadImage() in the z = 0 plane, w < 0 for its own size.
+    static void image(int id, GLfloat x, GLfloat y, GLfloat w, GLfloat h, SDL_Color tint);
+    /// @brief Draws everything queued so far. Called before swapping buffers and in background().
+    static void flush();
+    /// @brief Latches this frame's culled and drawn counts. Called once the frame is drawn.
+    static void endFrame();
+
+private:
+    static bool instanced;
+    static bool sorting;
+    static bool culling;
+    static Uint32 culled;
+    static Uint32 drawn;
+    static std::atomic<Uint32> lastCulled; // Read from the main thread in threadedMode()
+    static std::atomic<Uint32> lastDrawn;
+    static int detail;
+    static GLuint program;
+    static GLuint instanceVbo;
+    static GLsizeiptr instanceCapacity;
+
+    struct Mesh {
+        MeshData data;
+        GLuint fillVbo, strokeVbo; // 0 without instancing
+        std::vector<MeshInstance> instances;
+        Uint32 visibleFills, visibleStrokes;
+    };
+    static std::vector<Mesh> meshes;
+    static int meshIndex[MESH_SHAPE_COUNT][Meshes::maxDetail + 1]; // -1 until first used
+    static size_t queued;                                          // Instances in all meshes
+
+    struct SpriteRun {
+        int page;
+        GLint first;
+    };
+    static std::vector<SpriteVertex> sprites;
+    static std::vector<SpriteRun> spriteRuns;
+    static std::vector<SpriteVertex> sortedSprites; // Scratch for sortSprites(), kept to not allocate
+    static std::vector<SpriteRun> sortedRuns;
+
+    /// @brief False if a box (center and half extent axes, all in clip space) is entirely outside.
+    static bool inFrustum(const float* center, const float* axes[3]);
+    static GLuint compileShader(GLenum type, const char* source);
+    static int findMesh(MeshShape shape, int detail);
+    static void drawInstances(GLenum mode, GLuint vbo, GLsizei vertexCount, GLsizei instanceCount,
+                              size_t base, size_t colorOffset);
+    static void drawMeshes();
+    static void drawMeshesImmediate();
+    static void drawSprites();
+    static void sortSprites();
+};
+
+#endif //EASYSDL_BATCH3D_H
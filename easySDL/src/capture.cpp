@@ -0,0 +1,615 @@
+
+/** @file
+ * @brief Capture implementation.
+ */
+
+#include "capture.h"
+#include "easySDL.h"
+#include "glext.h"
+#include "glstate.h"
+#include "internal.h"
+#include "pacer.h"
+#include "readback.h"
+
+#ifdef EASYSDL_IMAGE
+#include <SDL2/SDL_image.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+SDL_Renderer* Capture::renderer = nullptr;
+bool Capture::mode3d = false;
+std::vector<std::string> Capture::requestedSaves;
+std::string Capture::requestedStart;
+bool Capture::requestedStop = false;
+bool Capture::recordingRequested = false;
+SDL_mutex* Capture::requestMutex = nullptr;
+std::vector<std::string> Capture::committedSaves;
+std::string Capture::committedStart;
+bool Capture::committedStop = false;
+bool Capture::recording = false;
+bool Capture::closing = false;
+std::string Capture::nextStart;
+bool Capture::ringTried = false;
+int Capture::ringWidth = 0;
+int Capture::ringHeight = 0;
+Capture::Slot Capture::ring[Capture::ringSize];
+int Capture::ringNext = 0;
+std::atomic<Uint32> Capture::dropped(0);
+SDL_Thread* Capture::encoderThread = nullptr;
+SDL_mutex* Capture::jobMutex = nullptr;
+SDL_sem* Capture::jobsReady = nullptr;
+std::deque<Capture::Job> Capture::jobs;
+std::atomic<bool> Capture::stopping(false);
+std::atomic<int> Capture::queuedFrames(0);
+std::vector<std::vector<Uint32>> Capture::spare;
+FILE* Capture::stream = nullptr;
+Capture::StreamFormat Capture::streamFormat = Capture::STREAM_Y4M;
+std::string Capture::streamPath;
+float Capture::streamRate = 60.0f;
+int Capture::streamWidth = 0;
+int Capture::streamHeight = 0;
+Uint32 Capture::streamFrames = 0;
+std::vector<Uint8> Capture::encoded;
+std::vector<Uint32> Capture::flipped;
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    if (s.size() < n) return false;
+    for (size_t i = 0; i < n; i++)
+        if (tolower((unsigned char) s[s.size() - n + i]) != suffix[i]) return false;
+    return true;
+}
+
+// Processing's naming: the last run of '#' becomes n, zero padded to its length
+static std::string numbered(const std::string& pattern, Uint32 n) {
+    size_t end = pattern.find_last_of('#');
+    if (end == std::string::npos) return pattern;
+    size_t begin = end;
+    while (begin > 0 && pattern[begin - 1] == '#') begin--;
+    std::string digits = std::to_string(n);
+    if (digits.size() < end + 1 - begin) digits.insert(0, end + 1 - begin - digits.size(), '0');
+    return pattern.substr(0, begin) + digits + pattern.substr(end + 1);
+}
+
+void Capture::init(SDL_Renderer* r, bool m3d) {
+    renderer = r;
+    mode3d = m3d;
+    requestMutex = SDL_CreateMutex();
+    jobMutex = SDL_CreateMutex();
+    jobsReady = SDL_CreateSemaphore(0);
+    if (requestMutex == nullptr || jobMutex == nullptr || jobsReady == nullptr)
+        ErrorSDL("Failed to create the capture locks!");
+}
+
+void Capture::quit() {
+    if (requestMutex == nullptr) return;
+
+    // What's still in the ring was presented, it belongs in the files
+    if (mode3d) harvest(true);
+    if (recording || closing) push({JOB_CLOSE, {}, -1, {}, 0, 0, 0});
+
+    if (encoderThread != nullptr) {
+        stopping = true;
+        SDL_SemPost(jobsReady);
+        SDL_WaitThread(encoderThread, nullptr); // Finishes the queue first
+        encoderThread = nullptr;
+    }
+    destroyRing();
+
+    SDL_DestroyMutex(requestMutex);
+    SDL_DestroyMutex(jobMutex);
+    SDL_DestroySemaphore(jobsReady);
+    requestMutex = jobMutex = nullptr;
+    jobsReady = nullptr;
+    requestedSaves.clear(); committedSaves.clear();
+    requestedStart.clear(); committedStart.clear(); nextStart.clear();
+    requestedStop = committedStop = false;
+    recordingRequested = recording = closing = false;
+    ringTried = false;
+    spare.clear();
+    stopping = false;
+}
+
+
+// Requests, main thread
+
+void Capture::saveFrame(const std::string& path) {
+    requestedSaves.push_back(numbered(path, frameCount));
+}
+
+bool Capture::startRecording(const std::string& path) {
+    if (!endsWith(path, ".y4m") && !endsWith(path, ".rgb") && path.find('#') == std::string::npos) {
+        Warn("startRecording(): use a .y4m or .rgb file, or numbered images like frames/####.png!");
+        return false;
+    }
+    if (recordingRequested) requestedStop = true; // One after the other
+    requestedStart = path;
+    recordingRequested = true;
+    return true;
+}
+
+void Capture::stopRecording() {
+    if (!recordingRequested) return;
+    if (requestedStart.empty()) requestedStop = true; // Started in this very frame: just never start it
+    requestedStart.clear();
+    recordingRequested = false;
+}
+
+void Capture::commit() {
+    if (requestMutex == nullptr || (requestedSaves.empty() && requestedStart.empty() && !requestedStop)) return;
+    SDL_LockMutex(requestMutex);
+    committedSaves.insert(committedSaves.end(), requestedSaves.begin(), requestedSaves.end());
+    if (requestedStop) {
+        committedStop = true;
+        committedStart.clear();
+    }
+    if (!requestedStart.empty()) committedStart = requestedStart;
+    SDL_UnlockMutex(requestMutex);
+    requestedSaves.clear();
+    requestedStart.clear();
+    requestedStop = false;
+}
+
+
+// Reading back, drawing thread
+
+bool Capture::createRing(int w, int h) {
+    if (ringTried && w == ringWidth && h == ringHeight) return ring[0].buffer != 0;
+    for (Slot& slot : ring)
+        if (slot.fence != nullptr || slot.users > 0) return false; // Resized, the old size is still in use
+    destroyRing();
+    ringTried = true;
+    ringWidth = w;
+    ringHeight = h;
+    if (!GLExt::loadStorage()) return false;
+
+    GLsizeiptr bytes = (GLsizeiptr) w*h*4;
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (Slot& slot : ring) {
+        GLExt::GenBuffers(1, &slot.buffer);
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        // Client storage asks for cached system memory, the encoder reads every byte of it
+        GLExt::BufferStorage(GL_PIXEL_PACK_BUFFER, bytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        slot.mapped = (Uint32*) GLExt::MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags);
+        if (slot.mapped == nullptr) {
+            GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            Warn("Failed to map a readback buffer, frames are read synchronously instead!");
+            destroyRing();
+            return false;
+        }
+    }
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+void Capture::destroyRing() {
+    for (Slot& slot : ring) {
+        if (slot.buffer == 0) continue;
+        if (slot.fence != nullptr) GLExt::DeleteSync(slot.fence);
+        if (slot.mapped != nullptr) {
+            GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            GLExt::UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        GLExt::DeleteBuffers(1, &slot.buffer);
+        slot.buffer = 0;
+        slot.mapped = nullptr;
+        slot.fence = nullptr;
+        slot.saves.clear();
+        slot.record = false;
+    }
+}
+
+void Capture::harvest(bool wait) {
+    // Oldest first, so recorded frames stay in order. Fences signal in order too
+    for (int i = 0; i < ringSize; i++) {
+        int index = (ringNext + i) % ringSize;
+        Slot& slot = ring[index];
+        if (slot.fence == nullptr) continue;
+        GLenum status = GLExt::ClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                              wait ? 1000000000ull : 0);
+        if (status == GL_TIMEOUT_EXPIRED) break;
+        GLExt::DeleteSync(slot.fence);
+        slot.fence = nullptr;
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            // GL_WAIT_FAILED, the copy may never have finished. Don't hand the encoder half a frame
+            if (!slot.saves.empty()) Warn("saveFrame(): reading the frame back failed!");
+            if (slot.record) dropped++;
+            slot.saves.clear();
+            slot.record = false;
+            continue;
+        }
+
+        // Counted before the push, the encoder may be done with it before push() returns
+        for (const std::string& path : slot.saves) {
+            slot.users++;
+            if (!push({JOB_IMAGE, path, index, {}, ringWidth, ringHeight, 0})) slot.users--;
+        }
+        if (slot.record) {
+            slot.users++;
+            if (!push({JOB_FRAME, {}, index, {}, ringWidth, ringHeight, 0})) slot.users--;
+        }
+        slot.saves.clear();
+        slot.record = false;
+    }
+}
+
+bool Capture::readIntoRing(int w, int h, const std::vector<std::string>& saves, bool record, bool& busy) {
+    if (!createRing(w, h)) return false;
+    Slot& slot = ring[ringNext];
+    if (easySDL::get_headless()) {
+        // Nobody watches a headless run, keep every frame and let the sketch wait instead
+        while (slot.fence != nullptr || slot.users > 0) {
+            harvest(true);
+            if (slot.users > 0) SDL_Delay(1);
+        }
+    }
+    if (slot.fence != nullptr || slot.users > 0) {
+        busy = true; // The encoder is behind
+        return false;
+    }
+
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, w, h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, nullptr); // Queued, returns right away
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = GLExt::FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.saves = saves;
+    slot.record = record;
+    ringNext = (ringNext + 1) % ringSize;
+    return true;
+}
+
+bool Capture::recordsInRing() {
+    for (const Slot& slot : ring)
+        if (slot.fence != nullptr && slot.record) return true;
+    return false;
+}
+
+std::vector<Uint32> Capture::takeMemory(size_t pixels) {
+    std::vector<Uint32> memory;
+    SDL_LockMutex(jobMutex);
+    if (!spare.empty()) {
+        memory = std::move(spare.back());
+        spare.pop_back();
+    }
+    SDL_UnlockMutex(jobMutex);
+    memory.resize(pixels);
+    return memory;
+}
+
+void Capture::readIntoMemory(int w, int h, const std::vector<std::string>& saves, bool record) {
+    if (easySDL::get_headless())
+        while (record && queuedFrames >= maxQueued) SDL_Delay(1);
+    if (saves.empty() && queuedFrames >= maxQueued) {
+        dropped++;
+        return;
+    }
+    std::vector<Uint32> memory = takeMemory((size_t) w*h);
+    if (!Readback::read(memory.data(), w, h)) {
+        if (record) dropped++;
+        return;
+    }
+
+    size_t left = saves.size() + (record ? 1 : 0);
+    for (const std::string& path : saves)
+        push({JOB_IMAGE, path, -1, --left > 0 ? memory : std::move(memory), w, h, 0});
+    if (record) push({JOB_FRAME, {}, -1, std::move(memory), w, h, 0});
+}
+
+void Capture::capture() {
+    if (requestMutex == nullptr) return;
+
+    std::vector<std::string> saves;
+    std::string start;
+    SDL_LockMutex(requestMutex);
+    saves.swap(committedSaves);
+    start.swap(committedStart);
+    bool stop = committedStop;
+    committedStop = false;
+    SDL_UnlockMutex(requestMutex);
+
+    if (mode3d && ringTried) harvest(false);
+
+    if (stop && recording) {
+        recording = false;
+        closing = true;
+    }
+    if (!start.empty()) nextStart = start;
+    if (closing) {
+        // The stream ends after its last frame leaves the ring
+        if (!recordsInRing()) {
+            push({JOB_CLOSE, {}, -1, {}, 0, 0, 0});
+            closing = false;
+        }
+    }
+    if (!nextStart.empty() && !closing) {
+        float fps = FramePacer::get_targetRate();
+        push({JOB_OPEN, nextStart, -1, {}, 0, 0, fps > 0 ? fps : 60.0f});
+        nextStart.clear();
+        recording = true;
+    }
+    if (saves.empty() && !recording) return;
+
+    int w = 0, h = 0;
+    if (mode3d) SDL_GL_GetDrawableSize(SDL_GL_GetCurrentWindow(), &w, &h);
+    else SDL_GetRendererOutputSize(renderer, &w, &h);
+    if (w <= 0 || h <= 0) return;
+
+    bool busy = false;
+    if (mode3d && readIntoRing(w, h, saves, recording, busy)) return;
+
+    // Read synchronously instead. A recorded frame only goes along if it can't overtake the ones
+    // still in the ring, and only if a save pays for the stall anyway when the ring is just busy
+    bool record = recording && !recordsInRing() && !(busy && saves.empty());
+    if (recording && !record) dropped++;
+    if (!saves.empty() || record) readIntoMemory(w, h, saves, record);
+}
+
+bool Capture::push(Job&& job) {
+    if (encoderThread == nullptr) {
+        stopping = false;
+        encoderThread = SDL_CreateThread(encoder, "easySDL capture", nullptr);
+        if (encoderThread == nullptr) {
+            ErrorSDL("Failed to start the capture thread!");
+            return false;
+        }
+    }
+    if (job.type == JOB_FRAME) queuedFrames++;
+    SDL_LockMutex(jobMutex);
+    jobs.push_back(std::move(job));
+    SDL_UnlockMutex(jobMutex);
+    SDL_SemPost(jobsReady);
+    return true;
+}
+
+
+// Encoding, encoder thread
+
+int Capture::encoder(void*) {
+    while (true) {
+        SDL_SemWait(jobsReady);
+        SDL_LockMutex(jobMutex);
+        if (jobs.empty()) {
+            SDL_UnlockMutex(jobMutex);
+            if (stopping) break;
+            continue;
+        }
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        SDL_UnlockMutex(jobMutex);
+
+        run(job);
+
+        if (job.type == JOB_FRAME) queuedFrames--;
+        if (job.slot >= 0) ring[job.slot].users--;
+        if (job.memory.capacity() > 0) {
+            SDL_LockMutex(jobMutex);
+            if ((int) spare.size() < maxQueued) spare.push_back(std::move(job.memory));
+            SDL_UnlockMutex(jobMutex);
+        }
+    }
+    return 0;
+}
+
+const Uint32* Capture::topDown(const Job& job) {
+    if (job.slot < 0) return job.memory.data();
+    // GL reads start at the bottom
+    const Uint32* bottomUp = ring[job.slot].mapped;
+    flipped.resize((size_t) job.width*job.height);
+    for (int y = 0; y < job.height; y++)
+        memcpy(flipped.data() + (size_t) y*job.width, bottomUp + (size_t) (job.height - 1 - y)*job.width,
+               (size_t) job.width*4);
+    return flipped.data();
+}
+
+void Capture::run(Job& job) {
+    switch (job.type) {
+        case JOB_IMAGE:
+            writeImage(job.path, topDown(job), job.width, job.height);
+            break;
+        case JOB_OPEN: {
+            streamPath = job.path;
+            streamRate = job.fps;
+            streamFrames = 0;
+            streamWidth = streamHeight = 0;
+            if (streamPath.find('#') != std::string::npos) {
+                streamFormat = STREAM_IMAGES;
+                break;
+            }
+            streamFormat = endsWith(streamPath, ".y4m") ? STREAM_Y4M : STREAM_RGB;
+            stream = fopen(streamPath.c_str(), "wb");
+            if (stream == nullptr) Warn("startRecording(): can't write to " + streamPath + "!");
+            break;
+        }
+        case JOB_FRAME:
+            writeFrame(topDown(job), job.width, job.height);
+            break;
+        case JOB_CLOSE:
+            if (stream != nullptr) fclose(stream);
+            stream = nullptr;
+            Log("Recorded " + std::to_string(streamFrames) + " frames to " + streamPath
+                + (streamFormat == STREAM_RGB ? " (raw rgb24, " + std::to_string(streamWidth) + "x"
+                   + std::to_string(streamHeight) + ")" : ""));
+            break;
+    }
+}
+
+// Anything that isn't .bmp is written as a PNG
+void Capture::writeImage(const std::string& path, const Uint32* pixels, int w, int h) {
+    bool ok;
+    if (endsWith(path, ".bmp")) {
+        // XRGB, the window's alpha isn't part of the picture
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*) pixels, w, h, 32, w*4, SDL_PIXELFORMAT_RGB888);
+        ok = surface != nullptr && SDL_SaveBMP(surface, path.c_str()) == 0;
+        if (surface != nullptr) SDL_FreeSurface(surface);
+    } else {
+#ifdef EASYSDL_IMAGE
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*) pixels, w, h, 32, w*4, SDL_PIXELFORMAT_RGB888);
+        ok = surface != nullptr && IMG_SavePNG(surface, path.c_str()) == 0;
+        if (surface != nullptr) SDL_FreeSurface(surface);
+#else
+        ok = writePNG(path, pixels, w, h);
+#endif
+    }
+    if (!ok) Warn("saveFrame(): failed to write " + path + "!");
+}
+
+// CRC-32 of PNG chunks
+static Uint32 crcTable[256];
+
+static Uint32 crc(Uint32 c, const Uint8* data, size_t n) {
+    if (crcTable[1] == 0) {
+        for (Uint32 i = 0; i < 256; i++) {
+            Uint32 v = i;
+            for (int k = 0; k < 8; k++) v = (v & 1) ? 0xEDB88320u ^ (v >> 1) : v >> 1;
+            crcTable[i] = v;
+        }
+    }
+    c = ~c;
+    for (size_t i = 0; i < n; i++) c = crcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return ~c;
+}
+
+static void putBE(Uint8* out, Uint32 v) {
+    out[0] = (Uint8) (v >> 24);
+    out[1] = (Uint8) (v >> 16);
+    out[2] = (Uint8) (v >> 8);
+    out[3] = (Uint8) v;
+}
+
+static void writeChunk(FILE* f, const char* type, const Uint8* data, size_t n) {
+    Uint8 header[8];
+    putBE(header, (Uint32) n);
+    memcpy(header + 4, type, 4);
+    Uint8 tail[4];
+    putBE(tail, crc(crc(0, header + 4, 4), data, n));
+    fwrite(header, 1, 8, f);
+    fwrite(data, 1, n, f);
+    fwrite(tail, 1, 4, f);
+}
+
+bool Capture::writePNG(const std::string& path, const Uint32* pixels, int w, int h) {
+    // Without SDL_image: RGB rows in stored (uncompressed) deflate blocks. Big files, but no zlib and no time spent
+    size_t rowBytes = (size_t) w*3 + 1, raw = rowBytes*h;
+    size_t blocks = (raw + 65534)/65535;
+    encoded.resize(2 + raw + blocks*5 + 4);
+    Uint8* out = encoded.data();
+    *out++ = 0x78; // zlib, 32K window, no compression
+    *out++ = 0x01;
+
+    Uint32 a = 1, b = 0; // Adler-32 of the rows
+    size_t blockLeft = 0, rawLeft = raw;
+    for (int y = 0; y < h; y++) {
+        const Uint32* row = pixels + (size_t) y*w;
+        for (int x = -1; x < w; x++) {
+            // Filter type 0 starts the row, then red, green, blue
+            Uint8 bytes[3];
+            int count = 1;
+            if (x < 0) {
+                bytes[0] = 0;
+            } else {
+                bytes[0] = (Uint8) (row[x] >> 16);
+                bytes[1] = (Uint8) (row[x] >> 8);
+                bytes[2] = (Uint8) row[x];
+                count = 3;
+            }
+            for (int i = 0; i < count; i++) {
+                if (blockLeft == 0) {
+                    blockLeft = std::min(rawLeft, (size_t) 65535);
+                    rawLeft -= blockLeft;
+                    *out++ = rawLeft == 0 ? 1 : 0;
+                    *out++ = (Uint8) blockLeft;
+                    *out++ = (Uint8) (blockLeft >> 8);
+                    *out++ = (Uint8) ~blockLeft;
+                    *out++ = (Uint8) (~blockLeft >> 8);
+                }
+                *out++ = bytes[i];
+                blockLeft--;
+                a += bytes[i];
+                if (a >= 65521) a -= 65521;
+                b += a;
+                if (b >= 65521) b -= 65521;
+            }
+        }
+    }
+    putBE(out, (b << 16) | a);
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr) return false;
+    static const Uint8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    Uint8 header[13] = {};
+    putBE(header, (Uint32) w);
+    putBE(header + 4, (Uint32) h);
+    header[8] = 8; // Bits per channel
+    header[9] = 2; // RGB
+    fwrite(signature, 1, 8, f);
+    writeChunk(f, "IHDR", header, 13);
+    writeChunk(f, "IDAT", encoded.data(), encoded.size());
+    writeChunk(f, "IEND", nullptr, 0);
+    return fclose(f) == 0;
+}
+
+void Capture::writeFrame(const Uint32* pixels, int w, int h) {
+    if (streamFormat == STREAM_IMAGES) {
+        writeImage(numbered(streamPath, streamFrames++), pixels, w, h);
+        return;
+    }
+    if (stream == nullptr) return;
+    if (streamFrames == 0) {
+        streamWidth = w;
+        streamHeight = h;
+        // Frame rate as a fraction, target rates like 59.94 exist
+        if (streamFormat == STREAM_Y4M)
+            fprintf(stream, "YUV4MPEG2 W%d H%d F%ld:1000 Ip A1:1 C420jpeg\n", w, h, lroundf(streamRate*1000.0f));
+    } else if (w != streamWidth || h != streamHeight) {
+        return; // Resized while recording, a stream has one size
+    }
+    streamFrames++;
+
+    if (streamFormat == STREAM_RGB) {
+        encoded.resize((size_t) w*h*3);
+        Uint8* out = encoded.data();
+        for (size_t i = 0; i < (size_t) w*h; i++, out += 3) {
+            out[0] = (Uint8) (pixels[i] >> 16);
+            out[1] = (Uint8) (pixels[i] >> 8);
+            out[2] = (Uint8) pixels[i];
+        }
+        fwrite(encoded.data(), 1, encoded.size(), stream);
+        return;
+    }
+
+    // BT.601 studio range Y'CbCr, chroma averaged over 2x2 pixels
+    int cw = (w + 1)/2, ch = (h + 1)/2;
+    encoded.resize((size_t) w*h + (size_t) cw*ch*2);
+    Uint8* luma = encoded.data();
+    Uint8* cb = luma + (size_t) w*h;
+    Uint8* cr = cb + (size_t) cw*ch;
+    for (size_t i = 0; i < (size_t) w*h; i++) {
+        int r = (pixels[i] >> 16) & 0xFF, g = (pixels[i] >> 8) & 0xFF, b = pixels[i] & 0xFF;
+        luma[i] = (Uint8) (((66*r + 129*g + 25*b + 128) >> 8) + 16);
+    }
+    for (int y = 0; y < ch; y++) {
+        const Uint32* top = pixels + (size_t) 2*y*w;
+        const Uint32* bottom = 2*y + 1 < h ? top + w : top;
+        for (int x = 0; x < cw; x++) {
+            int x1 = std::min(2*x + 1, w - 1);
+            Uint32 quad[4] = {top[2*x], top[x1], bottom[2*x], bottom[x1]};
+            int r = 2, g = 2, b = 2;
+            for (Uint32 p : quad) {
+                r += (p >> 16) & 0xFF;
+                g += (p >> 8) & 0xFF;
+                b += p & 0xFF;
+            }
+            r >>= 2; g >>= 2; b >>= 2;
+            // Offset by 128 << 8 first, so the shifts only ever see positive numbers
+            cb[(size_t) y*cw + x] = (Uint8) ((-38*r - 74*g + 112*b + 128 + (128 << 8)) >> 8);
+            cr[(size_t) y*cw + x] = (Uint8) ((112*r - 94*g - 18*b + 128 + (128 << 8)) >> 8);
+        }
+    }
+    fputs("FRAME\n", stream);
+    fwrite(encoded.data(), 1, encoded.size(), stream);
+}
@@ -0,0 +1,140 @@
+
+/** @file
+ * @brief saveFrame() and video recording, see saveFrame() in easySDL.h.
+ */
+
+#ifndef EASYSDL_CAPTURE_H
+#define EASYSDL_CAPTURE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+/** @class Capture
+ * @brief Reads presented frames back without stalling on them and writes them on a thread of its own.
+ *
+ * With window3d() and ARB_buffer_storage/ARB_sync, glReadPixels() goes into one of a ring
+ * of persistently mapped pixel buffers and returns right away. capture() checks the fences
+ * of earlier frames without waiting and hands the mapped memory itself to the encoder
+ * thread, a buffer is reused once the encoder is done with it. Otherwise (window(), older
+ * GL) the frame is read synchronously into memory, only the encoding is moved off.
+ *
+ * A recorded frame that finds the ring or the queue full is dropped instead of waiting,
+ * so the sketch keeps its frame rate even if the disk or the encoder can't keep up.
+ *
+ * Requests are made on the main thread and committed once per presented frame, by the
+ * main loop or RenderThread::submit(), so with threadedMode() they still apply to the
+ * frame they were made in.
+ */
+class Capture {
+public:
+    Capture() = delete;
+
+    static const int ringSize = 3;
+    static const int maxQueued = 4; // Recorded frames read into memory and waiting for the encoder
+
+    static void init(SDL_Renderer* renderer, bool mode3d);
+    /// @brief Writes out everything still pending, with the drawing context current.
+    static void quit();
+
+    // Main thread
+    static void saveFrame(const std::string& path);
+    static bool startRecording(const std::string& path);
+    static void stopRecording();
+    static bool get_recording() { return recordingRequested; };
+    static Uint32 get_dropped() { return dropped; };
+    /// @brief Hands the requests made since the last call to the next capture().
+    static void commit();
+
+    /// @brief Drawing thread, after everything was drawn and before swap/present.
+    static void capture();
+
+private:
+    enum JobType { JOB_IMAGE, JOB_OPEN, JOB_FRAME, JOB_CLOSE };
+    enum StreamFormat { STREAM_Y4M, STREAM_RGB, STREAM_IMAGES };
+
+    struct Job {
+        JobType type;
+        std::string path;             // JOB_IMAGE, JOB_OPEN
+        int slot;                     // Ring slot the frame is in, -1 if it's in memory
+        std::vector<Uint32> memory;   // ARGB8888, top row first
+        int width, height;
+        float fps;                    // JOB_OPEN
+    };
+
+    struct Slot {
+        GLuint buffer;
+        Uint32* mapped;               // ARGB8888, bottom row first like GL reads it
+        GLsync fence;                 // Set while the GPU copies into it
+        std::vector<std::string> saves;
+        bool record;
+        std::atomic<int> users;       // Jobs still reading it
+    };
+
+    static SDL_Renderer* renderer;
+    static bool mode3d;
+
+    // Main thread
+    static std::vector<std::string> requestedSaves;
+    static std::string requestedStart;
+    static bool requestedStop;
+    static bool recordingRequested;
+
+    // Committed, taken by the drawing thread
+    static SDL_mutex* requestMutex;
+    static std::vector<std::string> committedSaves;
+    static std::string committedStart;
+    static bool committedStop;
+
+    // Drawing thread
+    static bool recording;
+    static bool closing;             // Stopped, waiting for the last frames to come out of the ring
+    static std::string nextStart;    // Started while still closing the last recording
+    static bool ringTried;
+    static int ringWidth, ringHeight;
+    static Slot ring[ringSize];
+    static int ringNext;             // Slot the next read goes into, the oldest read if it's busy
+    static std::atomic<Uint32> dropped;
+
+    // Encoder
+    static SDL_Thread* encoderThread;
+    static SDL_mutex* jobMutex;
+    static SDL_sem* jobsReady;
+    static std::deque<Job> jobs;
+    static std::atomic<bool> stopping;
+    static std::atomic<int> queuedFrames;
+    static std::vector<std::vector<Uint32>> spare; // Frame memory to reuse, under jobMutex
+    static FILE* stream;
+    static StreamFormat streamFormat;
+    static std::string streamPath;
+    static float streamRate;
+    static int streamWidth, streamHeight;
+    static Uint32 streamFrames;
+    static std::vector<Uint8> encoded;             // Encoder thread scratch
+    static std::vector<Uint32> flipped;
+
+    static bool createRing(int w, int h);
+    static void destroyRing();
+    static void harvest(bool wait);
+    /// @brief False if there is no ring for this size, or busy if the next slot is still in use.
+    static bool readIntoRing(int w, int h, const std::vector<std::string>& saves, bool record, bool& busy);
+    static void readIntoMemory(int w, int h, const std::vector<std::string>& saves, bool record);
+    static std::vector<Uint32> takeMemory(size_t pixels);
+    static bool recordsInRing();
+    /// @brief Hands the job to the encoder thread, false if that couldn't be started.
+    static bool push(Job&& job);
+
+    static int encoder(void*);
+    static void run(Job& job);
+    static const Uint32* topDown(const Job& job);
+    static void writeImage(const std::string& path, const Uint32* pixels, int w, int h);
+    static bool writePNG(const std::string& path, const Uint32* pixels, int w, int h);
+    static void writeFrame(const Uint32* pixels, int w, int h);
+};
+
+#endif //EASYSDL_CAPTURE_H
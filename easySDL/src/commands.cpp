@@ -0,0 +1,127 @@
+
+/** @file
+ * @brief Command list replay.
+ */
+
+#include "commands.h"
+#include "batch2d.h"
+#include "batch3d.h"
+#include "easySDL.h"
+#include "filters.h"
+#include "particles.h"
+#include "picking.h"
+#include "pixels.h"
+
+#include <cstring>
+
+thread_local CommandList* CommandList::recordTarget = nullptr;
+
+void CommandList::replay(const Command* commands, size_t count) {
+    CommandList* target = recordTarget;
+    recordTarget = nullptr;
+
+    for (size_t i = 0; i < count; i++) {
+        const Command& c = commands[i];
+        switch (c.type) {
+            case CMD_BACKGROUND:
+                ::background(c.fill);
+                break;
+            case CMD_BOX:
+                easySDL::box(c.args[0], c.args[1], c.args[2], c.fill, c.stroke);
+                break;
+            case CMD_PUSH_MATRIX:
+                ::pushMatrix();
+                break;
+            case CMD_POP_MATRIX:
+                ::popMatrix();
+                break;
+            case CMD_TRANSLATE:
+                ::translate(c.args[0], c.args[1], c.args[2]);
+                break;
+            case CMD_ROTATE_X:
+                ::rotateX(c.args[0]);
+                break;
+            case CMD_ROTATE_Y:
+                ::rotateY(c.args[0]);
+                break;
+            case CMD_ROTATE_Z:
+                ::rotateZ(c.args[0]);
+                break;
+            case CMD_RECT:
+                Batch2D::rect(c.args[0], c.args[1], c.args[2], c.args[3], c.fill, c.stroke);
+                break;
+            case CMD_ELLIPSE:
+                Batch2D::ellipse(c.args[0], c.args[1], c.args[2], c.args[3], c.fill, c.stroke);
+                break;
+            case CMD_TRIANGLE:
+                Batch2D::triangle(c.args[0], c.args[1], c.args[2], c.args[3], c.args[4], c.args[5],
+                                  c.fill, c.stroke);
+                break;
+            case CMD_LINE:
+                Batch2D::line(c.args[0], c.args[1], c.args[2], c.args[3], c.stroke);
+                break;
+            case CMD_POINT:
+                Batch2D::point(c.args[0], c.args[1], c.stroke);
+                break;
+            case CMD_IMAGE:
+                easySDL::image((int) c.args[4], c.args[0], c.args[1], c.args[2], c.args[3], c.fill);
+                break;
+            case CMD_SPHERE:
+                Batch3D::mesh(MESH_SPHERE, c.args[0], c.args[1], c.args[2], (int) c.args[3], c.fill, c.stroke);
+                break;
+            case CMD_CYLINDER:
+                Batch3D::mesh(MESH_CYLINDER, c.args[0], c.args[1], c.args[2], (int) c.args[3], c.fill, c.stroke);
+                break;
+            case CMD_CONE:
+                Batch3D::mesh(MESH_CONE, c.args[0], c.args[1], c.args[2], (int) c.args[3], c.fill, c.stroke);
+                break;
+            case CMD_PARTICLES:
+                Particles::draw((int) c.args[0], (int) c.args[1], (int) c.args[2], c.args[3]);
+                break;
+            case CMD_PICK_RECT:
+                Picking::addRect(pickId(c), c.args[1], c.args[2], c.args[3], c.args[4]);
+                break;
+            case CMD_PICK_BOX:
+                Picking::addBox(pickId(c), c.args[1], c.args[2], c.args[3]);
+                break;
+            case CMD_PIXELS:
+                Pixels::draw((int) c.args[0], (int) c.args[1], (int) c.args[2], (int) c.args[3], c.args[4] != 0.0f);
+                break;
+            case CMD_FILTER:
+                Filters::frame((FilterKind) (int) c.args[0], c.args[1], c.args[2] != 0.0f);
+                break;
+            case CMD_KERNEL:
+                Filters::setKernel(c.fill.r, c.args);
+                break;
+            case CMD_CONVOLVE:
+                Filters::frameConvolve(Filters::get_kernel(), (int) c.args[0], c.args[1] != 0.0f);
+                break;
+        }
+    }
+
+    recordTarget = target;
+}
+
+// FNV-1a, but a 32-bit word at a time instead of a byte, 4x fewer multiplies
+static inline Uint64 fnv1a(Uint64 hash, Uint32 word) {
+    hash ^= word;
+    return hash * 1099511628211ull;
+}
+
+Uint64 CommandList::hash() const {
+    Uint64 h = 14695981039346656037ull;
+    for (const Command& c : commands) {
+        Uint32 fill, stroke;
+        memcpy(&fill, &c.fill, 4);
+        memcpy(&stroke, &c.stroke, 4);
+        h = fnv1a(h, c.type);
+        h = fnv1a(h, fill);
+        h = fnv1a(h, stroke);
+        for (GLfloat arg : c.args) {
+            Uint32 bits;
+            memcpy(&bits, &arg, 4);
+            h = fnv1a(h, bits);
+        }
+    }
+    return h;
+}
@@ -0,0 +1,140 @@
+
+/** @file
+ * @brief Recorded draw commands, replayed later (or on another thread).
+ */
+
+#ifndef EASYSDL_COMMANDS_H
+#define EASYSDL_COMMANDS_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <cstring>
+#include <vector>
+
+enum CommandType : Uint8 {
+    CMD_BACKGROUND,
+    CMD_BOX,
+    CMD_PUSH_MATRIX,
+    CMD_POP_MATRIX,
+    CMD_TRANSLATE,
+    CMD_ROTATE_X,
+    CMD_ROTATE_Y,
+    CMD_ROTATE_Z,
+    CMD_RECT,
+    CMD_ELLIPSE,
+    CMD_TRIANGLE,
+    CMD_LINE,
+    CMD_POINT,
+    CMD_IMAGE,
+    CMD_SPHERE,
+    CMD_CYLINDER,
+    CMD_CONE,
+    CMD_PARTICLES,
+    CMD_PICK_RECT,
+    CMD_PICK_BOX,
+    CMD_PIXELS,
+    CMD_FILTER,
+    CMD_KERNEL,
+    CMD_CONVOLVE
+};
+
+/// @brief One draw call with everything it needs, 36 bytes.
+struct Command {
+    CommandType type;
+    SDL_Color fill;   // Also the background color
+    SDL_Color stroke;
+    GLfloat args[6];  // Enough for triangle()
+};
+
+/** @class CommandList
+ * @brief A frame worth of draw calls.
+ *
+ * While a list is the record target of a thread, the drawing functions called on that
+ * thread append to it instead of drawing. box() stores the colors it would use,
+ * so fill() and stroke() themselves don't need to be recorded.
+ * clear() keeps the memory, so recording a steady scene doesn't allocate.
+ */
+class CommandList {
+public:
+    void clear() { commands.clear(); };
+    size_t get_size() const { return commands.size(); };
+    const std::vector<Command>& get_commands() const { return commands; };
+
+    void background(SDL_Color color) { commands.push_back({CMD_BACKGROUND, color, {}, {}}); };
+    void box(GLfloat w, GLfloat h, GLfloat d, SDL_Color fill, SDL_Color stroke) {
+        commands.push_back({CMD_BOX, fill, stroke, {w, h, d}});
+    };
+    /// @brief For sphere(), cylinder() and cone(): size like box() and the detail at the time of the call.
+    void mesh(CommandType type, GLfloat w, GLfloat h, GLfloat d, int detail, SDL_Color fill, SDL_Color stroke) {
+        commands.push_back({type, fill, stroke, {w, h, d, (GLfloat) detail}});
+    };
+    void pushMatrix() { commands.push_back({CMD_PUSH_MATRIX, {}, {}, {}}); };
+    void popMatrix() { commands.push_back({CMD_POP_MATRIX, {}, {}, {}}); };
+    void translate(GLfloat x, GLfloat y, GLfloat z) { commands.push_back({CMD_TRANSLATE, {}, {}, {x, y, z}}); };
+    void rotate(CommandType axis, GLfloat angle) { commands.push_back({axis, {}, {}, {angle}}); };
+    /// @brief For the 2D primitives, args in the same order as the function takes them.
+    void shape(CommandType type, SDL_Color fill, SDL_Color stroke, const GLfloat* args, int count) {
+        Command c = {type, fill, stroke, {}};
+        for (int i = 0; i < count; i++) c.args[i] = args[i];
+        commands.push_back(c);
+    };
+    /// @brief The image id is stored as a float, exact up to 2^24 images. The tint goes in fill.
+    void image(int img, GLfloat x, GLfloat y, GLfloat w, GLfloat h, SDL_Color tint) {
+        commands.push_back({CMD_IMAGE, tint, {}, {x, y, w, h, (GLfloat) img}});
+    };
+    /// @brief Which packed buffer of the system to draw and how much of it, see Particles.
+    void particles(int system, int buffer, int count, GLfloat size) {
+        commands.push_back({CMD_PARTICLES, {}, {}, {(GLfloat) system, (GLfloat) buffer, (GLfloat) count, size}});
+    };
+    /// @brief pickable() with the args after the id. The id goes in args[0] bit for bit, as a float ids above 2^24 would round.
+    void pick(CommandType type, int id, const GLfloat* args, int count) {
+        Command c = {type, {}, {}, {}};
+        memcpy(&c.args[0], &id, sizeof(id));
+        for (int i = 0; i < count; i++) c.args[i + 1] = args[i];
+        commands.push_back(c);
+    };
+    /// @brief The id pick() stored.
+    static int pickId(const Command& c) {
+        int id;
+        memcpy(&id, &c.args[0], sizeof(id));
+        return id;
+    };
+    /// @brief Rows of pixels[] to upload before drawing them, and if Pixels::queue() counted it.
+    void pixels(int x, int y, int w, int h, bool queued) {
+        commands.push_back({CMD_PIXELS, {}, {}, {(GLfloat) x, (GLfloat) y, (GLfloat) w, (GLfloat) h, queued ? 1.0f : 0.0f}});
+    };
+    /// @brief filter() over the frame, queued as in pixels().
+    void filter(int kind, GLfloat param, bool queued) {
+        commands.push_back({CMD_FILTER, {}, {}, {(GLfloat) kind, param, queued ? 1.0f : 0.0f}});
+    };
+    /// @brief convolve() over the frame: the kernel six values per CMD_KERNEL (which six in fill.r), then CMD_CONVOLVE.
+    void convolve(const GLfloat* kernel, int size, bool queued) {
+        int count = size*size;
+        for (int part = 0; part*6 < count; part++) {
+            Command c = {CMD_KERNEL, {(Uint8) part, 0, 0, 0}, {}, {}};
+            for (int i = 0; i < 6 && part*6 + i < count; i++) c.args[i] = kernel[part*6 + i];
+            commands.push_back(c);
+        }
+        commands.push_back({CMD_CONVOLVE, {}, {}, {(GLfloat) size, queued ? 1.0f : 0.0f}});
+    };
+    void append(const Command* other, size_t count) { commands.insert(commands.end(), other, other + count); };
+
+    /// @brief Executes every command on the calling thread (recording is paused meanwhile).
+    void replay() const { replay(commands.data(), commands.size()); };
+    static void replay(const Command* commands, size_t count);
+
+    /// @brief 64-bit FNV-1a (word-wise) over the contents, not the padding, of every command.
+    Uint64 hash() const;
+
+    /// @brief The list drawing calls on this thread go to, nullptr to draw right away.
+    static CommandList* get_recordTarget() { return recordTarget; };
+    static void set_recordTarget(CommandList* list) { recordTarget = list; };
+
+private:
+    std::vector<Command> commands;
+
+    static thread_local CommandList* recordTarget;
+};
+
+#endif //EASYSDL_COMMANDS_H
@@ -0,0 +1,110 @@
+
+/** @file
+ * @brief Display list arena and frame skipping.
+ */
+
+#include "displaylist.h"
+#include "internal.h"
+
+std::vector<Command> DisplayLists::arena;
+std::vector<DisplayLists::Range> DisplayLists::lists;
+size_t DisplayLists::garbage = 0;
+CommandList DisplayLists::scratch;
+CommandList* DisplayLists::previousTarget = nullptr;
+int DisplayLists::recording = -1;
+
+bool FrameSkipper::enabled = false;
+bool FrameSkipper::dirty = true;
+Uint64 FrameSkipper::lastHash = 0;
+Uint32 FrameSkipper::skipped = 0;
+CommandList FrameSkipper::frame;
+
+int DisplayLists::begin(int id) {
+    if (recording != -1) {
+        Error("beginList() called while already recording a list!");
+        return -1;
+    }
+    if (id == -1) {
+        // Reuse a deleted slot if there is one
+        for (id = 0; id < (int) lists.size() && lists[id].used; id++) {}
+        if (id == (int) lists.size()) lists.push_back({0, 0, false});
+        lists[id] = {arena.size(), 0, true};
+    } else if (!valid(id)) {
+        Error("beginList() with a list that doesn't exist!");
+        return -1;
+    }
+
+    recording = id;
+    scratch.clear();
+    previousTarget = CommandList::get_recordTarget();
+    CommandList::set_recordTarget(&scratch);
+    return id;
+}
+
+void DisplayLists::end() {
+    if (recording == -1) {
+        Error("endList() without beginList()!");
+        return;
+    }
+    CommandList::set_recordTarget(previousTarget);
+
+    Range& range = lists[recording];
+    garbage += range.count;
+    range.offset = arena.size();
+    range.count = scratch.get_size();
+    arena.insert(arena.end(), scratch.get_commands().begin(), scratch.get_commands().end());
+    recording = -1;
+
+    if (garbage > arena.size() / 2) compact();
+}
+
+void DisplayLists::draw(int id) {
+    if (!valid(id)) {
+        Error("drawList() with a list that doesn't exist!");
+        return;
+    }
+    const Range& range = lists[id];
+    if (CommandList* target = CommandList::get_recordTarget()) {
+        target->append(arena.data() + range.offset, range.count);
+    } else {
+        CommandList::replay(arena.data() + range.offset, range.count);
+    }
+}
+
+void DisplayLists::remove(int id) {
+    if (!valid(id) || id == recording) return;
+    garbage += lists[id].count;
+    lists[id] = {0, 0, false};
+    if (garbage > arena.size() / 2) compact();
+}
+
+void DisplayLists::compact() {
+    std::vector<Command> packed;
+    packed.reserve(arena.size() - garbage);
+    for (Range& range : lists) {
+        if (!range.used) continue;
+        size_t offset = packed.size();
+        packed.insert(packed.end(), arena.begin() + range.offset, arena.begin() + range.offset + range.count);
+        range.offset = offset;
+    }
+    arena.swap(packed);
+    garbage = 0;
+}
+
+void DisplayLists::quit() {
+    arena = {};
+    lists = {};
+    garbage = 0;
+    recording = -1;
+}
+
+bool FrameSkipper::changed() {
+    Uint64 hash = frame.hash();
+    if (!dirty && hash == lastHash) {
+        skipped++;
+        return false;
+    }
+    lastHash = hash;
+    dirty = false;
+    return true;
+}
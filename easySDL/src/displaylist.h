@@ -0,0 +1,78 @@
+
+/** @file
+ * @brief Display lists and skipping of unchanged frames.
+ */
+
+#ifndef EASYSDL_DISPLAYLIST_H
+#define EASYSDL_DISPLAYLIST_H
+
+#include "commands.h"
+
+#include <vector>
+
+/** @class DisplayLists
+ * @brief Recorded sequences of drawing calls, all stored back to back in one arena.
+ *
+ * A list is just a range of the arena. Re-recording a list appends the new version
+ * and leaves the old range as garbage, the arena is compacted once garbage is
+ * more than half of it.
+ */
+class DisplayLists {
+public:
+    DisplayLists() = delete;
+
+    /// @brief Starts recording into list id, -1 for a new list. Returns the id or -1 on error.
+    static int begin(int id);
+    static void end();
+    /// @brief Draws the list, or copies it into whatever is being recorded right now.
+    static void draw(int id);
+    static void remove(int id);
+    static void quit();
+
+    static bool get_recording() { return recording != -1; };
+
+private:
+    struct Range {
+        size_t offset;
+        size_t count;
+        bool used;
+    };
+
+    static std::vector<Command> arena;
+    static std::vector<Range> lists;
+    static size_t garbage;
+    static CommandList scratch;
+    static CommandList* previousTarget;
+    static int recording;
+
+    static bool valid(int id) { return id >= 0 && id < (int) lists.size() && lists[id].used; };
+    static void compact();
+};
+
+/** @class FrameSkipper
+ * @brief Records every frame, hashes it and only draws and presents it if it's different.
+ *
+ * Window events and redraw() force the next frame out no matter what.
+ */
+class FrameSkipper {
+public:
+    FrameSkipper() = delete;
+
+    static void set_enabled(bool enable) { enabled = enable; invalidate(); };
+    static bool get_enabled() { return enabled; };
+
+    static CommandList* get_frameList() { return &frame; };
+    /// @brief True if the recorded frame has to be drawn, remembers it as the last one.
+    static bool changed();
+    static void invalidate() { dirty = true; };
+    static Uint32 get_skipped() { return skipped; };
+
+private:
+    static bool enabled;
+    static bool dirty;
+    static Uint64 lastHash;
+    static Uint32 skipped;
+    static CommandList frame;
+};
+
+#endif //EASYSDL_DISPLAYLIST_H
@@ -7,18 +7,46 @@
 //#include <SDL2/SDL_opengl.h>
 
 #include "easySDL.h"
-
+#include "internal.h"
+#include "batch2d.h"
+#include "batch3d.h"
+#include "capture.h"
+#include "commands.h"
+#include "displaylist.h"
+#include "events.h"
+#include "filters.h"
+#include "glstate.h"
+#include "images.h"
+#include "inputlog.h"
+#include "jobs.h"
+#include "matrix2d.h"
+#include "matrix3d.h"
+#include "noise.h"
+#include "pacer.h"
+#include "particles.h"
+#include "picking.h"
+#include "pixels.h"
+#include "profiler.h"
+#include "random.h"
+#include "readback.h"
+#include "renderthread.h"
+#include "sound.h"
+#include "text.h"
+#include "trace.h"
+
+#include <cstdlib>
+#include <cstring>
 #include <string>
 
 // Main easySDL variables
 
 void (*easySDL::setup)();
 void (*easySDL::update)();
+void (*easySDL::fixedUpdate)();
 
 SDL_Window* easySDL::window;
 SDL_Renderer* easySDL::renderer;
 SDL_GLContext easySDL::glcontext;
-EventHandlerPtr easySDL::eventHandler[SDL_LASTEVENT] = {nullptr}; // Is this necessary
 
 int easySDL::main_return_code = 0;
 bool easySDL::createWindow_once = false;
@@ -26,13 +54,36 @@ bool easySDL::super_setup_once = false;
 bool easySDL::quit_flag = false;
 bool easySDL::mode3d = false;
 bool easySDL::vsync = false;
-Uint32 easySDL::time_step = 0;
-Uint32 easySDL::last_step = 0;
-Uint32 easySDL::frameTimes[10] = {0};
+bool easySDL::headlessMode = false;
+bool easySDL::threaded = false;
+bool easySDL::targetRateSet = false;
+double easySDL::fixedStep = 1.0 / 60;
+double easySDL::fixedAccumulator = 0;
+float easySDL::frameTimes[10] = {0};
 SDL_Color easySDL::fillColor = { 255, 255, 255, 255};
 SDL_Color easySDL::strokeColor = { 0, 0, 0, 255};
 
 
+// Global variables
+
+float frameDelta = 0;
+float frameAlpha = 0;
+Uint32 frameCount = 0;
+float frameRate = 10;
+Uint32 width = 1;
+Uint32 height = 1;
+Uint32* pixels = nullptr;
+int mouseX = 0;
+int mouseY = 0;
+int pmouseX = 0;
+int pmouseY = 0;
+Uint32 mouseButtons = 0;
+bool mousePressed = false;
+int mouseScrollX = 0;
+int mouseScrollY = 0;
+const Uint8* keyboardState = nullptr;
+
+
 
 
 // Utility functions (not visible)
@@ -67,18 +118,38 @@ void easySDL::super_setup() {
     if (!super_setup_once) {
         super_setup_once = true;
 
-        // Initializing SDL2
-        if (SDL_Init(SDL_INIT_EVERYTHING) < 0) { // TODO: Initialize only needed?
+        const char* headlessEnv = getenv("EASYSDL_HEADLESS");
+        if (headlessEnv != nullptr && strcmp(headlessEnv, "0") != 0) headlessMode = true;
+        if (headlessMode) SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+        const char* traceEnv = getenv("EASYSDL_STARTUP_TRACE");
+        if (traceEnv != nullptr && strcmp(traceEnv, "0") != 0) StartupTrace::set_enabled(true);
+        const char* recordEnv = getenv("EASYSDL_RECORD_INPUT");
+        const char* replayEnv = getenv("EASYSDL_REPLAY_INPUT");
+        const char* deltaEnv = getenv("EASYSDL_REPLAY_DELTA");
+
+        // Initializing SDL2, only the cheap parts. Video, audio and input come when they are needed
+        Uint64 start = FramePacer::now();
+        if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) < 0) {
             printf("Error initializing SDL: %s\n", SDL_GetError());
             quit_flag = true;
             main_return_code = -1; // Critical failure or something
         }
+        StartupTrace::record("SDL init", start, FramePacer::now());
+
+        keyboardState = SDL_GetKeyboardState(nullptr);
 
         // Setting defaults
-        time_step = 1000 / 60; // Default FPS is 60
+        FramePacer::init();
+        FramePacer::set_targetRate(60); // Default FPS is 60
+
+        // Before setup(), so random() in it gets the logged seed. The sketch's own calls still win
+        if (replayEnv != nullptr && *replayEnv != 0) InputLog::startReplay(replayEnv, deltaEnv != nullptr ? (float) atof(deltaEnv) : 0);
+        else if (recordEnv != nullptr && *recordEnv != 0) InputLog::startRecording(recordEnv);
 
         // Running user setup()
+        start = FramePacer::now();
         setup();
+        StartupTrace::record("setup()", start, FramePacer::now());
 
         if (!createWindow_once) {
             Warn("No window created in setup!");
@@ -87,31 +158,94 @@ void easySDL::super_setup() {
 }
 
 void easySDL::super_update() {
+    Uint64 phaseStart = FramePacer::now();
+
+    // Batches of events straight from the queue, mouse motion and wheel runs already merged
+    mouseScrollX = 0; mouseScrollY = 0;
+    SDL_PumpEvents();
+    int count;
+    bool replaying = InputLog::get_replaying();
+    while (!quit_flag && (count = EventBus::fetch()) > 0) {
+        SDL_Event* events = EventBus::get_events();
+        for (int i = 0; i < count && !quit_flag; i++) {
+            if (!replaying || events[i].type == SDL_QUIT) handle_event(&events[i]);
+            // Replaying, the log is the input. The live window can still be exposed or resized though
+            else if (events[i].type == SDL_WINDOWEVENT) FrameSkipper::invalidate();
+        }
+    }
+    if (replaying) {
+        for (const SDL_Event& logged : InputLog::get_events()) {
+            if (quit_flag) break;
+            SDL_Event event = logged; // Handlers get a copy they can change, like SDL's batch
+            handle_event(&event);
+        }
+    }
+    Profiler::record(PROFILE_EVENTS, FramePacer::now() - phaseStart);
 
-    SDL_Event event;
-    while (SDL_PollEvent(&event))
-        handle_event(&event);
+    Sound::update();
+    Images::update();
 
     pmouseX = mouseX; pmouseY = mouseY;
-    SDL_GetMouseState(&mouseX, &mouseY);
+    if (replaying) InputLog::mouse(mouseX, mouseY, mouseButtons);
+    else mouseButtons = SDL_GetMouseState(&mouseX, &mouseY);
+    mousePressed = mouseButtons != 0;
+    if (InputLog::get_recording()) InputLog::endFrame(frameDelta, mouseX, mouseY, mouseButtons);
 
     if (mode3d) {
-        glLoadIdentity();
-        glTranslatef(-1.0f, 1.0f, 0.0f); // Translating origin to top left
-        glScalef(2.0f/width, 2.0f/height, 2.0f/width);
-        glScalef(1.0f, -1.0f, 1.0f);
+        if (!RenderThread::get_running()) resetMatrix(); // Otherwise the render thread does it
+    } else {
+        MatrixStack2D::reset();
+    }
+
+    // Running user fixedUpdate() steps and update(), both count as the sketch's time
+    phaseStart = FramePacer::now();
+
+    // Fixed rate simulation steps, update() gets the leftover as frameAlpha
+    if (fixedUpdate != nullptr) {
+        fixedAccumulator += frameDelta / 1000.0;
+        if (fixedAccumulator > 0.25) fixedAccumulator = 0.25; // Don't spiral after a long hitch
+        while (fixedAccumulator >= fixedStep) {
+            fixedUpdate();
+            fixedAccumulator -= fixedStep;
+        }
+        frameAlpha = (float) (fixedAccumulator / fixedStep);
     }
 
-    // Running user update()
     update();
+    Profiler::record(PROFILE_UPDATE, FramePacer::now() - phaseStart);
 
     frameCount++;
 }
 
+void easySDL::resetMatrix() {
+    MatrixStack3D::reset(width, height);
+}
+
 void easySDL::super_quit() {
     static bool super_quit_once = false;
     if (!super_quit_once) {
-        if (mode3d) SDL_GL_DeleteContext(glcontext);
+        InputLog::stop(); // Writes the last frame of a recording
+        RenderThread::stop(); // Gives the GL context back to this thread
+        Capture::quit(); // Writes out the frames still pending while the context is there
+        CommandList::set_recordTarget(nullptr);
+        DisplayLists::quit();
+        Profiler::quit();
+        Sound::quit();
+        Text::quit();
+        Images::quit(); // Textures first, the context or renderer goes next
+        Pixels::quit();
+        pixels = nullptr;
+        Particles::quit();
+        Jobs::quit();
+        Picking::quit();
+        if (mode3d) {
+            Batch3D::quit();
+            Readback::quit();
+            SDL_GL_DeleteContext(glcontext);
+        } else {
+            Batch2D::quit();
+            Readback::quit();
+        }
         SDL_Quit(); // TODO: Figure out how to quit properly?
         quit_flag = true;
         super_quit_once = true;
@@ -119,9 +253,11 @@ void easySDL::super_quit() {
     }
 }
 
-int easySDL::main(void (*setupPtr)(), void (*updatePtr)()) {
+int easySDL::main(void (*setupPtr)(), void (*updatePtr)(), void (*fixedUpdatePtr)()) {
+    Uint64 mainStart = FramePacer::now();
     setup = setupPtr;
     update = updatePtr;
+    fixedUpdate = fixedUpdatePtr;
 
     // Init before setup so quit() works in setup()
     quit_flag = false;
@@ -129,87 +265,217 @@ int easySDL::main(void (*setupPtr)(), void (*updatePtr)()) {
     // Initializing SDL2 + defaults and running user setup()
     super_setup();
 
-    last_step = SDL_GetTicks();
-    while (!quit_flag) {
-        Uint32 now = SDL_GetTicks();
-
-        if (now - last_step >= time_step || vsync) { // Check for max FPS
+    if (threaded && !quit_flag) {
+        if (!mode3d) Warn("threadedMode() only works with window3d()!");
+        else RenderThread::start(window, glcontext);
+    }
 
-            frameDelta = now - last_step;
-            frameTimes[frameCount%10] = frameDelta;
-            if (frameCount > 8) {
-                frameRate = 0;
-                for (Uint32 frameTime : frameTimes) frameRate += frameTime;
-                frameRate = 1000/(frameRate/10);
-            }
+    FramePacer::start();
+    while (!quit_flag) {
+        // Sleeps, then spins the last bit. With vsync the swap waits, replaying the log sets the pace
+        if (!vsync && !InputLog::get_replaying()) FramePacer::wait();
+
+        double delta = FramePacer::tick();
+        frameDelta = (float) (delta * 1000);
+        if (frameCount > 0) Profiler::record(PROFILE_FRAME, (Uint64) (delta * SDL_GetPerformanceFrequency()));
+        frameTimes[frameCount%10] = frameDelta;
+        if (frameCount > 8) {
+            frameRate = 0;
+            for (float frameTime : frameTimes) frameRate += frameTime;
+            frameRate = 1000/(frameRate/10);
+        }
+        // Replaying input, frameDelta comes from the log. frameRate above still measures this run
+        if (InputLog::get_replaying() && !InputLog::nextFrame(frameDelta)) break;
 
+        if (RenderThread::get_running()) {
+            // Drawing calls in update() only record, the render thread draws the previous frame meanwhile
+            CommandList::set_recordTarget(RenderThread::get_recordList());
             super_update();
+            if (quit_flag) break;
+            RenderThread::submit();
+            if (frameCount == 1) StartupTrace::finish(mainStart); // Submitted, close enough
+            continue;
+        }
 
-            last_step = SDL_GetTicks();
-            // TODO: Render here (swap buffers and etc.)
-            if (mode3d) {
-                SDL_GL_SwapWindow(window);
-            } else {
-                SDL_RenderPresent(renderer);
-            }
-        } else { // Don't fry the CPU
-            SDL_Delay(1);
+        // Record the frame first, only draw it if it differs from the one on screen
+        bool skipping = FrameSkipper::get_enabled();
+        if (skipping) {
+            FrameSkipper::get_frameList()->clear();
+            CommandList::set_recordTarget(FrameSkipper::get_frameList());
         }
 
+        super_update();
+        if (skipping) CommandList::set_recordTarget(nullptr);
+        if (quit_flag) break; // quit() in update(), the window is already gone
+        if (skipping && !FrameSkipper::changed()) continue; // Nothing to draw or present
+
+        // TODO: Render here (swap buffers and etc.)
+        Uint64 presentStart = FramePacer::now();
+        if (skipping) FrameSkipper::get_frameList()->replay();
+        if (mode3d) {
+            Batch3D::flush();
+            GLState::endFrame();
+            Batch3D::endFrame();
+            Picking::endFrame();
+            Readback::capture();
+            Readback::publish();
+            Capture::commit();
+            Capture::capture();
+            SDL_GL_SwapWindow(window);
+        } else {
+            Batch2D::flush();
+            Picking::endFrame();
+            Readback::capture();
+            Readback::publish();
+            Capture::commit();
+            Capture::capture();
+            SDL_RenderPresent(renderer);
+        }
+        Profiler::record(PROFILE_PRESENT, FramePacer::now() - presentStart);
+        if (frameCount == 1) StartupTrace::finish(mainStart);
     }
     super_quit();
     return main_return_code;
 }
 
 void easySDL::handle_event(SDL_Event* event) {
+    if (InputLog::get_recording()) InputLog::record(event);
     switch (event->type) { // TODO: Add more special cases
         case SDL_QUIT:
             // TODO: Handle! global Quit()?
             super_quit();
             break;
+        case SDL_WINDOWEVENT:
+            FrameSkipper::invalidate(); // Exposed, resized and etc., the old frame might be gone
+            EventBus::dispatch(event);
+            break;
+        case SDL_MOUSEWHEEL: {
+            int flip = event->wheel.direction == SDL_MOUSEWHEEL_FLIPPED ? -1 : 1;
+            mouseScrollX += event->wheel.x * flip;
+            mouseScrollY += event->wheel.y * flip;
+            EventBus::dispatch(event);
+            break;
+        }
         default:
-            if (eventHandler[event->type] != nullptr) {
-                eventHandler[event->type](event);
-            }
+            EventBus::dispatch(event);
             break;
     }
 }
 
+bool easySDL::initSubsystem(Uint32 flags, const char* stage) {
+    if (SDL_WasInit(flags) == flags) return true;
+    Uint64 start = FramePacer::now();
+    if (SDL_InitSubSystem(flags) < 0) {
+        ErrorSDL(std::string("Failed to initialize SDL ") + stage + "!");
+        return false;
+    }
+    StartupTrace::record(stage, start, FramePacer::now());
+    return true;
+}
+
+bool easySDL::setupHeadlessVideo() {
+    // offscreen can do OpenGL through EGL (Mesa works without a GPU), dummy is 2D only
+    const char* current = SDL_WasInit(SDL_INIT_VIDEO) ? SDL_GetCurrentVideoDriver() : nullptr;
+    if (current != nullptr && (strcmp(current, "offscreen") == 0 || (!mode3d && strcmp(current, "dummy") == 0)))
+        return true;
+
+    if (current != nullptr) SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    const char* drivers[] = {"offscreen", "dummy"};
+    for (const char* driver : drivers) {
+        if (mode3d && strcmp(driver, "dummy") == 0) continue;
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, driver);
+        if (SDL_WasInit(SDL_INIT_VIDEO) == 0 && initSubsystem(SDL_INIT_VIDEO, "video")) return true;
+    }
+    ErrorSDL("No offscreen video driver available for headless mode!");
+    return false;
+}
+
 void easySDL::createWindow(const char *title, int w, int h, Uint32 flags) {
     if (!createWindow_once) {
-        mode3d = flags && SDL_WINDOW_OPENGL;
+        mode3d = (flags & SDL_WINDOW_OPENGL) != 0;
+
+        if (headlessMode) {
+            if (!setupHeadlessVideo()) {
+                quit_flag = true;
+                main_return_code = -1;
+                return;
+            }
+            flags = (flags & ~SDL_WINDOW_SHOWN) | SDL_WINDOW_HIDDEN;
+        } else if (!initSubsystem(SDL_INIT_VIDEO, "video")) {
+            quit_flag = true;
+            main_return_code = -1;
+            return;
+        }
 
+        Uint64 start = FramePacer::now();
         window = SDL_CreateWindow(title,
                                   SDL_WINDOWPOS_CENTERED,
                                   SDL_WINDOWPOS_CENTERED,
                                   w, h, flags);
+        StartupTrace::record("window", start, FramePacer::now());
+        if (window == nullptr) {
+            ErrorSDL("Failed to create window!");
+            quit_flag = true;
+            main_return_code = -1;
+            return;
+        }
         width = w; height = h;
+        start = FramePacer::now();
         if (mode3d) {
             glcontext = SDL_GL_CreateContext(window);
             vsyncMode(false); // vsync is off by default
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            glEnable(GL_MULTISAMPLE);
-            glEnable(GL_LINE_SMOOTH);
-//            glEnable(GL_POLYGON_SMOOTH);
+            if (headlessMode) SDL_GL_SetSwapInterval(0); // Nothing to sync to
+            GLState::init(); // Depth test, blending, multisampling and line smoothing
+            Batch3D::init(); // Falls back to immediate mode box() if this fails
             // TODO: MORE glEnable()!!!
             // TODO: Figure out good line antialiasing!
             // TODO: Some day we will even have culling... Some day...
+            StartupTrace::record("GL context", start, FramePacer::now());
         } else {
-            renderer = SDL_CreateRenderer(window, -1, 0); // TODO: Any flags? I think defaults are OK
+            // TODO: Any flags? I think defaults are OK
+            renderer = SDL_CreateRenderer(window, -1, headlessMode ? SDL_RENDERER_SOFTWARE : 0);
+            Batch2D::init(renderer);
+            StartupTrace::record("renderer", start, FramePacer::now());
         }
+        Readback::init(renderer, mode3d);
+        Images::init(renderer, mode3d);
+        Picking::init();
+        Pixels::init(renderer, mode3d);
+        Capture::init(renderer, mode3d);
+        if (headlessMode && !targetRateSet) FramePacer::set_targetRate(0); // As fast as possible, unless the sketch capped it
         createWindow_once = true;
     }
 }
 
+// Joystick and game controller events only arrive once their subsystem is up
+void easySDL::initInputFor(SDL_EventType eventType) {
+    if (eventType >= SDL_CONTROLLERAXISMOTION && eventType < SDL_FINGERDOWN) {
+        initSubsystem(SDL_INIT_GAMECONTROLLER, "game controller");
+    } else if (eventType >= SDL_JOYAXISMOTION && eventType < SDL_CONTROLLERAXISMOTION) {
+        initSubsystem(SDL_INIT_JOYSTICK, "joystick");
+    }
+}
+
 void easySDL::registerHandler(SDL_EventType eventType, EventHandlerPtr handler) {
-    // TODO: Register events based on type!!!
-    eventHandler[eventType] = handler; // TODO: Check if we are in setup()?
+    initInputFor(eventType);
+    EventBus::add(eventType, handler);
+}
+
+void easySDL::registerHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context) {
+    initInputFor(eventType);
+    EventBus::add(eventType, handler, context);
 }
 
 void easySDL::unregisterHandler(SDL_EventType eventType) {
-    eventHandler[eventType] = nullptr;
+    EventBus::remove(eventType);
+}
+
+void easySDL::unregisterHandler(SDL_EventType eventType, EventHandlerPtr handler) {
+    EventBus::remove(eventType, handler);
+}
+
+void easySDL::unregisterHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context) {
+    EventBus::remove(eventType, handler, context);
 }
 
 void easySDL::vsyncMode(bool enable) {
@@ -234,6 +500,35 @@ void easySDL::vsyncMode(bool enable) {
     vsync = enable;
 }
 
+void easySDL::set_headless(bool enable) {
+    if (createWindow_once) {
+        Warn("headless() has to be called before window() or window3d()!");
+        return;
+    }
+    headlessMode = enable;
+}
+
+void easySDL::set_threaded(bool enable) {
+    if (RenderThread::get_running()) {
+        Warn("threadedMode() has to be called in setup()!");
+        return;
+    }
+    threaded = enable;
+}
+
+void easySDL::set_targetRate(float fps) {
+    targetRateSet = true;
+    FramePacer::set_targetRate(fps);
+}
+
+void easySDL::set_fixedTimestep(float hz) {
+    if (hz <= 0) {
+        Error("fixedTimestep() needs a positive rate!");
+        return;
+    }
+    fixedStep = 1.0 / hz;
+}
+
 void easySDL::fill(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
     fillColor = {r, g, b, a};
 }
@@ -264,6 +559,118 @@ bool vsyncMode() {
     return easySDL::get_vsync();
 }
 
+void headless(bool enable) {
+    easySDL::set_headless(enable);
+}
+
+bool headless() {
+    return easySDL::get_headless();
+}
+
+void threadedMode(bool enable) {
+    easySDL::set_threaded(enable);
+}
+
+bool threadedMode() {
+    return easySDL::get_threaded();
+}
+
+const Uint8* framebuffer() {
+    return Readback::get_pixels();
+}
+
+int framebufferWidth() {
+    return Readback::get_valid() ? Readback::get_width() : 0;
+}
+
+int framebufferHeight() {
+    return Readback::get_valid() ? Readback::get_height() : 0;
+}
+
+void saveFrame() {
+    Capture::saveFrame("screen-####.png");
+}
+
+void saveFrame(const char* path) {
+    Capture::saveFrame(path);
+}
+
+bool startRecording(const char* path) {
+    return Capture::startRecording(path);
+}
+
+void stopRecording() {
+    Capture::stopRecording();
+}
+
+bool recording() {
+    return Capture::get_recording();
+}
+
+Uint32 droppedFrames() {
+    return Capture::get_dropped();
+}
+
+bool recordInput(const char* path) {
+    return InputLog::startRecording(path);
+}
+
+bool replayInput(const char* path, float fixedDelta) {
+    return InputLog::startReplay(path, fixedDelta);
+}
+
+void stopInput() {
+    InputLog::stop();
+}
+
+bool replayingInput() {
+    return InputLog::get_replaying();
+}
+
+void targetFrameRate(float fps) {
+    easySDL::set_targetRate(fps);
+}
+
+float targetFrameRate() {
+    return FramePacer::get_targetRate();
+}
+
+void fixedTimestep(float hz) {
+    easySDL::set_fixedTimestep(hz);
+}
+
+float fixedTimestep() {
+    return easySDL::get_fixedTimestep();
+}
+
+void registerHandler(SDL_EventType eventType, EventHandlerPtr handler) {
+    easySDL::registerHandler(eventType, handler);
+}
+
+void registerHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context) {
+    easySDL::registerHandler(eventType, handler, context);
+}
+
+void unregisterHandler(SDL_EventType eventType) {
+    easySDL::unregisterHandler(eventType); // TODO: Add checks or something
+}
+
+void unregisterHandler(SDL_EventType eventType, EventHandlerPtr handler) {
+    easySDL::unregisterHandler(eventType, handler);
+}
+
+void unregisterHandler(SDL_EventType eventType, EventContextHandlerPtr handler, void* context) {
+    easySDL::unregisterHandler(eventType, handler, context);
+}
+
+void coalesceEvents(bool enable) {
+    EventBus::set_coalescing(enable);
+}
+
+bool coalesceEvents() {
+    return EventBus::get_coalescing();
+}
+
 Uint32 windowFlags() {
     return easySDL::get_windowFlags();
 }
@@ -286,6 +693,45 @@ float degrees(float radians) {
     return radians*(180/PI);
 }
 
+float random(float high) {
+    return Random::nextFloat()*high;
+}
+
+float random(float low, float high) {
+    if (low >= high) return low;
+    return low + Random::nextFloat()*(high - low);
+}
+
+float randomGaussian() {
+    return Random::nextGaussian();
+}
+
+void randomSeed(Uint64 seed) {
+    Random::seed(seed, true);
+}
+
+float noise(float x, float y, float z) {
+    return Noise::get(x, y, z);
+}
+
+void noiseDetail(int lod, float falloff) {
+    Noise::set_detail(lod, falloff);
+}
+
+void noiseSeed(Uint64 seed) {
+    Noise::seed(seed, true);
+}
+
+void noiseField(float* out, int cols, int rows, float x, float y, float step) {
+    if (out == nullptr || cols <= 0 || rows <= 0) return;
+    Noise::field(out, cols, rows, x, y, step);
+}
+
+void noiseField(float* out, int cols, int rows, int layers, float x, float y, float z, float step) {
+    if (out == nullptr || cols <= 0 || rows <= 0 || layers <= 0) return;
+    Noise::field(out, cols, rows, layers, x, y, z, step);
+}
+
 // Time
 void delay(Uint32 ms) {
     SDL_Delay(ms);
@@ -295,6 +741,89 @@ Uint32 millis() {
     return SDL_GetTicks();
 }
 
+void startupTrace(bool enable) {
+    StartupTrace::set_enabled(enable);
+}
+
+float startupTime(const char* stage) {
+    return StartupTrace::get_stage(stage);
+}
+
+// Profiling
+float profilePercentile(ProfilePhase phase, float percentile) {
+    return (float) (Profiler::get_histogram(phase).percentile(percentile) / 1000);
+}
+
+float profileMax(ProfilePhase phase) {
+    return Profiler::get_histogram(phase).max() / 1000.0f;
+}
+
+float profileMean(ProfilePhase phase) {
+    return (float) (Profiler::get_histogram(phase).mean() / 1000);
+}
+
+void profileReset() {
+    Profiler::reset();
+}
+
+bool profileSave(const char* path) {
+    return Profiler::save(path);
+}
+
+void profileOutput(const char* path) {
+    Profiler::set_outputPath(path);
+}
+
+Uint32 stateChanges() {
+    return GLState::get_changes();
+}
+
+Uint32 stateChangesSkipped() {
+    return GLState::get_skipped();
+}
+
+// Sound
+
+int loadSound(const char* path, int voices) {
+    return Sound::load(path, voices);
+}
+
+int playSound(int sound, float volume, float pan) {
+    return Sound::play(sound, volume, pan);
+}
+
+void stopSound(int voice) {
+    Sound::stop(voice);
+}
+
+bool soundPlaying(int voice) {
+    return Sound::get_playing(voice);
+}
+
+int loadMusic(const char* path) {
+    return Sound::loadMusic(path);
+}
+
+void playMusic(int music, bool loop) {
+    Sound::playMusic(music, loop);
+}
+
+void stopMusic() {
+    Sound::stopMusic();
+}
+
+void musicVolume(float volume) {
+    Sound::set_musicVolume(volume);
+}
+
+void masterVolume(float volume) {
+    Sound::set_masterVolume(volume);
+}
+
+float audioLatency() {
+    return Sound::get_latency();
+}
+
 // Color
 void fill(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
     easySDL::fill(r, g, b, a);
@@ -309,158 +838,524 @@ void stroke(Uint8 c) { stroke(c, c, c, 255); }
 void stroke(SDL_Color color) { stroke(color.r, color.g, color.b, color.a); }
 
 void background(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
-    glClearColor((float)r/255, (float)g/255, (float)b/255, (float)a/255);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->background({r, g, b, a});
+        return;
+    }
+    if (easySDL::get_mode3d()) {
+        Batch3D::flush(); // Boxes queued before the clear still have to be drawn before it
+        glClearColor((float)r/255, (float)g/255, (float)b/255, (float)a/255);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    } else {
+        Batch2D::background({r, g, b, a});
+    }
 }
 void background(Uint8 c) { background(c, c, c, 255); }
 void background(SDL_Color color) { background(color.r, color.g, color.b, color.a); }
 
 // 2D primitives
-//void rect(GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
-//
-//}
+void rect(GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
+    if (easySDL::get_mode3d()) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        GLfloat args[4] = {x, y, w, h};
+        list->shape(CMD_RECT, easySDL::get_fillColor(), easySDL::get_strokeColor(), args, 4);
+        return;
+    }
+    Batch2D::rect(x, y, w, h, easySDL::get_fillColor(), easySDL::get_strokeColor());
+}
+
+void ellipse(GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
+    if (easySDL::get_mode3d()) return;
+    if (w == 0 or h == 0) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        GLfloat args[4] = {x, y, w, h};
+        list->shape(CMD_ELLIPSE, easySDL::get_fillColor(), easySDL::get_strokeColor(), args, 4);
+        return;
+    }
+    Batch2D::ellipse(x, y, w, h, easySDL::get_fillColor(), easySDL::get_strokeColor());
+}
+
+void circle(GLfloat x, GLfloat y, GLfloat d) {
+    ellipse(x, y, d, d);
+}
+
+void triangle(GLfloat x1, GLfloat y1, GLfloat x2, GLfloat y2, GLfloat x3, GLfloat y3) {
+    if (easySDL::get_mode3d()) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        GLfloat args[6] = {x1, y1, x2, y2, x3, y3};
+        list->shape(CMD_TRIANGLE, easySDL::get_fillColor(), easySDL::get_strokeColor(), args, 6);
+        return;
+    }
+    Batch2D::triangle(x1, y1, x2, y2, x3, y3, easySDL::get_fillColor(), easySDL::get_strokeColor());
+}
+
+void line(GLfloat x1, GLfloat y1, GLfloat x2, GLfloat y2) {
+    if (easySDL::get_mode3d()) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        GLfloat args[4] = {x1, y1, x2, y2};
+        list->shape(CMD_LINE, {}, easySDL::get_strokeColor(), args, 4);
+        return;
+    }
+    Batch2D::line(x1, y1, x2, y2, easySDL::get_strokeColor());
+}
+
+void point(GLfloat x, GLfloat y) {
+    if (easySDL::get_mode3d()) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        GLfloat args[2] = {x, y};
+        list->shape(CMD_POINT, {}, easySDL::get_strokeColor(), args, 2);
+        return;
+    }
+    Batch2D::point(x, y, easySDL::get_strokeColor());
+}
 
 // 3D primitives
+void easySDL::box(GLfloat w, GLfloat h, GLfloat d, SDL_Color fill, SDL_Color stroke) {
+    if (fill.a == 0 and stroke.a == 0) return;
+    Batch3D::box(w, h, d, fill, stroke); // Instanced, or immediate mode if the context can't
+}
 void box(GLfloat w, GLfloat h, GLfloat d) {
     if (!easySDL::get_mode3d()) return;
     if (w == 0 or h == 0 or d == 0) return;
-    pushMatrix();
-    glScalef(w, h, d);
-
-    // Fill
-    SDL_Color c = easySDL::get_fillColor();
-    if (c.a != 0) {
-        glColor4ub(c.r, c.g, c.b, c.a);
-        glBegin(GL_QUADS);
-        // Top
-        glNormal3f(0.0f, 1.0f, 0.0f);
-        glVertex3f(-0.5f, 0.5f, 0.5f);
-        glVertex3f(0.5f, 0.5f, 0.5f);
-        glVertex3f(0.5f, 0.5f, -0.5f);
-        glVertex3f(-0.5f, 0.5f, -0.5f);
-
-        // Front
-        glNormal3f(0.0f, 0.0f, 1.0f);
-        glVertex3f(0.5f, -0.5f, 0.5f);
-        glVertex3f(0.5f, 0.5f, 0.5f);
-        glVertex3f(-0.5f, 0.5f, 0.5f);
-        glVertex3f(-0.5f, -0.5f, 0.5f);
-
-        // Right
-        glNormal3f(1.0f, 0.0f, 0.0f);
-        glVertex3f(0.5f, 0.5f, -0.5f);
-        glVertex3f(0.5f, 0.5f, 0.5f);
-        glVertex3f(0.5f, -0.5f, 0.5f);
-        glVertex3f(0.5f, -0.5f, -0.5f);
-
-        // Left
-        glNormal3f(-1.0f, 0.0f, 0.0f);
-        glVertex3f(-0.5f, -0.5f, 0.5f);
-        glVertex3f(-0.5f, 0.5f, 0.5f);
-        glVertex3f(-0.5f, 0.5f, -0.5f);
-        glVertex3f(-0.5f, -0.5f, -0.5f);
-
-        // Bottom
-        glNormal3f(0.0f, -1.0f, 0.0f);
-        glVertex3f(0.5f, -0.5f, 0.5f);
-        glVertex3f(-0.5f, -0.5f, 0.5f);
-        glVertex3f(-0.5f, -0.5f, -0.5f);
-        glVertex3f(0.5f, -0.5f, -0.5f);
-
-        // Back
-        glNormal3f(0.0f, 0.0f, -1.0f);
-        glVertex3f(0.5f, 0.5f, -0.5f);
-        glVertex3f(0.5f, -0.5f, -0.5f);
-        glVertex3f(-0.5f, -0.5f, -0.5f);
-        glVertex3f(-0.5f, 0.5f, -0.5f);
-
-        glEnd();
-    }
-
-    // Stroke
-    c = easySDL::get_strokeColor();
-    if (c.a != 0) {
-        glColor4ub(c.r, c.g, c.b, c.a);
-        //   5 +---+ 6  // 1 (-0.5f,  0.5f,  0.5f)
-        //     | B |    // 2 ( 0.5f,  0.5f,  0.5f)
-        //   8 +---+ 7  // 3 ( 0.5f, -0.5f,  0.5f)
-        //    // //     // 4 (-0.5f, -0.5f,  0.5f)
-        // 1 +---+ 2    // 5 (-0.5f,  0.5f, -0.5f)
-        //   | F |      // 6 ( 0.5f,  0.5f, -0.5f)
-        // 4 +---+ 3    // 7 ( 0.5f, -0.5f, -0.5f)
-        //              // 8 (-0.5f, -0.5f, -0.5f)
-        // 2143267856 15 37 48
-        glBegin(GL_LINE_STRIP);
-        glVertex3f( 0.5f,  0.5f,  0.5f); // 2
-        glVertex3f(-0.5f,  0.5f,  0.5f); // 1
-        glVertex3f(-0.5f, -0.5f,  0.5f); // 4
-        glVertex3f( 0.5f, -0.5f,  0.5f); // 3
-        glVertex3f( 0.5f,  0.5f,  0.5f); // 2
-        glVertex3f( 0.5f,  0.5f, -0.5f); // 6
-        glVertex3f( 0.5f, -0.5f, -0.5f); // 7
-        glVertex3f(-0.5f, -0.5f, -0.5f); // 8
-        glVertex3f(-0.5f,  0.5f, -0.5f); // 5
-        glVertex3f( 0.5f,  0.5f, -0.5f); // 6
-        glEnd();
-
-        glBegin(GL_LINES);
-        glVertex3f(-0.5f,  0.5f,  0.5f);
-        glVertex3f(-0.5f,  0.5f, -0.5f);
-
-        glVertex3f( 0.5f, -0.5f,  0.5f);
-        glVertex3f( 0.5f, -0.5f, -0.5f);
-
-        glVertex3f(-0.5f, -0.5f,  0.5f);
-        glVertex3f(-0.5f, -0.5f, -0.5f);
-        glEnd();
-    }
-    popMatrix();
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->box(w, h, d, easySDL::get_fillColor(), easySDL::get_strokeColor());
+        return;
+    }
+    easySDL::box(w, h, d, easySDL::get_fillColor(), easySDL::get_strokeColor());
 }
 void box(GLfloat size) {
     box(size, size, size);
 }
 
+static void curvedShape(MeshShape shape, CommandType type, GLfloat w, GLfloat h, GLfloat d) {
+    if (!easySDL::get_mode3d()) return;
+    if (w == 0 or h == 0 or d == 0) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->mesh(type, w, h, d, Batch3D::get_detail(), easySDL::get_fillColor(), easySDL::get_strokeColor());
+        return;
+    }
+    Batch3D::mesh(shape, w, h, d, Batch3D::get_detail(), easySDL::get_fillColor(), easySDL::get_strokeColor());
+}
+void sphere(GLfloat r) {
+    curvedShape(MESH_SPHERE, CMD_SPHERE, 2*r, 2*r, 2*r);
+}
+void cylinder(GLfloat r, GLfloat h) {
+    curvedShape(MESH_CYLINDER, CMD_CYLINDER, 2*r, h, 2*r);
+}
+void cone(GLfloat r, GLfloat h) {
+    curvedShape(MESH_CONE, CMD_CONE, 2*r, h, 2*r);
+}
+
+void sphereDetail(int res) {
+    Batch3D::set_detail(res > 0 ? res : 0);
+}
+
+int sphereDetail() {
+    return Batch3D::get_detail();
+}
+
+// Particles
+int particleSystem(int capacity) {
+    return Particles::create(capacity);
+}
+
+static bool checkParticles(int system, const char* function) {
+    if (Particles::valid(system)) return true;
+    Warn(std::string(function) + ": no such particle system!");
+    return false;
+}
+
+void emitParticle(int system, GLfloat x, GLfloat y, GLfloat z, GLfloat vx, GLfloat vy, GLfloat vz, float life) {
+    if (!checkParticles(system, "emitParticle()")) return;
+    GLfloat position[3] = {x, y, z}, velocity[3] = {vx, vy, vz};
+    Particles::emit(system, position, velocity, life, easySDL::get_fillColor());
+}
+
+void emitParticles(int system, int count, GLfloat x, GLfloat y, GLfloat z, float speed, float life) {
+    if (!checkParticles(system, "emitParticles()")) return;
+    GLfloat position[3] = {x, y, z};
+    Particles::burst(system, count, position, speed, life, easySDL::get_fillColor());
+}
+
+void particleGravity(int system, GLfloat x, GLfloat y, GLfloat z) {
+    if (checkParticles(system, "particleGravity()")) Particles::set_gravity(system, x, y, z);
+}
+
+void particleDrag(int system, float drag) {
+    if (checkParticles(system, "particleDrag()")) Particles::set_drag(system, drag);
+}
+
+void particleAttractor(int system, int index, GLfloat x, GLfloat y, GLfloat z, float strength) {
+    if (checkParticles(system, "particleAttractor()")) Particles::set_attractor(system, index, x, y, z, strength);
+}
+
+void updateParticles(int system, float dt) {
+    if (checkParticles(system, "updateParticles()")) Particles::update(system, dt);
+}
+
+void drawParticles(int system, float size) {
+    if (!easySDL::get_mode3d()) return;
+    if (!checkParticles(system, "drawParticles()")) return;
+    if (DisplayLists::get_recording()) {
+        // The list would keep drawing this frame's packed buffer, which pack() rewrites later
+        Warn("drawParticles() can't be recorded in a display list!");
+        return;
+    }
+    int count = Particles::get_count(system);
+    int buffer = Particles::pack(system);
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->particles(system, buffer, count, size);
+        return;
+    }
+    Particles::draw(system, buffer, count, size);
+}
+
+int particleCount(int system) {
+    return Particles::valid(system) ? Particles::get_count(system) : 0;
+}
+
+// Picking
+void pickable(int id, GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        GLfloat args[4] = {x, y, w, h};
+        list->pick(CMD_PICK_RECT, id, args, 4);
+        return;
+    }
+    Picking::addRect(id, x, y, w, h);
+}
+
+void pickable(int id, GLfloat w, GLfloat h, GLfloat d) {
+    if (!easySDL::get_mode3d()) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        GLfloat args[3] = {w, h, d};
+        list->pick(CMD_PICK_BOX, id, args, 3);
+        return;
+    }
+    Picking::addBox(id, w, h, d);
+}
+
+int pick(GLfloat x, GLfloat y) {
+    return Picking::pick(x, y);
+}
+
+int pickAll(GLfloat x, GLfloat y, int* ids, int maxIds) {
+    return Picking::pickAll(x, y, ids, maxIds);
+}
+
+int pickRect(GLfloat x, GLfloat y, GLfloat w, GLfloat h, int* ids, int maxIds) {
+    return Picking::pickRect(x, y, w, h, ids, maxIds);
+}
+
+int pickRadius(GLfloat x, GLfloat y, GLfloat radius, int* ids, int maxIds) {
+    return Picking::pickRadius(x, y, radius, ids, maxIds);
+}
+
+int pickableCount() {
+    return Picking::get_count();
+}
+
+void sortDraws(bool enable) {
+    Batch3D::set_sorting(enable);
+}
+
+bool sortDraws() {
+    return Batch3D::get_sorting();
+}
+
+void frustumCulling(bool enable) {
+    Batch3D::set_culling(enable);
+}
+
+bool frustumCulling() {
+    return Batch3D::get_culling();
+}
+
+Uint32 culledObjects() {
+    return Batch3D::get_culled();
+}
+
+Uint32 drawnObjects() {
+    return Batch3D::get_drawn();
+}
+
+// Pixels
+Uint32 color(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    return ((Uint32) a << 24) | ((Uint32) r << 16) | ((Uint32) g << 8) | b;
+}
+
+void loadPixels() {
+    pixels = Pixels::load();
+}
+
+void updatePixels(int x, int y, int w, int h) {
+    if (pixels == nullptr) {
+        Warn("updatePixels(): call loadPixels() first!");
+        return;
+    }
+    if (w < 0) {
+        x += w;
+        w = -w;
+    }
+    if (h < 0) {
+        y += h;
+        h = -h;
+    }
+    FrameSkipper::invalidate(); // Same command, different pixels
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        bool queued = RenderThread::get_running() && list == RenderThread::get_recordList();
+        if (queued) Pixels::queue();
+        list->pixels(x, y, w, h, queued);
+        return;
+    }
+    Pixels::draw(x, y, w, h, false);
+}
+
+void updatePixels() {
+    updatePixels(0, 0, Pixels::get_width(), Pixels::get_height());
+}
+
+// Filters
+void filter(FilterKind kind, float param) {
+    if (!Filters::check(kind, param)) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        bool queued = RenderThread::get_running() && list == RenderThread::get_recordList();
+        if (queued) Pixels::queue();
+        list->filter(kind, param, queued);
+        return;
+    }
+    Filters::frame(kind, param, false);
+}
+
+void filter(FilterKind kind) {
+    filter(kind, Filters::defaultParam(kind));
+}
+
+void filter(Uint32* buffer, int w, int h, FilterKind kind, float param) {
+    if (Filters::check(kind, param)) Filters::apply(buffer, w, h, kind, param);
+}
+
+void filter(Uint32* buffer, int w, int h, FilterKind kind) {
+    filter(buffer, w, h, kind, Filters::defaultParam(kind));
+}
+
+// Both convolve()s, false if the kernel is no good
+static bool checkKernel(const float* kernel, int size) {
+    if (kernel == nullptr || (size != 3 && size != 5)) {
+        Warn("convolve(): the kernel must be 3x3 or 5x5!");
+        return false;
+    }
+    return true;
+}
+
+void convolve(const float* kernel, int size) {
+    if (!checkKernel(kernel, size)) return;
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        bool queued = RenderThread::get_running() && list == RenderThread::get_recordList();
+        if (queued) Pixels::queue();
+        list->convolve(kernel, size, queued);
+        return;
+    }
+    Filters::frameConvolve(kernel, size, false);
+}
+
+void convolve(Uint32* buffer, int w, int h, const float* kernel, int size) {
+    if (checkKernel(kernel, size)) Filters::convolve(buffer, w, h, kernel, size);
+}
+
+// Images
+void easySDL::image(int img, GLfloat x, GLfloat y, GLfloat w, GLfloat h, SDL_Color tint) {
+    if (mode3d) Batch3D::image(img, x, y, w, h, tint);
+    else Batch2D::image(img, x, y, w, h, tint);
+}
+
+int loadImage(const char* path) {
+    return Images::load(path);
+}
+
+void image(int img, GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
+    SDL_Color white = {255, 255, 255, 255};
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->image(img, x, y, w, h, white);
+        return;
+    }
+    easySDL::image(img, x, y, w, h, white);
+}
+
+void image(int img, GLfloat x, GLfloat y) {
+    image(img, x, y, -1, -1); // Own size, looked up when drawn
+}
+
+bool imageLoaded(int img) {
+    return Images::get_loaded(img);
+}
+
+int imageWidth(int img) {
+    return Images::get_width(img);
+}
+
+int imageHeight(int img) {
+    return Images::get_height(img);
+}
+
+int createImage(const Uint32* colors, int w, int h) {
+    // Images::add() converts, so the surface can borrow the colors
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*) colors, w, h, 32, w*4, SDL_PIXELFORMAT_ARGB8888);
+    if (surface == nullptr) {
+        ErrorSDL("Failed to create an image!");
+        return -1;
+    }
+    int id = Images::add(surface, true);
+    SDL_FreeSurface(surface);
+    return id;
+}
+
+void waitImages() {
+    Images::wait();
+}
+
+void textureBudget(int megabytes) {
+    Images::set_budget((size_t) megabytes << 20);
+}
+
+float textureMemory() {
+    return (float) Images::get_residentBytes() / (1 << 20);
+}
+
+// Text
+int loadFont(const char* path) {
+    return Text::loadFont(path);
+}
+
+void textFont(int font) {
+    Text::set_font(font);
+}
+
+void textSize(float size) {
+    Text::set_size(size);
+}
+
+void text(const char* str, GLfloat x, GLfloat y) {
+    if (easySDL::get_fillColor().a == 0) return;
+    const TextRun* run = Text::layout(str);
+    if (run == nullptr) {
+        static bool warned = false;
+        if (!warned) Warn("text() needs a font, see loadFont()!");
+        warned = true;
+        return;
+    }
+    // Glyphs are just images, recorded, batched and skipped like any other
+    SDL_Color fill = easySDL::get_fillColor();
+    CommandList* list = CommandList::get_recordTarget();
+    for (const TextGlyph& g : run->glyphs) {
+        if (list != nullptr) list->image(g.image, x + g.x, y + g.y, g.w, g.h, fill);
+        else easySDL::image(g.image, x + g.x, y + g.y, g.w, g.h, fill);
+    }
+}
+
+float textWidth(const char* str) {
+    const TextRun* run = Text::layout(str);
+    return run != nullptr ? run->width : 0.0f;
+}
+
+// Display lists
+int beginList() {
+    return DisplayLists::begin(-1);
+}
+
+void beginList(int id) {
+    DisplayLists::begin(id);
+}
+
+void endList() {
+    DisplayLists::end();
+}
+
+void drawList(int id) {
+    DisplayLists::draw(id);
+}
+
+void deleteList(int id) {
+    DisplayLists::remove(id);
+}
+
+void skipUnchangedFrames(bool enable) {
+    FrameSkipper::set_enabled(enable);
+}
+
+bool skipUnchangedFrames() {
+    return FrameSkipper::get_enabled();
+}
+
+void redraw() {
+    FrameSkipper::invalidate();
+}
+
+Uint32 skippedFrames() {
+    return FrameSkipper::get_skipped();
+}
+
 // Matrix
 void pushMatrix() {
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->pushMatrix();
+        return;
+    }
     if (easySDL::get_mode3d()) {
-        glPushMatrix();
+        MatrixStack3D::push();
     } else {
-        // TODO: Write a matrix implementation
-        Warn("No matrix manipulation for 2D mode yet!");
+        MatrixStack2D::push();
     }
 }
 
 void popMatrix() {
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->popMatrix();
+        return;
+    }
     if (easySDL::get_mode3d()) {
-        glPopMatrix();
+        MatrixStack3D::pop();
     } else {
-        // TODO: Write a matrix implementation
-        Warn("No matrix manipulation for 2D mode yet!");
+        MatrixStack2D::pop();
     }
 }
 
 void translate(GLfloat x, GLfloat y, GLfloat z) {
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->translate(x, y, z);
+        return;
+    }
     if (easySDL::get_mode3d()) {
-        glTranslatef(x, y, z);
+        MatrixStack3D::translate(x, y, z);
     } else {
-        if (z != 0.0f) return;
-        Warn("No matrix manipulation for 2D mode yet!");
+        MatrixStack2D::translate(x, y); // z is ignored in 2D
     }
 }
 
 void rotateX(GLfloat angle) {
     if (!easySDL::get_mode3d()) return;
-    glRotatef(degrees(angle), 1.0f, 0.0f, 0.0f);
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->rotate(CMD_ROTATE_X, angle);
+        return;
+    }
+    MatrixStack3D::rotateX(angle);
 }
 void rotateY(GLfloat angle) {
     if (!easySDL::get_mode3d()) return;
-    glRotatef(degrees(angle), 0.0f, 1.0f, 0.0f);
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->rotate(CMD_ROTATE_Y, angle);
+        return;
+    }
+    MatrixStack3D::rotateY(angle);
 }
 void rotateZ(GLfloat angle) {
+    if (CommandList* list = CommandList::get_recordTarget()) {
+        list->rotate(CMD_ROTATE_Z, angle);
+        return;
+    }
     if (easySDL::get_mode3d()) {
-        glRotatef(degrees(angle), 0.0f, 0.0f, 1.0f);
+        MatrixStack3D::rotateZ(angle);
     } else {
-        Warn("No matrix manipulation for 2D mode yet!");
+        MatrixStack2D::rotate(angle);
     }
 }
 void rotate(GLfloat angle) {
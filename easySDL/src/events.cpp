@@ -0,0 +1,127 @@
+
+/** @file
+ * @brief Event bus implementation.
+ */
+
+#include "events.h"
+
+#include <algorithm>
+
+std::unordered_map<Uint32, std::vector<EventSubscriber>> EventBus::subscribers;
+SDL_Event EventBus::events[EventBus::batchSize];
+bool EventBus::coalescing = true;
+int EventBus::dispatching = 0;
+bool EventBus::needsCompacting = false;
+
+void EventBus::add(Uint32 type, EventHandlerPtr handler) {
+    if (handler == nullptr) return;
+    subscribers[type].push_back({handler, nullptr, nullptr});
+}
+
+void EventBus::add(Uint32 type, EventContextHandlerPtr handler, void* context) {
+    if (handler == nullptr) return;
+    subscribers[type].push_back({nullptr, handler, context});
+}
+
+// Removing only clears the entry, compact() drops it once nobody is iterating
+void EventBus::remove(Uint32 type) {
+    auto it = subscribers.find(type);
+    if (it == subscribers.end()) return;
+    for (EventSubscriber& s : it->second) s = {nullptr, nullptr, nullptr};
+    needsCompacting = true;
+    if (dispatching == 0) compact();
+}
+
+void EventBus::remove(Uint32 type, EventHandlerPtr handler) {
+    auto it = subscribers.find(type);
+    if (it == subscribers.end()) return;
+    for (EventSubscriber& s : it->second)
+        if (s.handler == handler) s = {nullptr, nullptr, nullptr};
+    needsCompacting = true;
+    if (dispatching == 0) compact();
+}
+
+void EventBus::remove(Uint32 type, EventContextHandlerPtr handler, void* context) {
+    auto it = subscribers.find(type);
+    if (it == subscribers.end()) return;
+    for (EventSubscriber& s : it->second)
+        if (s.contextHandler == handler && s.context == context) s = {nullptr, nullptr, nullptr};
+    needsCompacting = true;
+    if (dispatching == 0) compact();
+}
+
+bool EventBus::get_hasHandlers(Uint32 type) {
+    auto it = subscribers.find(type);
+    if (it == subscribers.end()) return false;
+    for (const EventSubscriber& s : it->second)
+        if (s.handler != nullptr || s.contextHandler != nullptr) return true;
+    return false;
+}
+
+void EventBus::compact() {
+    if (!needsCompacting) return;
+    for (auto it = subscribers.begin(); it != subscribers.end();) {
+        std::vector<EventSubscriber>& list = it->second;
+        list.erase(std::remove_if(list.begin(), list.end(), [](const EventSubscriber& s) {
+            return s.handler == nullptr && s.contextHandler == nullptr;
+        }), list.end());
+        it = list.empty() ? subscribers.erase(it) : ++it;
+    }
+    needsCompacting = false;
+}
+
+int EventBus::fetch() {
+    int count = SDL_PeepEvents(events, batchSize, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+    if (count <= 0) return 0;
+    return coalescing ? coalesce(count) : count;
+}
+
+int EventBus::coalesce(int count) {
+    int out = 0;
+    for (int i = 0; i < count; i++) {
+        SDL_Event& e = events[i];
+        if (out > 0) {
+            SDL_Event& prev = events[out - 1];
+            if (e.type == SDL_MOUSEMOTION && prev.type == SDL_MOUSEMOTION &&
+                e.motion.which == prev.motion.which && e.motion.windowID == prev.motion.windowID) {
+                Sint32 xrel = prev.motion.xrel + e.motion.xrel;
+                Sint32 yrel = prev.motion.yrel + e.motion.yrel;
+                prev.motion = e.motion;
+                prev.motion.xrel = xrel;
+                prev.motion.yrel = yrel;
+                continue;
+            }
+            if (e.type == SDL_MOUSEWHEEL && prev.type == SDL_MOUSEWHEEL &&
+                e.wheel.which == prev.wheel.which && e.wheel.windowID == prev.wheel.windowID &&
+                e.wheel.direction == prev.wheel.direction) {
+                prev.wheel.x += e.wheel.x;
+                prev.wheel.y += e.wheel.y;
+                prev.wheel.preciseX += e.wheel.preciseX;
+                prev.wheel.preciseY += e.wheel.preciseY;
+                prev.wheel.timestamp = e.wheel.timestamp;
+                continue;
+            }
+        }
+        if (out != i) events[out] = e;
+        out++;
+    }
+    return out;
+}
+
+void EventBus::dispatch(SDL_Event* event) {
+    auto it = subscribers.find(event->type);
+    if (it == subscribers.end()) return;
+
+    dispatching++;
+    // By index: a handler may add handlers and reallocate the vector
+    std::vector<EventSubscriber>& list = it->second;
+    size_t count = list.size();
+    for (size_t i = 0; i < count && i < list.size(); i++) {
+        EventSubscriber s = list[i];
+        if (s.handler != nullptr) s.handler(event);
+        else if (s.contextHandler != nullptr) s.contextHandler(event, s.context);
+    }
+    dispatching--;
+
+    if (dispatching == 0) compact();
+}
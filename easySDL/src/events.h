@@ -0,0 +1,61 @@
+
+/** @file
+ * @brief Event dispatching with several handlers per event type.
+ */
+
+#ifndef EASYSDL_EVENTS_H
+#define EASYSDL_EVENTS_H
+
+#include "easySDL.h"
+
+#include <unordered_map>
+#include <vector>
+
+/// @brief One registered handler, either a plain one or one with a context pointer.
+struct EventSubscriber {
+    EventHandlerPtr handler;
+    EventContextHandlerPtr contextHandler;
+    void* context;
+};
+
+/** @class EventBus
+ * @brief Drains SDL events in batches, coalesces the noisy ones and calls every handler.
+ *
+ * Runs of consecutive SDL_MOUSEMOTION events become one event (last position, summed
+ * relative motion), runs of SDL_MOUSEWHEEL events are summed. Only neighbours are merged,
+ * so a click still sees the mouse where it was at the time of the click.
+ * Handlers may (un)register other handlers while being called.
+ */
+class EventBus {
+public:
+    EventBus() = delete;
+
+    static const int batchSize = 128;
+
+    static void add(Uint32 type, EventHandlerPtr handler);
+    static void add(Uint32 type, EventContextHandlerPtr handler, void* context);
+    static void remove(Uint32 type);
+    static void remove(Uint32 type, EventHandlerPtr handler);
+    static void remove(Uint32 type, EventContextHandlerPtr handler, void* context);
+    static bool get_hasHandlers(Uint32 type);
+
+    /// @brief Gets up to batchSize events from SDL and coalesces them, call SDL_PumpEvents() first.
+    static int fetch();
+    static SDL_Event* get_events() { return events; };
+    static void dispatch(SDL_Event* event);
+
+    static void set_coalescing(bool enable) { coalescing = enable; };
+    static bool get_coalescing() { return coalescing; };
+
+private:
+    static std::unordered_map<Uint32, std::vector<EventSubscriber>> subscribers;
+    static SDL_Event events[batchSize];
+    static bool coalescing;
+    static int dispatching; // Nesting depth, removals are deferred while > 0
+    static bool needsCompacting;
+
+    static int coalesce(int count);
+    static void compact();
+};
+
+#endif //EASYSDL_EVENTS_H
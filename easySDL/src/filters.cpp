@@ -0,0 +1,510 @@
+
+/** @file
+ * @brief Filters implementation.
+ */
+
+#include "filters.h"
+#include "batch2d.h"
+#include "batch3d.h"
+#include "internal.h"
+#include "jobs.h"
+#include "pixels.h"
+#include "readback.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+thread_local std::vector<Uint32> Filters::scratch;
+thread_local float Filters::staged[25];
+
+// Rows (or columns) per chunk for about this many pixels, smaller pieces aren't worth a worker
+static const size_t minPixels = 16384;
+static const size_t minColumns = 16; // A cache line of each row, so bands don't share lines
+static const int maxTaps = 2*Filters::maxRadius + 2;
+
+// Per worker rows
+static thread_local std::vector<Uint32> paddedRow;
+static thread_local std::vector<Uint32> columnSums;
+static thread_local std::vector<float> floatRows;
+
+static inline int clampIndex(int i, int count) {
+    return std::min(std::max(i, 0), count - 1);
+}
+
+// Copy of a row with its end pixels repeated radius times on both sides
+static void padRow(const Uint32* in, int w, int radius, Uint32* padded) {
+    std::fill(padded, padded + radius, in[0]);
+    memcpy(padded + radius, in, (size_t) w*4);
+    std::fill(padded + radius + w, padded + 2*radius + w, in[w - 1]);
+}
+
+#ifdef __SSE2__
+// The four channels of a pixel in 32-bit lanes, blue first
+static inline __m128i expand(Uint32 pixel) {
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int) pixel), zero), zero);
+}
+
+// Channels in 32-bit lanes times scale, rounded and packed back into a pixel
+static inline Uint32 pack(__m128i channels, __m128 scale) {
+    __m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(channels), scale));
+    v = _mm_packs_epi32(v, v);
+    return (Uint32) _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+}
+
+// Four pixels of the sum of weights[t]*taps[t][x] over an even number of taps, weights in 1/16384ths
+static inline __m128i blur4(const Uint32* const* taps, int x, const __m128i* pairs, int count) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i p0 = _mm_set1_epi32(1 << 13), p1 = p0, p2 = p0, p3 = p0;
+    for (int t = 0; t < count; t += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (taps[t] + x));
+        __m128i b = _mm_loadu_si128((const __m128i*) (taps[t + 1] + x));
+        // Each channel of tap t next to the same channel of tap t + 1, one multiply-add does both
+        __m128i pair = pairs[t/2];
+        __m128i lo = _mm_unpacklo_epi8(a, b), hi = _mm_unpackhi_epi8(a, b);
+        p0 = _mm_add_epi32(p0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), pair));
+        p1 = _mm_add_epi32(p1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), pair));
+        p2 = _mm_add_epi32(p2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), pair));
+        p3 = _mm_add_epi32(p3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), pair));
+    }
+    __m128i low = _mm_packs_epi32(_mm_srai_epi32(p0, 14), _mm_srai_epi32(p1, 14));
+    __m128i high = _mm_packs_epi32(_mm_srai_epi32(p2, 14), _mm_srai_epi32(p3, 14));
+    return _mm_packus_epi16(low, high);
+}
+#endif
+
+// Normalized Gaussian in 1/16384ths, returns the radius. The rounding error goes to the middle
+static int gaussianWeights(float sigma, Sint16* weights) {
+    int radius = std::min((int) ceilf(sigma*3.0f), Filters::maxRadius);
+    if (radius < 1) return 0;
+    float g[maxTaps], sum = 0.0f;
+    for (int t = 0; t <= 2*radius; t++) {
+        float d = (float) (t - radius);
+        g[t] = expf(-d*d/(2.0f*sigma*sigma));
+        sum += g[t];
+    }
+    int total = 0;
+    for (int t = 0; t <= 2*radius; t++) {
+        weights[t] = (Sint16) lroundf(g[t]/sum*16384.0f);
+        total += weights[t];
+    }
+    weights[radius] = (Sint16) (weights[radius] + 16384 - total);
+    weights[2*radius + 1] = 0;
+    return radius;
+}
+
+float Filters::defaultParam(FilterKind kind) {
+    switch (kind) {
+        case FILTER_THRESHOLD:
+            return 0.5f;
+        case FILTER_BLUR:
+        case FILTER_BOX_BLUR:
+        case FILTER_ERODE:
+        case FILTER_DILATE:
+            return 1.0f;
+        default:
+            return 0.0f;
+    }
+}
+
+bool Filters::check(FilterKind kind, float param) {
+    if (kind == FILTER_POSTERIZE && (param < 2.0f || param > 255.0f)) {
+        Warn("filter(): FILTER_POSTERIZE needs 2 to 255 levels!");
+        return false;
+    }
+    if (param < 0.0f) {
+        Warn("filter(): param can't be negative!");
+        return false;
+    }
+    return true;
+}
+
+
+// Per pixel filters
+
+void Filters::pointRows(size_t begin, size_t end, void* data) {
+    const Point& point = *(const Point*) data;
+    Uint32* p = point.buffer + begin*point.w;
+    size_t count = (end - begin)*point.w, i = 0;
+
+    if (point.kind == FILTER_POSTERIZE) {
+        const Uint8* t = point.table;
+        for (; i < count; i++) {
+            Uint32 c = p[i];
+            p[i] = (c & 0xFF000000) | ((Uint32) t[(c >> 16) & 0xFF] << 16) | ((Uint32) t[(c >> 8) & 0xFF] << 8) | t[c & 0xFF];
+        }
+        return;
+    }
+
+#ifdef __SSE2__
+    __m128i low = _mm_set1_epi32(0xFF), alpha = _mm_set1_epi32((int) 0xFF000000), rgb = _mm_set1_epi32(0xFFFFFF);
+    __m128i level = _mm_set1_epi32(point.level - 1);
+    for (; i + 4 <= count; i += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i*) (p + i)), out;
+        switch (point.kind) {
+            case FILTER_THRESHOLD: {
+                // Brightest channel lands in the low byte
+                __m128i m = _mm_max_epu8(_mm_max_epu8(c, _mm_srli_epi32(c, 8)), _mm_srli_epi32(c, 16));
+                __m128i white = _mm_cmpgt_epi32(_mm_and_si128(m, low), level);
+                out = _mm_or_si128(_mm_and_si128(c, alpha), _mm_and_si128(white, rgb));
+                break;
+            }
+            case FILTER_GRAY: {
+                // Channels are below 256, so the 16-bit multiplies of the low halves don't overflow
+                __m128i b = _mm_and_si128(c, low);
+                __m128i g = _mm_and_si128(_mm_srli_epi32(c, 8), low);
+                __m128i r = _mm_and_si128(_mm_srli_epi32(c, 16), low);
+                __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(77)),
+                                                          _mm_mullo_epi16(g, _mm_set1_epi32(151))),
+                                            _mm_mullo_epi16(b, _mm_set1_epi32(28)));
+                __m128i lum = _mm_srli_epi32(sum, 8);
+                lum = _mm_or_si128(lum, _mm_or_si128(_mm_slli_epi32(lum, 8), _mm_slli_epi32(lum, 16)));
+                out = _mm_or_si128(_mm_and_si128(c, alpha), lum);
+                break;
+            }
+            case FILTER_OPAQUE:
+                out = _mm_or_si128(c, alpha);
+                break;
+            default: // FILTER_INVERT
+                out = _mm_xor_si128(c, rgb);
+                break;
+        }
+        _mm_storeu_si128((__m128i*) (p + i), out);
+    }
+#endif
+
+    for (; i < count; i++) {
+        Uint32 c = p[i];
+        Uint32 r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+        switch (point.kind) {
+            case FILTER_THRESHOLD:
+                p[i] = (c & 0xFF000000) | ((int) std::max(r, std::max(g, b)) >= point.level ? 0xFFFFFF : 0);
+                break;
+            case FILTER_GRAY: {
+                Uint32 lum = (r*77 + g*151 + b*28) >> 8;
+                p[i] = (c & 0xFF000000) | (lum << 16) | (lum << 8) | lum;
+                break;
+            }
+            case FILTER_OPAQUE:
+                p[i] = c | 0xFF000000;
+                break;
+            default:
+                p[i] = c ^ 0xFFFFFF;
+                break;
+        }
+    }
+}
+
+
+// Separable passes: Gaussian blur, erode and dilate
+
+void Filters::runRow(const Pass& pass, const Uint32* const* taps, Uint32* out) {
+    int count = 2*pass.radius + 1;
+    int x = 0;
+#ifdef __SSE2__
+    __m128i pairs[maxTaps/2];
+    if (pass.op == PASS_BLUR)
+        for (int t = 0; t < count; t += 2)
+            pairs[t/2] = _mm_set1_epi32((int) (Uint16) pass.weights[t] | ((int) pass.weights[t + 1] << 16));
+    for (; x + 4 <= pass.w; x += 4) {
+        __m128i result;
+        if (pass.op == PASS_BLUR) {
+            result = blur4(taps, x, pairs, count + 1);
+        } else {
+            result = _mm_loadu_si128((const __m128i*) (taps[0] + x));
+            for (int t = 1; t < count; t++) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (taps[t] + x));
+                result = pass.op == PASS_MIN ? _mm_min_epu8(result, v) : _mm_max_epu8(result, v);
+            }
+        }
+        _mm_storeu_si128((__m128i*) (out + x), result);
+    }
+#endif
+    for (; x < pass.w; x++) {
+        Uint32 result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            int value;
+            if (pass.op == PASS_BLUR) {
+                value = 1 << 13;
+                for (int t = 0; t < count; t++) value += pass.weights[t]*(int) ((taps[t][x] >> shift) & 0xFF);
+                value = std::min(value >> 14, 255);
+            } else {
+                value = (int) ((taps[0][x] >> shift) & 0xFF);
+                for (int t = 1; t < count; t++) {
+                    int v = (int) ((taps[t][x] >> shift) & 0xFF);
+                    value = pass.op == PASS_MIN ? std::min(value, v) : std::max(value, v);
+                }
+            }
+            result |= (Uint32) value << shift;
+        }
+        out[x] = result;
+    }
+}
+
+void Filters::horizontalRows(size_t begin, size_t end, void* data) {
+    const Pass& pass = *(const Pass*) data;
+    int r = pass.radius, w = pass.w;
+    paddedRow.resize((size_t) w + 2*r);
+    const Uint32* taps[maxTaps];
+    for (int t = 0; t <= 2*r; t++) taps[t] = paddedRow.data() + t;
+    taps[2*r + 1] = taps[2*r]; // The blur's zero weight tap that evens the count
+    for (size_t y = begin; y < end; y++) {
+        padRow(pass.src + y*w, w, r, paddedRow.data());
+        runRow(pass, taps, pass.dst + y*w);
+    }
+}
+
+void Filters::verticalRows(size_t begin, size_t end, void* data) {
+    const Pass& pass = *(const Pass*) data;
+    int r = pass.radius, w = pass.w;
+    const Uint32* taps[maxTaps];
+    for (size_t y = begin; y < end; y++) {
+        for (int t = 0; t <= 2*r; t++) taps[t] = pass.src + (size_t) clampIndex((int) y + t - r, pass.h)*w;
+        taps[2*r + 1] = taps[2*r];
+        runRow(pass, taps, pass.dst + y*w);
+    }
+}
+
+void Filters::separable(Uint32* buffer, int w, int h, PassOp op, int radius, const Sint16* weights) {
+    scratch.resize((size_t) w*h);
+    size_t minRows = std::max(minPixels/(size_t) w, (size_t) 1);
+    Pass pass = {op, buffer, scratch.data(), w, h, radius, weights};
+    Jobs::parallelFor((size_t) h, minRows, horizontalRows, &pass);
+    pass.src = scratch.data();
+    pass.dst = buffer;
+    Jobs::parallelFor((size_t) h, minRows, verticalRows, &pass);
+}
+
+
+// Box blur, running sums
+
+void Filters::boxRows(size_t begin, size_t end, void* data) {
+    const Pass& pass = *(const Pass*) data;
+    int r = pass.radius, w = pass.w, n = 2*r + 1;
+    paddedRow.resize((size_t) w + 2*r);
+    const Uint32* p = paddedRow.data();
+    for (size_t y = begin; y < end; y++) {
+        padRow(pass.src + y*w, w, r, paddedRow.data());
+        Uint32* out = pass.dst + y*w;
+#ifdef __SSE2__
+        __m128 scale = _mm_set1_ps(1.0f/(float) n);
+        __m128i sum = _mm_setzero_si128();
+        for (int t = 0; t < 2*r; t++) sum = _mm_add_epi32(sum, expand(p[t]));
+        for (int x = 0; x < w; x++) {
+            sum = _mm_add_epi32(sum, expand(p[x + 2*r]));
+            out[x] = pack(sum, scale);
+            sum = _mm_sub_epi32(sum, expand(p[x]));
+        }
+#else
+        int sum[4] = {};
+        for (int t = 0; t < 2*r; t++)
+            for (int c = 0; c < 4; c++) sum[c] += (int) ((p[t] >> 8*c) & 0xFF);
+        for (int x = 0; x < w; x++) {
+            Uint32 result = 0;
+            for (int c = 0; c < 4; c++) {
+                sum[c] += (int) ((p[x + 2*r] >> 8*c) & 0xFF);
+                result |= (Uint32) ((sum[c] + n/2)/n) << 8*c;
+                sum[c] -= (int) ((p[x] >> 8*c) & 0xFF);
+            }
+            out[x] = result;
+        }
+#endif
+    }
+}
+
+void Filters::boxColumns(size_t begin, size_t end, void* data) {
+    const Pass& pass = *(const Pass*) data;
+    int r = pass.radius, w = pass.w, h = pass.h, n = 2*r + 1;
+    size_t cols = end - begin;
+    columnSums.assign(cols*4, 0);
+    Uint32* sums = columnSums.data();
+
+    // Rows -r to r around the first one, edges repeated
+    for (int t = -r; t <= r; t++) {
+        const Uint32* row = pass.src + (size_t) clampIndex(t, h)*w + begin;
+        for (size_t c = 0; c < cols; c++)
+            for (int k = 0; k < 4; k++) sums[c*4 + k] += (row[c] >> 8*k) & 0xFF;
+    }
+
+#ifdef __SSE2__
+    __m128 scale = _mm_set1_ps(1.0f/(float) n);
+#endif
+    for (int y = 0; y < h; y++) {
+        const Uint32* entering = pass.src + (size_t) clampIndex(y + r + 1, h)*w + begin;
+        const Uint32* leaving = pass.src + (size_t) clampIndex(y - r, h)*w + begin;
+        Uint32* out = pass.dst + (size_t) y*w + begin;
+        for (size_t c = 0; c < cols; c++) {
+#ifdef __SSE2__
+            __m128i sum = _mm_loadu_si128((const __m128i*) (sums + c*4));
+            out[c] = pack(sum, scale);
+            sum = _mm_sub_epi32(_mm_add_epi32(sum, expand(entering[c])), expand(leaving[c]));
+            _mm_storeu_si128((__m128i*) (sums + c*4), sum);
+#else
+            Uint32 result = 0;
+            for (int k = 0; k < 4; k++) {
+                Uint32& sum = sums[c*4 + k];
+                result |= ((sum + n/2)/n) << 8*k;
+                sum += ((entering[c] >> 8*k) & 0xFF) - ((leaving[c] >> 8*k) & 0xFF);
+            }
+            out[c] = result;
+#endif
+        }
+    }
+}
+
+
+// Convolution
+
+// A row as 4 floats per pixel, blue first, with its end pixels repeated radius times on both sides
+static void floatRow(const Uint32* in, int w, int radius, float* out) {
+    for (int x = -radius; x < w + radius; x++, out += 4) {
+        Uint32 c = in[clampIndex(x, w)];
+#ifdef __SSE2__
+        _mm_storeu_ps(out, _mm_cvtepi32_ps(expand(c)));
+#else
+        for (int k = 0; k < 4; k++) out[k] = (float) ((c >> 8*k) & 0xFF);
+#endif
+    }
+}
+
+void Filters::convolveRows(size_t begin, size_t end, void* data) {
+    const Convolution& conv = *(const Convolution*) data;
+    int size = conv.size, r = size/2, w = conv.w;
+    size_t stride = (size_t) (w + 2*r)*4;
+    floatRows.resize(stride*size);
+
+    // A ring of converted rows, row u in slot u % size: moving down a row converts only the new one
+    const float* lines[5];
+    for (size_t y = begin; y < end; y++) {
+        for (int i = 0; i < size; i++) {
+            int u = (int) y + i - r;
+            float* line = floatRows.data() + (size_t) ((u + size) % size)*stride;
+            if (y == begin || i == size - 1) floatRow(conv.src + (size_t) clampIndex(u, conv.h)*w, w, r, line);
+            lines[i] = line;
+        }
+
+        const Uint32* in = conv.src + y*w;
+        Uint32* out = conv.dst + y*w;
+        for (int x = 0; x < w; x++) {
+            const float* k = conv.kernel;
+            Uint32 result;
+#ifdef __SSE2__
+            __m128 sum = _mm_setzero_ps();
+            for (int i = 0; i < size; i++) {
+                const float* p = lines[i] + (size_t) x*4;
+                for (int j = 0; j < size; j++, k += 4, p += 4)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(k), _mm_loadu_ps(p)));
+            }
+            // The packs saturate to 0-255
+            __m128i v = _mm_cvtps_epi32(sum);
+            v = _mm_packs_epi32(v, v);
+            result = (Uint32) _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+#else
+            float sum[3] = {};
+            for (int i = 0; i < size; i++) {
+                const float* p = lines[i] + (size_t) x*4;
+                for (int j = 0; j < size; j++, k += 4, p += 4)
+                    for (int c = 0; c < 3; c++) sum[c] += k[c]*p[c];
+            }
+            result = 0;
+            for (int c = 0; c < 3; c++) result |= (Uint32) std::min(std::max(lroundf(sum[c]), 0L), 255L) << 8*c;
+#endif
+            out[x] = (result & 0xFFFFFF) | (in[x] & 0xFF000000);
+        }
+    }
+}
+
+
+// Entry points
+
+void Filters::apply(Uint32* buffer, int w, int h, FilterKind kind, float param) {
+    if (buffer == nullptr || w <= 0 || h <= 0) return;
+    size_t minRows = std::max(minPixels/(size_t) w, (size_t) 1);
+    int radius = (int) std::min(param, (float) maxRadius);
+
+    switch (kind) {
+        case FILTER_BLUR: {
+            Sint16 weights[maxTaps];
+            radius = gaussianWeights(param, weights);
+            if (radius > 0) separable(buffer, w, h, PASS_BLUR, radius, weights);
+            return;
+        }
+        case FILTER_BOX_BLUR: {
+            if (radius < 1) return;
+            scratch.resize((size_t) w*h);
+            Pass pass = {PASS_BLUR, buffer, scratch.data(), w, h, radius, nullptr};
+            Jobs::parallelFor((size_t) h, minRows, boxRows, &pass);
+            pass.src = scratch.data();
+            pass.dst = buffer;
+            Jobs::parallelFor((size_t) w, std::max(minPixels/(size_t) h, minColumns), boxColumns, &pass);
+            return;
+        }
+        case FILTER_ERODE:
+        case FILTER_DILATE:
+            if (radius >= 1) separable(buffer, w, h, kind == FILTER_ERODE ? PASS_MIN : PASS_MAX, radius, nullptr);
+            return;
+        default: {
+            Uint8 table[256];
+            Point point = {buffer, w, kind, 0, table};
+            if (kind == FILTER_THRESHOLD) point.level = (int) (std::min(param, 1.0f)*255.0f);
+            if (kind == FILTER_POSTERIZE) {
+                // Like Processing: the level the channel falls in, spread back over 0-255
+                int levels = std::min(std::max((int) param, 2), 255);
+                for (int i = 0; i < 256; i++) table[i] = (Uint8) (((i*levels) >> 8)*255/(levels - 1));
+            }
+            Jobs::parallelFor((size_t) h, minRows, pointRows, &point);
+        }
+    }
+}
+
+void Filters::convolve(Uint32* buffer, int w, int h, const float* kernel, int size) {
+    if (buffer == nullptr || w <= 0 || h <= 0) return;
+    float taps[25*4];
+    for (int t = 0; t < size*size; t++) {
+        taps[t*4] = taps[t*4 + 1] = taps[t*4 + 2] = kernel[t];
+        taps[t*4 + 3] = 0.0f; // Alpha is copied over instead
+    }
+    scratch.assign(buffer, buffer + (size_t) w*h);
+    Convolution conv = {scratch.data(), buffer, w, h, size, taps};
+    Jobs::parallelFor((size_t) h, std::max(minPixels/(size_t) w, (size_t) 1), convolveRows, &conv);
+}
+
+// Brings what was drawn so far into the pixels[] layer, nullptr if that failed
+static Uint32* readFrame() {
+    if (easySDL::get_mode3d()) Batch3D::flush();
+    else Batch2D::flush();
+    Uint32* data = Pixels::acquire();
+    if (data == nullptr || !Readback::read(data, Pixels::get_width(), Pixels::get_height())) return nullptr;
+    // The window's own alpha isn't meant to be seen, the layer is drawn blended
+    Filters::apply(data, Pixels::get_width(), Pixels::get_height(), FILTER_OPAQUE, 0.0f);
+    return data;
+}
+
+void Filters::frame(FilterKind kind, float param, bool queued) {
+    Uint32* data = readFrame();
+    if (data == nullptr) {
+        if (queued) Pixels::release();
+        return;
+    }
+    apply(data, Pixels::get_width(), Pixels::get_height(), kind, param);
+    Pixels::draw(0, 0, Pixels::get_width(), Pixels::get_height(), queued);
+}
+
+void Filters::frameConvolve(const float* kernel, int size, bool queued) {
+    Uint32* data = readFrame();
+    if (data == nullptr) {
+        if (queued) Pixels::release();
+        return;
+    }
+    convolve(data, Pixels::get_width(), Pixels::get_height(), kernel, size);
+    Pixels::draw(0, 0, Pixels::get_width(), Pixels::get_height(), queued);
+}
+
+void Filters::setKernel(int part, const float* values) {
+    for (int i = 0; i < 6 && part*6 + i < 25; i++) staged[part*6 + i] = values[i];
+}
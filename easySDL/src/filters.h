@@ -0,0 +1,94 @@
+
+/** @file
+ * @brief Image filters over ARGB8888 buffers and the frame, see filter() in easySDL.h.
+ */
+
+#ifndef EASYSDL_FILTERS_H
+#define EASYSDL_FILTERS_H
+
+#include "easySDL.h"
+
+#include <SDL2/SDL.h>
+
+#include <vector>
+
+/** @class Filters
+ * @brief filter() and convolve(), four pixels at a time with SSE2, split across cores by Jobs.
+ *
+ * - Per pixel filters run over bands of rows in place.
+ * - Gaussian blur, erode and dilate are separable: a horizontal pass into a scratch image
+ *   (each row copied out with its edge pixels repeated, so the taps never go out of bounds),
+ *   then a vertical pass back. Blur weights are 14-bit fixed point, two taps per _mm_madd_epi16.
+ * - Box blur keeps running sums, so its cost doesn't grow with the radius. The vertical
+ *   pass goes down bands of columns.
+ * - convolve() converts rows to floats once into a small ring per band.
+ *
+ * Filtering the frame (frame(), on the drawing thread) reads the back buffer into the
+ * pixels[] layer, filters it there and draws it back over the window.
+ */
+class Filters {
+public:
+    Filters() = delete;
+
+    static const int maxRadius = 128;
+
+    /// @brief param for filter(kind) without one.
+    static float defaultParam(FilterKind kind);
+    /// @brief Warns about param values kind can't use, for the public functions to call first.
+    static bool check(FilterKind kind, float param);
+
+    /// @brief Filters w*h pixels in place.
+    static void apply(Uint32* buffer, int w, int h, FilterKind kind, float param);
+    /// @brief Convolves w*h pixels in place with a size*size kernel (3 or 5), alpha stays.
+    static void convolve(Uint32* buffer, int w, int h, const float* kernel, int size);
+
+    /// @brief Filters what was drawn so far, on the drawing thread. queued is as in Pixels::draw().
+    static void frame(FilterKind kind, float param, bool queued);
+    /// @brief Convolves what was drawn so far, like frame().
+    static void frameConvolve(const float* kernel, int size, bool queued);
+    /// @brief Stores values [part*6, part*6 + 6) of get_kernel(), from CMD_KERNEL.
+    static void setKernel(int part, const float* values);
+    /// @brief The kernel CMD_KERNEL put together on this thread, for CMD_CONVOLVE.
+    static const float* get_kernel() { return staged; };
+
+private:
+    enum PassOp { PASS_BLUR, PASS_MIN, PASS_MAX };
+
+    struct Pass {
+        PassOp op;
+        const Uint32* src;
+        Uint32* dst;
+        int w, h, radius;
+        const Sint16* weights; // PASS_BLUR: 2*radius + 2 of them, summing to 1 << 14, the last one 0
+    };
+
+    struct Point {
+        Uint32* buffer;
+        int w;
+        FilterKind kind;
+        int level;          // FILTER_THRESHOLD
+        const Uint8* table; // FILTER_POSTERIZE
+    };
+
+    struct Convolution {
+        const Uint32* src;
+        Uint32* dst;
+        int w, h, size;
+        const float* kernel; // size*size taps of 4 floats, alpha 0
+    };
+
+    // Per thread, filtering can run on the main and the render thread at the same time
+    static thread_local std::vector<Uint32> scratch;
+    static thread_local float staged[25];
+
+    static void pointRows(size_t begin, size_t end, void* point);
+    static void horizontalRows(size_t begin, size_t end, void* pass);
+    static void verticalRows(size_t begin, size_t end, void* pass);
+    static void boxRows(size_t begin, size_t end, void* pass);
+    static void boxColumns(size_t begin, size_t end, void* pass);
+    static void convolveRows(size_t begin, size_t end, void* convolution);
+    static void runRow(const Pass& pass, const Uint32* const* taps, Uint32* out);
+    static void separable(Uint32* buffer, int w, int h, PassOp op, int radius, const Sint16* weights);
+};
+
+#endif //EASYSDL_FILTERS_H
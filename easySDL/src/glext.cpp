@@ -0,0 +1,48 @@
+
+/** @file
+ * @brief Loader for the OpenGL functions declared in glext.h.
+ */
+
+#include "glext.h"
+#include "internal.h"
+
+bool GLExt::loaded = false;
+bool GLExt::storageTried = false;
+bool GLExt::storageLoaded = false;
+
+#define EASYSDL_GLEXT_DEFINE(type, name, glname) type GLExt::name = nullptr;
+EASYSDL_GLEXT_FUNCTIONS(EASYSDL_GLEXT_DEFINE)
+EASYSDL_GLEXT_STORAGE_FUNCTIONS(EASYSDL_GLEXT_DEFINE)
+#undef EASYSDL_GLEXT_DEFINE
+
+bool GLExt::load() {
+    if (loaded) return true;
+    bool ok = true;
+
+#define EASYSDL_GLEXT_LOAD(type, name, glname) \
+    name = (type) SDL_GL_GetProcAddress(#glname); \
+    if (name == nullptr) { Warn("OpenGL function " #glname " not found!"); ok = false; }
+    EASYSDL_GLEXT_FUNCTIONS(EASYSDL_GLEXT_LOAD)
+#undef EASYSDL_GLEXT_LOAD
+
+    loaded = ok;
+    return ok;
+}
+
+bool GLExt::loadStorage() {
+    if (storageTried) return storageLoaded;
+    storageTried = true;
+    // GetProcAddress can return something for functions the driver doesn't support, ask first
+    if (!load() || !SDL_GL_ExtensionSupported("GL_ARB_buffer_storage") || !SDL_GL_ExtensionSupported("GL_ARB_sync"))
+        return false;
+    bool ok = true;
+
+#define EASYSDL_GLEXT_LOAD(type, name, glname) \
+    name = (type) SDL_GL_GetProcAddress(#glname); \
+    if (name == nullptr) ok = false;
+    EASYSDL_GLEXT_STORAGE_FUNCTIONS(EASYSDL_GLEXT_LOAD)
+#undef EASYSDL_GLEXT_LOAD
+
+    storageLoaded = ok;
+    return ok;
+}
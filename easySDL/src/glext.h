@@ -0,0 +1,75 @@
+
+/** @file
+ * @brief OpenGL entry points newer than 1.1, loaded through SDL_GL_GetProcAddress().
+ */
+
+#ifndef EASYSDL_GLEXT_H
+#define EASYSDL_GLEXT_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+// X(type, name in GLExt, name in the driver)
+#define EASYSDL_GLEXT_FUNCTIONS(X) \
+    X(PFNGLGENBUFFERSPROC,              GenBuffers,              glGenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC,           DeleteBuffers,           glDeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC,              BindBuffer,              glBindBuffer) \
+    X(PFNGLBUFFERDATAPROC,              BufferData,              glBufferData) \
+    X(PFNGLBUFFERSUBDATAPROC,           BufferSubData,           glBufferSubData) \
+    X(PFNGLCREATESHADERPROC,            CreateShader,            glCreateShader) \
+    X(PFNGLDELETESHADERPROC,            DeleteShader,            glDeleteShader) \
+    X(PFNGLSHADERSOURCEPROC,            ShaderSource,            glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC,           CompileShader,           glCompileShader) \
+    X(PFNGLGETSHADERIVPROC,             GetShaderiv,             glGetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC,        GetShaderInfoLog,        glGetShaderInfoLog) \
+    X(PFNGLCREATEPROGRAMPROC,           CreateProgram,           glCreateProgram) \
+    X(PFNGLDELETEPROGRAMPROC,           DeleteProgram,           glDeleteProgram) \
+    X(PFNGLATTACHSHADERPROC,            AttachShader,            glAttachShader) \
+    X(PFNGLBINDATTRIBLOCATIONPROC,      BindAttribLocation,      glBindAttribLocation) \
+    X(PFNGLLINKPROGRAMPROC,             LinkProgram,             glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC,            GetProgramiv,            glGetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC,       GetProgramInfoLog,       glGetProgramInfoLog) \
+    X(PFNGLUSEPROGRAMPROC,              UseProgram,              glUseProgram) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, EnableVertexAttribArray, glEnableVertexAttribArray) \
+    X(PFNGLDISABLEVERTEXATTRIBARRAYPROC,DisableVertexAttribArray,glDisableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC,     VertexAttribPointer,     glVertexAttribPointer) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC,     VertexAttribDivisor,     glVertexAttribDivisor) \
+    X(PFNGLDRAWARRAYSINSTANCEDPROC,     DrawArraysInstanced,     glDrawArraysInstanced)
+
+// Persistently mapped buffers (GL 4.4 / ARB_buffer_storage) and fences (GL 3.2 / ARB_sync), optional
+#define EASYSDL_GLEXT_STORAGE_FUNCTIONS(X) \
+    X(PFNGLBUFFERSTORAGEPROC,           BufferStorage,           glBufferStorage) \
+    X(PFNGLMAPBUFFERRANGEPROC,          MapBufferRange,          glMapBufferRange) \
+    X(PFNGLUNMAPBUFFERPROC,             UnmapBuffer,             glUnmapBuffer) \
+    X(PFNGLFENCESYNCPROC,               FenceSync,               glFenceSync) \
+    X(PFNGLCLIENTWAITSYNCPROC,          ClientWaitSync,          glClientWaitSync) \
+    X(PFNGLDELETESYNCPROC,              DeleteSync,              glDeleteSync)
+
+/** @class GLExt
+ * @brief Static holder for the OpenGL functions SDL_opengl.h doesn't give us directly.
+ *
+ * Call GLExt::load() with a current context, then use e.g. GLExt::GenBuffers().
+ * The storage functions are loaded separately by loadStorage(), nothing needs them.
+ */
+class GLExt {
+public:
+    GLExt() = delete;
+
+    /// @brief Loads every function, returns false if any of them is missing.
+    static bool load();
+    static bool get_loaded() { return loaded; };
+    /// @brief Loads the storage functions too, returns false if the driver doesn't have them.
+    static bool loadStorage();
+
+#define EASYSDL_GLEXT_DECLARE(type, name, glname) static type name;
+    EASYSDL_GLEXT_FUNCTIONS(EASYSDL_GLEXT_DECLARE)
+    EASYSDL_GLEXT_STORAGE_FUNCTIONS(EASYSDL_GLEXT_DECLARE)
+#undef EASYSDL_GLEXT_DECLARE
+
+private:
+    static bool loaded;
+    static bool storageTried;
+    static bool storageLoaded;
+};
+
+#endif //EASYSDL_GLEXT_H
@@ -0,0 +1,161 @@
+
+/** @file
+ * @brief GL state cache implementation.
+ */
+
+#include "glstate.h"
+#include "glext.h"
+
+bool GLState::caps[GLState::CAP_COUNT] = {false};
+bool GLState::arrays[GLState::ARRAY_COUNT] = {false};
+GLenum GLState::blendSrc = GL_ONE;
+GLenum GLState::blendDst = GL_ZERO;
+GLenum GLState::alphaTest = GL_ALWAYS;
+GLfloat GLState::alphaRef = 0.0f;
+SDL_Color GLState::currentColor = {255, 255, 255, 255};
+bool GLState::colorKnown = false;
+GLuint GLState::arrayBuffer = 0;
+GLuint GLState::texture = 0;
+GLuint GLState::program = 0;
+Uint32 GLState::changes = 0;
+Uint32 GLState::skipped = 0;
+std::atomic<Uint32> GLState::lastChanges(0);
+std::atomic<Uint32> GLState::lastSkipped(0);
+
+int GLState::capIndex(GLenum cap) {
+    switch (cap) {
+        case GL_DEPTH_TEST: return 0;
+        case GL_BLEND: return 1;
+        case GL_MULTISAMPLE: return 2;
+        case GL_LINE_SMOOTH: return 3;
+        case GL_TEXTURE_2D: return 4;
+        case GL_ALPHA_TEST: return 5;
+        default: return -1;
+    }
+}
+
+int GLState::arrayIndex(GLenum array) {
+    switch (array) {
+        case GL_VERTEX_ARRAY: return 0;
+        case GL_TEXTURE_COORD_ARRAY: return 1;
+        case GL_COLOR_ARRAY: return 2;
+        default: return -1;
+    }
+}
+
+void GLState::init() {
+    // GL defaults: everything off, nothing bound
+    for (bool& cap : caps) cap = false;
+    for (bool& array : arrays) array = false;
+    blendSrc = GL_ONE; blendDst = GL_ZERO;
+    alphaTest = GL_ALWAYS; alphaRef = 0.0f;
+    colorKnown = false;
+    arrayBuffer = 0; texture = 0; program = 0;
+
+    set_enabled(GL_DEPTH_TEST, true);
+    set_enabled(GL_BLEND, true);
+    blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    set_enabled(GL_MULTISAMPLE, true);
+    set_enabled(GL_LINE_SMOOTH, true);
+//    set_enabled(GL_POLYGON_SMOOTH, true);
+}
+
+void GLState::set_enabled(GLenum cap, bool enabled) {
+    int i = capIndex(cap);
+    if (i >= 0) {
+        if (caps[i] == enabled) {
+            skipped++;
+            return;
+        }
+        caps[i] = enabled;
+    }
+    if (enabled) glEnable(cap);
+    else glDisable(cap);
+    changes++;
+}
+
+void GLState::set_clientState(GLenum array, bool enabled) {
+    int i = arrayIndex(array);
+    if (i >= 0) {
+        if (arrays[i] == enabled) {
+            skipped++;
+            return;
+        }
+        arrays[i] = enabled;
+    }
+    if (enabled) glEnableClientState(array);
+    else glDisableClientState(array);
+    changes++;
+}
+
+void GLState::blendFunc(GLenum src, GLenum dst) {
+    if (src == blendSrc && dst == blendDst) {
+        skipped++;
+        return;
+    }
+    blendSrc = src; blendDst = dst;
+    glBlendFunc(src, dst);
+    changes++;
+}
+
+void GLState::alphaFunc(GLenum func, GLfloat ref) {
+    if (func == alphaTest && ref == alphaRef) {
+        skipped++;
+        return;
+    }
+    alphaTest = func; alphaRef = ref;
+    glAlphaFunc(func, ref);
+    changes++;
+}
+
+void GLState::color(SDL_Color c) {
+    if (colorKnown && c.r == currentColor.r && c.g == currentColor.g && c.b == currentColor.b && c.a == currentColor.a) {
+        skipped++;
+        return;
+    }
+    currentColor = c;
+    colorKnown = true;
+    glColor4ub(c.r, c.g, c.b, c.a);
+    changes++;
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    if (!GLExt::get_loaded()) return; // Then nothing was ever bound either
+    if (target == GL_ARRAY_BUFFER) {
+        if (buffer == arrayBuffer) {
+            skipped++;
+            return;
+        }
+        arrayBuffer = buffer;
+    }
+    GLExt::BindBuffer(target, buffer);
+    changes++;
+}
+
+void GLState::bindTexture(GLuint id) {
+    if (id == texture) {
+        skipped++;
+        return;
+    }
+    texture = id;
+    glBindTexture(GL_TEXTURE_2D, id);
+    changes++;
+}
+
+void GLState::useProgram(GLuint id) {
+    if (!GLExt::get_loaded()) return;
+    if (id == program) {
+        skipped++;
+        return;
+    }
+    program = id;
+    GLExt::UseProgram(id);
+    changes++;
+}
+
+void GLState::endFrame() {
+    lastChanges = changes;
+    lastSkipped = skipped;
+    changes = 0;
+    skipped = 0;
+}
@@ -0,0 +1,73 @@
+
+/** @file
+ * @brief Shadow copy of the GL state easySDL touches, drops calls that wouldn't change anything.
+ */
+
+#ifndef EASYSDL_GLSTATE_H
+#define EASYSDL_GLSTATE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <atomic>
+
+/** @class GLState
+ * @brief Tracks capabilities, blending, alpha test, current color, bound buffer, texture and program.
+ *
+ * Everything in easySDL that changes one of these goes through here, so a call that sets
+ * what is already set costs a compare instead of a trip into the driver. Calls that did
+ * reach the driver are counted per frame, see stateChanges() in easySDL.h.
+ *
+ * Only valid on the thread that owns the context, same as the GL calls it wraps.
+ */
+class GLState {
+public:
+    GLState() = delete;
+
+    /// @brief Sets the defaults from createWindow() through the cache. Needs a current context.
+    static void init();
+
+    static void set_enabled(GLenum cap, bool enabled);
+    static void set_clientState(GLenum array, bool enabled);
+    static void blendFunc(GLenum src, GLenum dst);
+    static void alphaFunc(GLenum func, GLfloat ref);
+    static void color(SDL_Color c);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    static void bindTexture(GLuint texture);
+    static void useProgram(GLuint program);
+
+    /// @brief The current color is undefined after drawing with GL_COLOR_ARRAY, forget it.
+    static void invalidateColor() { colorKnown = false; };
+    /// @brief Deleting a bound texture or buffer unbinds it, call these before glDelete*().
+    static void forgetTexture(GLuint id) { if (texture == id) texture = 0; };
+    static void forgetBuffer(GLuint id) { if (arrayBuffer == id) arrayBuffer = 0; };
+
+    /// @brief Latches this frame's counts for stateChanges(). Called once the frame is drawn.
+    static void endFrame();
+    static Uint32 get_changes() { return lastChanges; };
+    static Uint32 get_skipped() { return lastSkipped; };
+
+private:
+    enum { CAP_COUNT = 6, ARRAY_COUNT = 3 };
+
+    static bool caps[CAP_COUNT];
+    static bool arrays[ARRAY_COUNT];
+    static GLenum blendSrc, blendDst;
+    static GLenum alphaTest;
+    static GLfloat alphaRef;
+    static SDL_Color currentColor;
+    static bool colorKnown;
+    static GLuint arrayBuffer;
+    static GLuint texture;
+    static GLuint program;
+
+    static Uint32 changes;
+    static Uint32 skipped;
+    static std::atomic<Uint32> lastChanges; // Read from the main thread in threadedMode()
+    static std::atomic<Uint32> lastSkipped;
+
+    static int capIndex(GLenum cap);
+    static int arrayIndex(GLenum array);
+};
+
+#endif //EASYSDL_GLSTATE_H
@@ -0,0 +1,462 @@
+
+/** @file
+ * @brief Image decoding, atlas packing and texture residency.
+ */
+
+#include "images.h"
+#include "displaylist.h"
+#include "glstate.h"
+#include "internal.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef EASYSDL_IMAGE
+#include <SDL2/SDL_image.h>
+#endif
+
+SDL_Renderer* Images::renderer = nullptr;
+bool Images::mode3d = false;
+size_t Images::budget = (size_t) 256 << 20;
+size_t Images::residentBytes = 0;
+std::atomic<Uint32> Images::frame(0);
+
+std::vector<Images::Image> Images::images;
+std::vector<Images::Page> Images::pages;
+SDL_mutex* Images::tableMutex = nullptr;
+
+SDL_Thread* Images::workers[Images::maxWorkers] = {};
+int Images::workerCount = 0;
+SDL_mutex* Images::jobMutex = nullptr;
+SDL_sem* Images::jobsReady = nullptr;
+SDL_cond* Images::allDecoded = nullptr;
+std::deque<Images::Job> Images::jobs;
+std::vector<Images::Decoded> Images::done;
+std::atomic<int> Images::decoding(0);
+std::atomic<bool> Images::stopping(false);
+
+void Images::init(SDL_Renderer* r, bool is3d) {
+    renderer = r;
+    mode3d = is3d;
+    if (tableMutex == nullptr) tableMutex = SDL_CreateMutex();
+}
+
+void Images::quit() {
+    if (workerCount > 0) {
+        stopping = true;
+        for (int i = 0; i < workerCount; i++) SDL_SemPost(jobsReady);
+        for (int i = 0; i < workerCount; i++) SDL_WaitThread(workers[i], nullptr);
+        workerCount = 0;
+        SDL_DestroySemaphore(jobsReady);
+        SDL_DestroyCond(allDecoded);
+        SDL_DestroyMutex(jobMutex);
+        jobsReady = nullptr;
+        allDecoded = nullptr;
+        jobMutex = nullptr;
+    }
+    for (Decoded& d : done) SDL_FreeSurface(d.surface);
+    done.clear();
+    jobs.clear();
+
+    for (Page& page : pages) {
+        for (Upload& u : page.pending) SDL_FreeSurface(u.surface);
+        destroyTexture(page);
+    }
+    pages.clear();
+    images.clear();
+    residentBytes = 0;
+
+    if (tableMutex != nullptr) SDL_DestroyMutex(tableMutex);
+    tableMutex = nullptr;
+    renderer = nullptr;
+}
+
+
+// Decoding
+
+void Images::startWorkers() {
+    jobMutex = SDL_CreateMutex();
+    jobsReady = SDL_CreateSemaphore(0);
+    allDecoded = SDL_CreateCond();
+    stopping = false;
+    // Leave a core for the main thread (and one more for the render thread, it's fine)
+    int count = std::min(maxWorkers, std::max(1, SDL_GetCPUCount() - 1));
+    for (int i = 0; i < count; i++) {
+        workers[workerCount] = SDL_CreateThread(worker, "easySDL image", nullptr);
+        if (workers[workerCount] == nullptr) {
+            ErrorSDL("Failed to start an image decoding thread!");
+            break;
+        }
+        workerCount++;
+    }
+}
+
+int Images::worker(void*) {
+    while (true) {
+        SDL_SemWait(jobsReady);
+        if (stopping) break;
+
+        SDL_LockMutex(jobMutex);
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        SDL_UnlockMutex(jobMutex);
+
+        Decoded result = {job.id, nullptr, false, {}};
+        result.surface = decode(job.path, result.padded, result.error);
+
+        SDL_LockMutex(jobMutex);
+        done.push_back(std::move(result));
+        if (--decoding == 0) SDL_CondBroadcast(allDecoded);
+        SDL_UnlockMutex(jobMutex);
+    }
+    return 0;
+}
+
+SDL_Surface* Images::decode(const std::string& path, bool& padded, std::string& error) {
+#ifdef EASYSDL_IMAGE
+    SDL_Surface* loaded = IMG_Load(path.c_str());
+#else
+    SDL_Surface* loaded = SDL_LoadBMP(path.c_str());
+#endif
+    if (loaded == nullptr) {
+        error = SDL_GetError(); // Per thread, has to be read here
+        return nullptr;
+    }
+    SDL_Surface* result = prepare(loaded, padded);
+    SDL_FreeSurface(loaded);
+    if (result == nullptr) error = SDL_GetError();
+    return result;
+}
+
+// RGBA32 copy of the surface, padded if it's going to an atlas
+SDL_Surface* Images::prepare(SDL_Surface* surface, bool& padded) {
+    SDL_Surface* rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+    if (rgba == nullptr) return nullptr;
+    padded = false;
+    if (rgba->w > atlasMaxImage || rgba->h > atlasMaxImage) return rgba;
+
+    // Goes to an atlas: one pixel of repeated edge around it, filtering at the border stays inside
+    int w = rgba->w, h = rgba->h;
+    SDL_Surface* out = SDL_CreateRGBSurfaceWithFormat(0, w + 2, h + 2, 32, SDL_PIXELFORMAT_RGBA32);
+    if (out == nullptr) return rgba;
+    for (int y = -1; y <= h; y++) {
+        const Uint32* src = (const Uint32*) ((const Uint8*) rgba->pixels + std::min(std::max(y, 0), h - 1) * rgba->pitch);
+        Uint32* dst = (Uint32*) ((Uint8*) out->pixels + (y + 1) * out->pitch);
+        dst[0] = src[0];
+        memcpy(dst + 1, src, (size_t) w * 4);
+        dst[w + 1] = src[w - 1];
+    }
+    SDL_FreeSurface(rgba);
+    padded = true;
+    return out;
+}
+
+void Images::queue(int id) {
+    images[id].state = IMAGE_QUEUED;
+    decoding++;
+    SDL_LockMutex(jobMutex);
+    jobs.push_back({id, images[id].path});
+    SDL_UnlockMutex(jobMutex);
+    SDL_SemPost(jobsReady);
+}
+
+int Images::load(const char* path) {
+    if (tableMutex == nullptr) tableMutex = SDL_CreateMutex(); // loadImage() before window()
+#ifndef EASYSDL_IMAGE
+    static bool warned = false;
+    size_t length = strlen(path);
+    if (!warned && (length < 4 || SDL_strcasecmp(path + length - 4, ".bmp") != 0)) {
+        Warn("loadImage(): built without SDL_image, only BMP files can be loaded!");
+        warned = true;
+    }
+#endif
+    if (workerCount == 0) startWorkers();
+
+    lock();
+    Image image = {path, IMAGE_QUEUED, false, 0, 0, {-1, 0, 0, 0, 0, 0, 0}};
+    images.push_back(image);
+    int id = (int) images.size() - 1;
+    if (workerCount == 0) {
+        images[id].state = IMAGE_FAILED; // Nobody to decode it
+        unlock();
+        return id;
+    }
+    queue(id);
+    unlock();
+    return id;
+}
+
+int Images::add(SDL_Surface* surface, bool pinned) {
+    if (tableMutex == nullptr) tableMutex = SDL_CreateMutex();
+    bool padded;
+    SDL_Surface* prepared = prepare(surface, padded);
+    if (prepared == nullptr) {
+        ErrorSDL("Failed to convert an image!");
+        return -1;
+    }
+
+    lock();
+    Image image = {{}, IMAGE_QUEUED, pinned, 0, 0, {-1, 0, 0, 0, 0, 0, 0}};
+    images.push_back(image);
+    int id = (int) images.size() - 1;
+    place(id, prepared, padded);
+    unlock();
+    return id;
+}
+
+void Images::wait() {
+    if (workerCount > 0) {
+        SDL_LockMutex(jobMutex);
+        while (decoding > 0) SDL_CondWait(allDecoded, jobMutex);
+        SDL_UnlockMutex(jobMutex);
+    }
+    update();
+}
+
+
+// Placing and evicting, main thread
+
+bool Images::pack(Page& page, int w, int h, SDL_Rect& rect) {
+    // Worked out on copies, a miss leaves the shelf as it was for a smaller image
+    int x = page.shelfX, y = page.shelfY, shelfHeight = page.shelfHeight;
+    if (x + w > page.width) { // Next shelf
+        y += shelfHeight;
+        x = 0;
+        shelfHeight = 0;
+    }
+    if (y + h > page.height || w > page.width) return false;
+    rect = {x, y, w, h};
+    page.shelfX = x + w;
+    page.shelfY = y;
+    page.shelfHeight = std::max(shelfHeight, h);
+    return true;
+}
+
+int Images::newPage(int w, int h, bool atlas, bool pinned) {
+    int index = -1;
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i].state == PAGE_FREE) {
+            index = (int) i;
+            break;
+        }
+    }
+    if (index < 0) {
+        pages.emplace_back();
+        index = (int) pages.size() - 1;
+    }
+    Page& page = pages[index];
+    page.state = PAGE_LIVE;
+    page.atlas = atlas;
+    page.pinned = pinned;
+    page.width = w;
+    page.height = h;
+    page.shelfX = page.shelfY = page.shelfHeight = 0;
+    page.texture = nullptr;
+    page.glTexture = 0;
+    page.images.clear();
+    page.pending.clear();
+    page.lastUsed = frame;
+    residentBytes += (size_t) w * h * 4;
+    return index;
+}
+
+void Images::place(int id, SDL_Surface* surface, bool atlas) {
+    Image& image = images[id];
+    int border = atlas ? 1 : 0;
+    image.width = surface->w - 2 * border;
+    image.height = surface->h - 2 * border;
+
+    SDL_Rect rect;
+    int index = -1;
+    if (atlas) {
+        for (size_t i = 0; i < pages.size() && index < 0; i++)
+            if (pages[i].state == PAGE_LIVE && pages[i].atlas && pages[i].pinned == image.pinned &&
+                pack(pages[i], surface->w, surface->h, rect))
+                index = (int) i;
+        if (index < 0) {
+            index = newPage(atlasSize, atlasSize, true, image.pinned);
+            pack(pages[index], surface->w, surface->h, rect);
+        }
+    } else {
+        index = newPage(surface->w, surface->h, false, image.pinned);
+        rect = {0, 0, surface->w, surface->h};
+    }
+
+    Page& page = pages[index];
+    page.images.push_back(id);
+    page.pending.push_back({surface, rect});
+    page.lastUsed = frame; // Loaded to be drawn, don't evict it right away
+
+    ImageRegion& region = image.region;
+    region.page = index;
+    region.u0 = (float) (rect.x + border) / (float) page.width;
+    region.v0 = (float) (rect.y + border) / (float) page.height;
+    region.u1 = (float) (rect.x + border + image.width) / (float) page.width;
+    region.v1 = (float) (rect.y + border + image.height) / (float) page.height;
+    region.width = image.width;
+    region.height = image.height;
+    image.state = IMAGE_READY;
+}
+
+void Images::evict(int index) {
+    Page& page = pages[index];
+    for (int id : page.images) {
+        if (images[id].state == IMAGE_READY && images[id].region.page == index) {
+            images[id].state = IMAGE_EVICTED;
+            images[id].region.page = -1;
+        }
+    }
+    page.images.clear();
+    page.state = PAGE_DYING; // The texture goes away in upload(), on the drawing thread
+    residentBytes -= (size_t) page.width * page.height * 4;
+}
+
+void Images::update() {
+    if (workerCount == 0) return;
+    frame++;
+
+    SDL_LockMutex(jobMutex);
+    bool decoded = !done.empty();
+    SDL_UnlockMutex(jobMutex);
+    if (!decoded && residentBytes <= budget) return; // Nothing to do, don't touch the lock
+
+    lock();
+    SDL_LockMutex(jobMutex);
+    std::vector<Decoded> ready;
+    ready.swap(done);
+    SDL_UnlockMutex(jobMutex);
+
+    bool changed = false;
+    for (Decoded& d : ready) {
+        if (d.surface == nullptr) {
+            Error("Failed to load image " + images[d.id].path + ": " + d.error);
+            images[d.id].state = IMAGE_FAILED;
+            continue;
+        }
+        place(d.id, d.surface, d.padded);
+        changed = true;
+    }
+
+    // Least recently drawn pages first, never the ones used this or last frame
+    while (residentBytes > budget) {
+        int oldest = -1;
+        for (size_t i = 0; i < pages.size(); i++) {
+            const Page& page = pages[i];
+            if (page.state != PAGE_LIVE || page.pinned || page.lastUsed + 1 >= frame) continue;
+            if (oldest < 0 || page.lastUsed < pages[oldest].lastUsed) oldest = (int) i;
+        }
+        if (oldest < 0) break; // All in use, over budget it is
+        evict(oldest);
+        changed = true;
+    }
+    unlock();
+
+    if (changed) FrameSkipper::invalidate(); // Same commands, different pixels
+}
+
+
+// Textures, drawing thread
+
+void Images::destroyTexture(Page& page) {
+    if (page.texture != nullptr) SDL_DestroyTexture(page.texture);
+    if (page.glTexture != 0) {
+        GLState::forgetTexture(page.glTexture);
+        glDeleteTextures(1, &page.glTexture);
+    }
+    page.texture = nullptr;
+    page.glTexture = 0;
+}
+
+void Images::upload() {
+    static std::vector<Uint8> zeros;
+
+    for (Page& page : pages) {
+        if (page.state == PAGE_DYING) {
+            for (Upload& u : page.pending) SDL_FreeSurface(u.surface);
+            page.pending.clear();
+            destroyTexture(page);
+            page.state = PAGE_FREE;
+            continue;
+        }
+        if (page.state != PAGE_LIVE || page.pending.empty()) continue;
+
+        // Atlases start transparent, the gaps between images must not show garbage
+        const void* initial = nullptr;
+        if (page.atlas && page.texture == nullptr && page.glTexture == 0) {
+            zeros.resize((size_t) page.width * page.height * 4);
+            initial = zeros.data();
+        }
+
+        if (mode3d) {
+            if (page.glTexture == 0) {
+                glGenTextures(1, &page.glTexture);
+                GLState::bindTexture(page.glTexture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page.width, page.height, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, initial);
+            } else {
+                GLState::bindTexture(page.glTexture);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            for (Upload& u : page.pending) {
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, u.surface->pitch / 4);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, u.rect.x, u.rect.y, u.rect.w, u.rect.h,
+                                GL_RGBA, GL_UNSIGNED_BYTE, u.surface->pixels);
+                SDL_FreeSurface(u.surface);
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        } else {
+            if (page.texture == nullptr) {
+                page.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC,
+                                                 page.width, page.height);
+                if (page.texture == nullptr) {
+                    ErrorSDL("Failed to create an image texture!");
+                    for (Upload& u : page.pending) SDL_FreeSurface(u.surface);
+                    page.pending.clear();
+                    continue;
+                }
+                SDL_SetTextureBlendMode(page.texture, SDL_BLENDMODE_BLEND);
+                if (initial != nullptr) SDL_UpdateTexture(page.texture, nullptr, initial, page.width * 4);
+            }
+            for (Upload& u : page.pending) {
+                SDL_UpdateTexture(page.texture, &u.rect, u.surface->pixels, u.surface->pitch);
+                SDL_FreeSurface(u.surface);
+            }
+        }
+        page.pending.clear();
+    }
+}
+
+bool Images::lookup(int id, ImageRegion& region) {
+    if (id < 0 || id >= (int) images.size()) return false;
+    Image& image = images[id];
+    if (image.state == IMAGE_EVICTED) {
+        queue(id); // Wanted again, it'll be back in a frame or two
+        return false;
+    }
+    if (image.state != IMAGE_READY) return false;
+    pages[image.region.page].lastUsed = frame;
+    region = image.region;
+    return true;
+}
+
+
+// Queries
+
+// No lock, only the main thread adds images and these don't care about the page
+
+bool Images::get_loaded(int id) {
+    if (id < 0 || id >= (int) images.size()) return false;
+    return images[id].width > 0; // Known once decoded, stays known after eviction
+}
+
+int Images::get_width(int id) {
+    return id >= 0 && id < (int) images.size() ? images[id].width : 0;
+}
+
+int Images::get_height(int id) {
+    return id >= 0 && id < (int) images.size() ? images[id].height : 0;
+}
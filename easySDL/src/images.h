@@ -0,0 +1,149 @@
+
+/** @file
+ * @brief Image loading and texture management, see loadImage() in easySDL.h.
+ */
+
+#ifndef EASYSDL_IMAGES_H
+#define EASYSDL_IMAGES_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+/// @brief Where a loaded image is right now: which texture page and which part of it.
+struct ImageRegion {
+    int page;
+    float u0, v0, u1, v1;
+    int width, height;
+};
+
+/** @class Images
+ * @brief Decodes images on worker threads and packs them into texture pages.
+ *
+ * Small images share 1024x1024 atlas pages (shelf packed, edges repeated one pixel out
+ * so filtering doesn't bleed), big ones get a page of their own. Pages are the unit of
+ * the memory budget: when over it, the least recently drawn page is dropped and its
+ * images are decoded again the next time they're drawn.
+ *
+ * Images made in memory with add() (text glyphs) are pinned: they go to their own
+ * pages, which are never evicted, since there is no file to load them from again.
+ *
+ * update() runs on the main thread, upload() and lookup() on the thread that draws.
+ * With threadedMode() that's the render thread, which holds lock() while it draws.
+ */
+class Images {
+public:
+    Images() = delete;
+
+    static const int atlasSize = 1024;
+    static const int atlasMaxImage = 256; // Bigger images get their own page
+    static const int maxWorkers = 4;
+
+    static void init(SDL_Renderer* renderer, bool mode3d);
+    static void quit();
+
+    static int load(const char* path);
+    /// @brief Adds an image from memory right away, main thread only. The surface stays the caller's.
+    static int add(SDL_Surface* surface, bool pinned);
+    /// @brief Places freshly decoded images and evicts pages over the budget. Once per frame.
+    static void update();
+    /// @brief Creates, fills and destroys the textures. Called right before drawing sprites.
+    static void upload();
+    /// @brief Blocks until everything loaded so far is decoded and placed.
+    static void wait();
+
+    /// @brief Region of an image that is on a page, marks the page as used. False if it isn't (yet).
+    static bool lookup(int id, ImageRegion& region);
+    static SDL_Texture* get_texture(int page) { return pages[page].texture; };
+    static GLuint get_glTexture(int page) { return pages[page].glTexture; };
+
+    static bool get_loaded(int id);
+    static int get_width(int id);
+    static int get_height(int id);
+
+    static void set_budget(size_t bytes) { budget = bytes; };
+    static size_t get_budget() { return budget; };
+    static size_t get_residentBytes() { return residentBytes; };
+
+    static void lock() { if (tableMutex != nullptr) SDL_LockMutex(tableMutex); };
+    static void unlock() { if (tableMutex != nullptr) SDL_UnlockMutex(tableMutex); };
+
+private:
+    enum ImageState { IMAGE_QUEUED, IMAGE_READY, IMAGE_EVICTED, IMAGE_FAILED };
+    enum PageState { PAGE_FREE, PAGE_LIVE, PAGE_DYING };
+
+    struct Image {
+        std::string path;
+        ImageState state;
+        bool pinned;
+        int width, height;
+        ImageRegion region;
+    };
+
+    struct Upload {
+        SDL_Surface* surface;
+        SDL_Rect rect;
+    };
+
+    struct Page {
+        PageState state;
+        bool atlas;
+        bool pinned;
+        int width, height;
+        int shelfX, shelfY, shelfHeight;
+        SDL_Texture* texture;
+        GLuint glTexture;
+        std::vector<int> images;
+        std::vector<Upload> pending;
+        Uint32 lastUsed;
+    };
+
+    struct Job {
+        int id;
+        std::string path;
+    };
+
+    struct Decoded {
+        int id;
+        SDL_Surface* surface; // nullptr if it failed
+        bool padded;          // Has the repeated edge, goes to an atlas
+        std::string error;
+    };
+
+    static SDL_Renderer* renderer;
+    static bool mode3d;
+    static size_t budget;
+    static size_t residentBytes;
+    static std::atomic<Uint32> frame; // Counted on the main thread, lookup() reads it on the render thread
+
+    static std::vector<Image> images;
+    static std::vector<Page> pages;
+    static SDL_mutex* tableMutex;
+
+    static SDL_Thread* workers[maxWorkers];
+    static int workerCount;
+    static SDL_mutex* jobMutex;
+    static SDL_sem* jobsReady;
+    static SDL_cond* allDecoded;   // Signalled under jobMutex when decoding drops to 0
+    static std::deque<Job> jobs;
+    static std::vector<Decoded> done;
+    static std::atomic<int> decoding;
+    static std::atomic<bool> stopping;
+
+    static void startWorkers();
+    static int worker(void*);
+    static SDL_Surface* decode(const std::string& path, bool& padded, std::string& error);
+    static SDL_Surface* prepare(SDL_Surface* surface, bool& padded);
+    static void queue(int id);
+    static void place(int id, SDL_Surface* surface, bool atlas);
+    static int newPage(int w, int h, bool atlas, bool pinned);
+    static bool pack(Page& page, int w, int h, SDL_Rect& rect);
+    static void evict(int page);
+    static void destroyTexture(Page& page);
+};
+
+#endif //EASYSDL_IMAGES_H
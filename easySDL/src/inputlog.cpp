@@ -0,0 +1,368 @@
+
+/** @file
+ * @brief InputLog implementation.
+ */
+
+#include "inputlog.h"
+#include "easySDL.h"
+#include "internal.h"
+#include "noise.h"
+#include "pacer.h"
+#include "random.h"
+
+#include <cstring>
+
+const char InputLog::magic[8] = {'E', 'S', 'D', 'L', 'I', 'N', 'P', '1'};
+FILE* InputLog::file = nullptr;
+std::vector<Uint8> InputLog::frameBytes;
+Uint32 InputLog::frameEvents = 0;
+Uint32 InputLog::frames = 0;
+Uint32 InputLog::skipped = 0;
+bool InputLog::replaying = false;
+std::vector<Uint8> InputLog::log;
+size_t InputLog::position = 0;
+float InputLog::fixedDelta = 0;
+double InputLog::clock = 0;
+Uint64 InputLog::start = 0;
+std::vector<SDL_Event> InputLog::events;
+int InputLog::mouseX = 0;
+int InputLog::mouseY = 0;
+Uint32 InputLog::mouseButtons = 0;
+Uint8 InputLog::keys[SDL_NUM_SCANCODES];
+
+bool InputLog::startRecording(const std::string& path) {
+    stop();
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        Warn("recordInput(): can't write " + path + "!");
+        return false;
+    }
+
+    // random() and noise() have to start the same way on replay. A seed of the sketch's own already does,
+    // a lazy one from random() or noise() before this is replaced by the logged one
+    Uint64 s = seed();
+    if (!Random::get_chosen()) Random::seed(s);
+    if (!Noise::get_chosen()) Noise::seed(s);
+    std::vector<Uint8> header(magic, magic + 8);
+    put(header, s);
+    fwrite(header.data(), 1, header.size(), file);
+
+    frameBytes.clear();
+    frameEvents = frames = skipped = 0;
+    return true;
+}
+
+bool InputLog::startReplay(const std::string& path, float delta) {
+    stop();
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        Warn("replayInput(): can't read " + path + "!");
+        return false;
+    }
+    // Sessions are small, a few bytes per event. Read it all so disk reads don't show up in frame times
+    log.clear();
+    Uint8 chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) log.insert(log.end(), chunk, chunk + n);
+    fclose(f);
+
+    Uint64 s;
+    position = 8;
+    if (log.size() < 8 || memcmp(log.data(), magic, 8) != 0 || !get(s)) {
+        Warn("replayInput(): " + path + " isn't an input log!");
+        log.clear();
+        return false;
+    }
+    if (!Random::get_chosen()) Random::seed(s); // Same as recording
+    if (!Noise::get_chosen()) Noise::seed(s);
+
+    replaying = true;
+    fixedDelta = delta;
+    frames = 0;
+    clock = 0;
+    events.clear();
+    mouseX = mouseY = 0;
+    mouseButtons = 0;
+    memset(keys, 0, sizeof(keys));
+    keyboardState = keys;
+    return true;
+}
+
+void InputLog::stop() {
+    if (file != nullptr) {
+        if (frameEvents > 0) endFrame(0, mouseX, mouseY, mouseButtons); // Events of a frame cut short, like SDL_QUIT
+        fclose(file);
+        file = nullptr;
+        Log("Recorded " + std::to_string(frames) + " frames of input");
+        if (skipped > 0) Log(std::to_string(skipped) + " events of other types than window, keyboard and mouse weren't recorded");
+    }
+    if (replaying) {
+        replaying = false;
+        log.clear();
+        events.clear();
+        keyboardState = SDL_GetKeyboardState(nullptr);
+        Log("Replayed " + std::to_string(frames) + " frames of input");
+    }
+}
+
+
+// Recording
+
+void InputLog::put(std::vector<Uint8>& out, Uint64 value) {
+    while (value >= 0x80) {
+        out.push_back((Uint8) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((Uint8) value);
+}
+
+void InputLog::putSigned(std::vector<Uint8>& out, Sint64 value) {
+    put(out, ((Uint64) value << 1) ^ (Uint64) (value >> 63)); // Zigzag, small negatives stay short
+}
+
+void InputLog::putFloat(std::vector<Uint8>& out, float value) {
+    Uint32 bits;
+    memcpy(&bits, &value, 4);
+    for (int i = 0; i < 4; i++) out.push_back((Uint8) (bits >> (i*8)));
+}
+
+void InputLog::record(const SDL_Event* event) {
+    std::vector<Uint8>& out = frameBytes;
+    size_t begin = out.size();
+    put(out, event->type);
+    switch (event->type) {
+        case SDL_QUIT:
+            break;
+        case SDL_WINDOWEVENT:
+            put(out, event->window.windowID);
+            put(out, event->window.event);
+            putSigned(out, event->window.data1);
+            putSigned(out, event->window.data2);
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            put(out, event->key.windowID);
+            put(out, event->key.repeat);
+            put(out, (Uint64) event->key.keysym.scancode);
+            putSigned(out, event->key.keysym.sym);
+            put(out, event->key.keysym.mod);
+            break;
+        case SDL_TEXTINPUT: {
+            size_t length = strnlen(event->text.text, sizeof(event->text.text) - 1);
+            put(out, event->text.windowID);
+            put(out, length);
+            out.insert(out.end(), event->text.text, event->text.text + length);
+            break;
+        }
+        case SDL_MOUSEMOTION:
+            put(out, event->motion.windowID);
+            put(out, event->motion.which);
+            put(out, event->motion.state);
+            putSigned(out, event->motion.x);
+            putSigned(out, event->motion.y);
+            putSigned(out, event->motion.xrel);
+            putSigned(out, event->motion.yrel);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            put(out, event->button.windowID);
+            put(out, event->button.which);
+            put(out, event->button.button);
+            put(out, event->button.clicks);
+            putSigned(out, event->button.x);
+            putSigned(out, event->button.y);
+            break;
+        case SDL_MOUSEWHEEL:
+            put(out, event->wheel.windowID);
+            put(out, event->wheel.which);
+            putSigned(out, event->wheel.x);
+            putSigned(out, event->wheel.y);
+            put(out, event->wheel.direction);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+            putFloat(out, event->wheel.preciseX);
+            putFloat(out, event->wheel.preciseY);
+#endif
+            break;
+        default:
+            // Controllers, drops, user events and so on. Some carry pointers, none are part of the log
+            out.resize(begin);
+            skipped++;
+            return;
+    }
+    frameEvents++;
+}
+
+void InputLog::endFrame(float delta, int x, int y, Uint32 buttons) {
+    std::vector<Uint8> header;
+    put(header, frameEvents);
+    putFloat(header, delta);
+    putSigned(header, x);
+    putSigned(header, y);
+    put(header, buttons);
+    fwrite(header.data(), 1, header.size(), file);
+    fwrite(frameBytes.data(), 1, frameBytes.size(), file);
+    frameBytes.clear();
+    frameEvents = 0;
+    frames++;
+    mouseX = x; mouseY = y; mouseButtons = buttons;
+}
+
+Uint64 InputLog::seed() {
+    Uint64 state = SDL_GetPerformanceCounter();
+    return Random::splitmix(state);
+}
+
+
+// Replaying
+
+bool InputLog::get(Uint64& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position >= log.size()) return false;
+        Uint8 byte = log[position++];
+        value |= (Uint64) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool InputLog::getSigned(Sint64& value) {
+    Uint64 bits;
+    if (!get(bits)) return false;
+    value = (Sint64) (bits >> 1) ^ -(Sint64) (bits & 1);
+    return true;
+}
+
+bool InputLog::getFloat(float& value) {
+    if (log.size() - position < 4) return false;
+    Uint32 bits = 0;
+    for (int i = 0; i < 4; i++) bits |= (Uint32) log[position++] << (i*8);
+    memcpy(&value, &bits, 4);
+    return true;
+}
+
+bool InputLog::readEvent(SDL_Event& event) {
+    Uint64 type, a, b, c;
+    Sint64 x, y, dx, dy;
+    memset(&event, 0, sizeof(event));
+    if (!get(type)) return false;
+    event.type = (Uint32) type;
+    event.common.timestamp = SDL_GetTicks();
+    switch (type) {
+        case SDL_QUIT:
+            return true;
+        case SDL_WINDOWEVENT:
+            if (!get(a) || !get(b) || !getSigned(x) || !getSigned(y)) return false;
+            event.window.windowID = (Uint32) a;
+            event.window.event = (Uint8) b;
+            event.window.data1 = (Sint32) x;
+            event.window.data2 = (Sint32) y;
+            return true;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            Uint64 mod;
+            if (!get(a) || !get(b) || !get(c) || !getSigned(x) || !get(mod)) return false;
+            if (c >= SDL_NUM_SCANCODES) return false;
+            event.key.windowID = (Uint32) a;
+            event.key.state = event.type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED;
+            event.key.repeat = (Uint8) b;
+            event.key.keysym.scancode = (SDL_Scancode) c;
+            event.key.keysym.sym = (SDL_Keycode) x;
+            event.key.keysym.mod = (Uint16) mod;
+            keys[c] = event.key.state; // Like SDL, the state is there before update() sees the event
+            return true;
+        }
+        case SDL_TEXTINPUT:
+            if (!get(a) || !get(b) || b >= sizeof(event.text.text) || log.size() - position < b) return false;
+            event.text.windowID = (Uint32) a;
+            memcpy(event.text.text, log.data() + position, b);
+            position += b;
+            return true;
+        case SDL_MOUSEMOTION:
+            if (!get(a) || !get(b) || !get(c) || !getSigned(x) || !getSigned(y) || !getSigned(dx) || !getSigned(dy))
+                return false;
+            event.motion.windowID = (Uint32) a;
+            event.motion.which = (Uint32) b;
+            event.motion.state = (Uint32) c;
+            event.motion.x = (Sint32) x;
+            event.motion.y = (Sint32) y;
+            event.motion.xrel = (Sint32) dx;
+            event.motion.yrel = (Sint32) dy;
+            return true;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP: {
+            Uint64 clicks;
+            if (!get(a) || !get(b) || !get(c) || !get(clicks) || !getSigned(x) || !getSigned(y)) return false;
+            event.button.windowID = (Uint32) a;
+            event.button.which = (Uint32) b;
+            event.button.button = (Uint8) c;
+            event.button.state = event.type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+            event.button.clicks = (Uint8) clicks;
+            event.button.x = (Sint32) x;
+            event.button.y = (Sint32) y;
+            return true;
+        }
+        case SDL_MOUSEWHEEL:
+            if (!get(a) || !get(b) || !getSigned(x) || !getSigned(y) || !get(c)) return false;
+            event.wheel.windowID = (Uint32) a;
+            event.wheel.which = (Uint32) b;
+            event.wheel.x = (Sint32) x;
+            event.wheel.y = (Sint32) y;
+            event.wheel.direction = (Uint32) c;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+            if (!getFloat(event.wheel.preciseX) || !getFloat(event.wheel.preciseY)) return false;
+#endif
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool InputLog::nextFrame(float& delta) {
+    if (position >= log.size()) {
+        stop();
+        return false;
+    }
+
+    Uint64 count, buttons;
+    Sint64 x, y;
+    float recorded;
+    bool ok = get(count) && getFloat(recorded) && getSigned(x) && getSigned(y) && get(buttons);
+    events.clear();
+    for (Uint64 i = 0; ok && i < count; i++) {
+        events.emplace_back();
+        ok = readEvent(events.back());
+    }
+    if (!ok) {
+        Warn("replayInput(): the log is cut off or damaged after frame " + std::to_string(frames) + "!");
+        stop();
+        return false;
+    }
+    mouseX = (int) x;
+    mouseY = (int) y;
+    mouseButtons = (Uint32) buttons;
+    frames++;
+
+    if (fixedDelta > 0) {
+        delta = fixedDelta;
+        return true;
+    }
+
+    // Recorded timing: sleep until the frame is as far from the first one as it was when recording
+    if (frames == 1) {
+        start = FramePacer::now();
+    } else {
+        clock += recorded;
+        double ahead = clock - FramePacer::toSeconds(FramePacer::now() - start)*1000;
+        if (ahead >= 2) SDL_Delay((Uint32) (ahead - 1));
+        while (FramePacer::toSeconds(FramePacer::now() - start)*1000 < clock) {}
+    }
+    delta = recorded;
+    return true;
+}
+
+void InputLog::mouse(int& x, int& y, Uint32& buttons) {
+    x = mouseX;
+    y = mouseY;
+    buttons = mouseButtons;
+}
@@ -0,0 +1,83 @@
+
+/** @file
+ * @brief Input recording and replay, see recordInput() in easySDL.h.
+ */
+
+#ifndef EASYSDL_INPUTLOG_H
+#define EASYSDL_INPUTLOG_H
+
+#include <SDL2/SDL.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/** @class InputLog
+ * @brief Writes what a frame got from SDL to a binary log and feeds it back later.
+ *
+ * A frame is its event count, frameDelta as is, mouseX/mouseY and mouseButtons, then the
+ * events. Integers are zigzag varints, so most of a mouse motion event fits in a few bytes.
+ * Only the event fields are stored, the timestamp is set again on replay.
+ * The random() and noise() seed goes in the header, unless the sketch picked its own.
+ *
+ * Replaying, the log replaces SDL as the input: the events of a frame go through
+ * easySDL::handle_event() like SDL's would, the mouse comes from the log and keyboardState
+ * points at keys kept from the replayed key events. SDL's own events are still pumped,
+ * only SDL_QUIT of them gets through. Window events of the live window still force the next
+ * frame out, see FrameSkipper.
+ */
+class InputLog {
+public:
+    InputLog() = delete;
+
+    static bool startRecording(const std::string& path);
+    /// @param fixedDelta 0 for the recorded timing, otherwise the frameDelta of every frame.
+    static bool startReplay(const std::string& path, float fixedDelta);
+    static void stop();
+
+    static bool get_recording() { return file != nullptr; };
+    static bool get_replaying() { return replaying; };
+
+    // Recording, main thread
+    /// @brief Called by easySDL::handle_event() for every event.
+    static void record(const SDL_Event* event);
+    /// @brief Ends the frame, after the mouse state was read.
+    static void endFrame(float delta, int x, int y, Uint32 buttons);
+
+    // Replaying, main thread
+    /// @brief Reads the next frame and waits until it's due, false at the end of the log.
+    static bool nextFrame(float& delta);
+    static const std::vector<SDL_Event>& get_events() { return events; };
+    static void mouse(int& x, int& y, Uint32& buttons);
+
+private:
+    static const char magic[8];
+
+    static FILE* file;
+    static std::vector<Uint8> frameBytes; // Events of the frame being recorded
+    static Uint32 frameEvents;
+    static Uint32 frames;
+    static Uint32 skipped;                // Events of types the log doesn't know
+
+    static bool replaying;
+    static std::vector<Uint8> log;
+    static size_t position;
+    static float fixedDelta;
+    static double clock;                  // Recorded milliseconds since the first replayed frame
+    static Uint64 start;
+    static std::vector<SDL_Event> events;
+    static int mouseX, mouseY;
+    static Uint32 mouseButtons;
+    static Uint8 keys[SDL_NUM_SCANCODES];
+
+    static void put(std::vector<Uint8>& out, Uint64 value);
+    static void putSigned(std::vector<Uint8>& out, Sint64 value);
+    static void putFloat(std::vector<Uint8>& out, float value);
+    static bool get(Uint64& value);
+    static bool getSigned(Sint64& value);
+    static bool getFloat(float& value);
+    static bool readEvent(SDL_Event& event);
+    static Uint64 seed();
+};
+
+#endif //EASYSDL_INPUTLOG_H
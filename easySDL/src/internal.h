@@ -0,0 +1,19 @@
+
+/** @file
+ * @brief Internal helpers shared between easySDL source files. Not installed.
+ */
+
+#ifndef EASYSDL_INTERNAL_H
+#define EASYSDL_INTERNAL_H
+
+#include <string>
+
+// Utility functions (not visible), defined in easySDL.cpp
+
+void ErrorSDL(std::string err);
+void Error(std::string err);
+void Warn(std::string str);
+void Log(std::string str);
+void Debug(std::string str);
+
+#endif //EASYSDL_INTERNAL_H
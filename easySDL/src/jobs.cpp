@@ -0,0 +1,107 @@
+
+/** @file
+ * @brief Worker pool implementation.
+ */
+
+#include "jobs.h"
+#include "internal.h"
+
+#include <algorithm>
+
+SDL_Thread* Jobs::workers[Jobs::maxWorkers] = {};
+int Jobs::workerCount = 0;
+std::atomic<bool> Jobs::started(false);
+std::mutex Jobs::startLock;
+std::atomic<bool> Jobs::busy(false);
+SDL_sem* Jobs::go = nullptr;
+SDL_sem* Jobs::finished = nullptr;
+std::atomic<bool> Jobs::stopping(false);
+Jobs::Kernel Jobs::kernel = nullptr;
+void* Jobs::context = nullptr;
+size_t Jobs::count = 0;
+size_t Jobs::chunk = 0;
+std::atomic<size_t> Jobs::next(0);
+
+void Jobs::start() {
+    std::lock_guard<std::mutex> lock(startLock);
+    if (started) return; // Another thread got here first
+    go = SDL_CreateSemaphore(0);
+    finished = SDL_CreateSemaphore(0);
+    stopping = false;
+    if (go == nullptr || finished == nullptr) {
+        ErrorSDL("Failed to create the worker pool, loops will run on one thread!");
+        started = true;
+        return;
+    }
+    int wanted = std::min(maxWorkers, SDL_GetCPUCount() - 1); // The caller is one more
+    for (int i = 0; i < wanted; i++) {
+        workers[workerCount] = SDL_CreateThread(worker, "easySDL worker", nullptr);
+        if (workers[workerCount] == nullptr) {
+            ErrorSDL("Failed to start a worker thread!");
+            break;
+        }
+        workerCount++;
+    }
+    started = true; // Last, parallelFor() doesn't lock to see the pool
+}
+
+void Jobs::quit() {
+    std::lock_guard<std::mutex> lock(startLock);
+    if (workerCount > 0) {
+        stopping = true;
+        for (int i = 0; i < workerCount; i++) SDL_SemPost(go);
+        for (int i = 0; i < workerCount; i++) SDL_WaitThread(workers[i], nullptr);
+        workerCount = 0;
+    }
+    if (go != nullptr) SDL_DestroySemaphore(go);
+    if (finished != nullptr) SDL_DestroySemaphore(finished);
+    go = finished = nullptr;
+    started = false;
+}
+
+int Jobs::get_threadCount() {
+    if (!started) start();
+    return workerCount + 1;
+}
+
+void Jobs::runChunks() {
+    while (true) {
+        size_t begin = next.fetch_add(chunk);
+        if (begin >= count) break;
+        kernel(begin, std::min(begin + chunk, count), context);
+    }
+}
+
+int Jobs::worker(void*) {
+    while (true) {
+        SDL_SemWait(go);
+        if (stopping) break;
+        runChunks();
+        SDL_SemPost(finished);
+    }
+    return 0;
+}
+
+void Jobs::parallelFor(size_t n, size_t minChunk, Kernel k, void* c) {
+    if (n == 0) return;
+    if (!started) start();
+    minChunk = std::max(minChunk, (size_t) 1);
+    bool idle = false;
+    if (workerCount == 0 || n <= minChunk || !busy.compare_exchange_strong(idle, true)) {
+        k(0, n, c);
+        return;
+    }
+
+    // A few chunks per thread, so one that got descheduled doesn't hold up the rest
+    kernel = k;
+    context = c;
+    count = n;
+    chunk = std::max(minChunk, n / ((size_t) (workerCount + 1) * 4));
+    next = 0;
+    int helpers = (int) std::min((size_t) workerCount, (n + chunk - 1) / chunk - 1);
+    for (int i = 0; i < helpers; i++) SDL_SemPost(go);
+    runChunks();
+    for (int i = 0; i < helpers; i++) SDL_SemWait(finished);
+
+    busy = false;
+}
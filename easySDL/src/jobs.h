@@ -0,0 +1,59 @@
+
+/** @file
+ * @brief A small pool of worker threads for splitting loops across cores.
+ */
+
+#ifndef EASYSDL_JOBS_H
+#define EASYSDL_JOBS_H
+
+#include <SDL2/SDL.h>
+
+#include <atomic>
+#include <mutex>
+
+/** @class Jobs
+ * @brief parallelFor() over a range of indices, with the calling thread helping out.
+ *
+ * Workers are started the first time they're needed and sleep on a semaphore in between.
+ * Only one loop runs on them at a time: a parallelFor() from another thread while one is
+ * going (say the render thread while the main thread updates particles), or from inside a
+ * kernel, just runs inline.
+ */
+class Jobs {
+public:
+    Jobs() = delete;
+
+    typedef void (*Kernel)(size_t begin, size_t end, void* context);
+
+    static const int maxWorkers = 15;
+
+    /// @brief Calls kernel on pieces of [0, count) at least minChunk long, returns when all are done.
+    static void parallelFor(size_t count, size_t minChunk, Kernel kernel, void* context);
+    static void quit();
+
+    /// @brief Threads a loop can run on, counting the caller.
+    static int get_threadCount();
+
+private:
+    static SDL_Thread* workers[maxWorkers];
+    static int workerCount;
+    static std::atomic<bool> started;
+    static std::mutex startLock;          // Either thread can be the first to need the pool
+    static std::atomic<bool> busy;        // Not a mutex, SDL's are recursive and a nested loop would get in
+    static SDL_sem* go;
+    static SDL_sem* finished;
+    static std::atomic<bool> stopping;
+
+    // The loop being run
+    static Kernel kernel;
+    static void* context;
+    static size_t count;
+    static size_t chunk;
+    static std::atomic<size_t> next;
+
+    static void start();
+    static int worker(void*);
+    static void runChunks();
+};
+
+#endif //EASYSDL_JOBS_H
@@ -0,0 +1,103 @@
+
+/** @file
+ * @brief Software 2D matrix stack implementation.
+ */
+
+#include "matrix2d.h"
+#include "internal.h"
+
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+Affine2D MatrixStack2D::stack[MatrixStack2D::capacity] = {Affine2D::identity()};
+int MatrixStack2D::depth = 0;
+bool MatrixStack2D::isIdentity = true;
+
+Affine2D Affine2D::operator*(const Affine2D& o) const {
+#ifdef __SSE2__
+    // Both result columns at once: [a b c d] = [a b a b]*[o.a o.a o.c o.c] + [c d c d]*[o.b o.b o.d o.d]
+    __m128 cols = _mm_load_ps(&a);
+    __m128 col0 = _mm_shuffle_ps(cols, cols, _MM_SHUFFLE(1, 0, 1, 0));
+    __m128 col1 = _mm_shuffle_ps(cols, cols, _MM_SHUFFLE(3, 2, 3, 2));
+    __m128 lin = _mm_add_ps(_mm_mul_ps(col0, _mm_setr_ps(o.a, o.a, o.c, o.c)),
+                            _mm_mul_ps(col1, _mm_setr_ps(o.b, o.b, o.d, o.d)));
+    Affine2D r;
+    _mm_storeu_ps(&r.a, lin);
+    r.tx = a*o.tx + c*o.ty + tx;
+    r.ty = b*o.tx + d*o.ty + ty;
+    return r;
+#else
+    return {a*o.a + c*o.b,   b*o.a + d*o.b,
+            a*o.c + c*o.d,   b*o.c + d*o.d,
+            a*o.tx + c*o.ty + tx, b*o.tx + d*o.ty + ty};
+#endif
+}
+
+void MatrixStack2D::reset() {
+    depth = 0;
+    stack[0] = Affine2D::identity();
+    isIdentity = true;
+}
+
+void MatrixStack2D::push() {
+    if (depth + 1 >= capacity) {
+        Error("Too many calls to pushMatrix()!");
+        return;
+    }
+    stack[depth + 1] = stack[depth];
+    depth++;
+}
+
+void MatrixStack2D::pop() {
+    if (depth == 0) {
+        Error("Too many calls to popMatrix()!");
+        return;
+    }
+    depth--;
+    // isIdentity stays as is: if the top was untouched identity, so is the one below
+}
+
+void MatrixStack2D::translate(float x, float y) {
+    Affine2D& m = stack[depth];
+    m.tx += m.a*x + m.c*y;
+    m.ty += m.b*x + m.d*y;
+    isIdentity = false;
+}
+
+void MatrixStack2D::rotate(float angle) {
+    float s = sinf(angle), c = cosf(angle);
+    stack[depth] = stack[depth] * Affine2D{c, s, -s, c, 0.0f, 0.0f};
+    isIdentity = false;
+}
+
+void MatrixStack2D::scale(float sx, float sy) {
+    Affine2D& m = stack[depth];
+    m.a *= sx; m.b *= sx;
+    m.c *= sy; m.d *= sy;
+    isIdentity = false;
+}
+
+void MatrixStack2D::transformPoints(const SDL_FPoint* in, SDL_FPoint* out, int count) {
+    if (isIdentity) {
+        if (in != out) for (int i = 0; i < count; i++) out[i] = in[i];
+        return;
+    }
+    const Affine2D& m = stack[depth];
+    int i = 0;
+#ifdef __SSE2__
+    // Two points per register: [x0 y0 x1 y1]
+    const __m128 ab = _mm_setr_ps(m.a, m.b, m.a, m.b);
+    const __m128 cd = _mm_setr_ps(m.c, m.d, m.c, m.d);
+    const __m128 t = _mm_setr_ps(m.tx, m.ty, m.tx, m.ty);
+    for (; i + 2 <= count; i += 2) {
+        __m128 p = _mm_loadu_ps(&in[i].x);
+        __m128 xx = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 yy = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+        _mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(xx, ab), _mm_mul_ps(yy, cd)), t));
+    }
+#endif
+    for (; i < count; i++) out[i] = m.apply(in[i].x, in[i].y);
+}
@@ -0,0 +1,57 @@
+
+/** @file
+ * @brief Software 2D matrix stack for window() (SDL_Renderer) mode.
+ */
+
+#ifndef EASYSDL_MATRIX2D_H
+#define EASYSDL_MATRIX2D_H
+
+#include <SDL2/SDL.h>
+
+/** @brief 2x3 affine matrix.
+ *
+ * Maps (x, y) to (a*x + c*y + tx, b*x + d*y + ty), same layout as the HTML canvas.
+ * Aligned to 16 bytes so both columns are a single SSE load.
+ */
+struct alignas(16) Affine2D {
+    float a, b; // First column
+    float c, d; // Second column
+    float tx, ty;
+
+    static Affine2D identity() { return {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f}; };
+    /// @brief Returns this * other, i.e. other is applied first.
+    Affine2D operator*(const Affine2D& other) const;
+    SDL_FPoint apply(float x, float y) const { return {a*x + c*y + tx, b*x + d*y + ty}; };
+};
+
+/** @class MatrixStack2D
+ * @brief Fixed-size stack of Affine2D, never allocates.
+ *
+ * Reset to identity at the start of every frame, like glLoadIdentity() in 3D mode.
+ */
+class MatrixStack2D {
+public:
+    MatrixStack2D() = delete;
+
+    static const int capacity = 32;
+
+    static void reset();
+    static void push();
+    static void pop();
+    static void translate(float x, float y);
+    static void rotate(float angle);
+    static void scale(float sx, float sy);
+
+    static const Affine2D& get_current() { return stack[depth]; };
+    static bool get_isIdentity() { return isIdentity; };
+
+    /// @brief Transforms count points from in to out with the current matrix. in and out may alias.
+    static void transformPoints(const SDL_FPoint* in, SDL_FPoint* out, int count);
+
+private:
+    static Affine2D stack[capacity];
+    static int depth;
+    static bool isIdentity; // Lets transformPoints() skip all the math
+};
+
+#endif //EASYSDL_MATRIX2D_H
@@ -0,0 +1,73 @@
+
+/** @file
+ * @brief Software 3D matrix stack implementation.
+ */
+
+#include "matrix3d.h"
+#include "internal.h"
+
+mat4 MatrixStack3D::stack[MatrixStack3D::capacity] = {mat4::identity()};
+int MatrixStack3D::depth = 0;
+bool MatrixStack3D::dirty = true;
+int MatrixStack3D::width = 1;
+int MatrixStack3D::height = 1;
+
+void MatrixStack3D::reset(int w, int h) {
+    width = w;
+    height = h;
+    depth = 0;
+    // Translating origin to top left, then pixels to clip space with y flipped
+    stack[0] = mat4::translation(-1.0f, 1.0f, 0.0f);
+    stack[0].scale(2.0f/w, -2.0f/h, 2.0f/w);
+    dirty = true;
+}
+
+void MatrixStack3D::push() {
+    if (depth + 1 >= capacity) {
+        Error("Too many calls to pushMatrix()!");
+        return;
+    }
+    stack[depth + 1] = stack[depth];
+    depth++;
+}
+
+void MatrixStack3D::pop() {
+    if (depth == 0) {
+        Error("Too many calls to popMatrix()!");
+        return;
+    }
+    depth--;
+    dirty = true;
+}
+
+void MatrixStack3D::translate(float x, float y, float z) {
+    stack[depth].translate(x, y, z);
+    dirty = true;
+}
+
+void MatrixStack3D::rotateX(float angle) {
+    stack[depth].rotateX(angle);
+    dirty = true;
+}
+
+void MatrixStack3D::rotateY(float angle) {
+    stack[depth].rotateY(angle);
+    dirty = true;
+}
+
+void MatrixStack3D::rotateZ(float angle) {
+    stack[depth].rotateZ(angle);
+    dirty = true;
+}
+
+void MatrixStack3D::scale(float x, float y, float z) {
+    stack[depth].scale(x, y, z);
+    dirty = true;
+}
+
+void MatrixStack3D::upload() {
+    if (!dirty) return;
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(stack[depth].data());
+    dirty = false;
+}
@@ -0,0 +1,54 @@
+
+/** @file
+ * @brief Software 3D matrix stack for window3d() mode.
+ */
+
+#ifndef EASYSDL_MATRIX3D_H
+#define EASYSDL_MATRIX3D_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include "vecmath.h"
+
+/** @class MatrixStack3D
+ * @brief Fixed-size stack of mat4, the 3D counterpart of MatrixStack2D.
+ *
+ * Replaces the fixed-function glPushMatrix()/glTranslatef()/glRotatef(): the math stays
+ * on the CPU, Batch3D reads the current matrix directly, and the GL modelview matrix is
+ * only loaded (once, if it changed) by upload() before something draws with it.
+ */
+class MatrixStack3D {
+public:
+    MatrixStack3D() = delete;
+
+    static const int capacity = 32;
+
+    /// @brief Back to the base matrix: origin in the top left corner, y down, one unit per pixel.
+    static void reset(int width, int height);
+    static void push();
+    static void pop();
+    static void translate(float x, float y, float z);
+    static void rotateX(float angle);
+    static void rotateY(float angle);
+    static void rotateZ(float angle);
+    static void scale(float x, float y, float z);
+
+    static const mat4& get_current() { return stack[depth]; };
+    /// @brief Window size the base matrix was made for, in pixels.
+    static int get_width() { return width; };
+    static int get_height() { return height; };
+
+    /// @brief Loads the current matrix into GL_MODELVIEW if it changed since the last upload().
+    static void upload();
+    /// @brief Someone else changed GL_MODELVIEW, upload() again next time.
+    static void invalidate() { dirty = true; };
+
+private:
+    static mat4 stack[capacity];
+    static int depth;
+    static bool dirty;
+    static int width, height;
+};
+
+#endif //EASYSDL_MATRIX3D_H
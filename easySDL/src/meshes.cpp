@@ -0,0 +1,119 @@
+
+/** @file
+ * @brief 3D primitive tessellation.
+ */
+
+#include "meshes.h"
+#include "easySDL.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Unit cube faces, as quads
+static const GLfloat cubeQuads[6][4][3] = {
+    {{-0.5f,  0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f}, { 0.5f,  0.5f, -0.5f}, {-0.5f,  0.5f, -0.5f}}, // Top
+    {{ 0.5f, -0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f}, {-0.5f,  0.5f,  0.5f}, {-0.5f, -0.5f,  0.5f}}, // Front
+    {{ 0.5f,  0.5f, -0.5f}, { 0.5f,  0.5f,  0.5f}, { 0.5f, -0.5f,  0.5f}, { 0.5f, -0.5f, -0.5f}}, // Right
+    {{-0.5f, -0.5f,  0.5f}, {-0.5f,  0.5f,  0.5f}, {-0.5f,  0.5f, -0.5f}, {-0.5f, -0.5f, -0.5f}}, // Left
+    {{ 0.5f, -0.5f,  0.5f}, {-0.5f, -0.5f,  0.5f}, {-0.5f, -0.5f, -0.5f}, { 0.5f, -0.5f, -0.5f}}, // Bottom
+    {{ 0.5f,  0.5f, -0.5f}, { 0.5f, -0.5f, -0.5f}, {-0.5f, -0.5f, -0.5f}, {-0.5f,  0.5f, -0.5f}}  // Back
+};
+
+// 12 edges as GL_LINES
+static const GLfloat cubeEdges[24][3] = {
+    {-0.5f,  0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f},   { 0.5f,  0.5f,  0.5f}, { 0.5f, -0.5f,  0.5f},
+    { 0.5f, -0.5f,  0.5f}, {-0.5f, -0.5f,  0.5f},   {-0.5f, -0.5f,  0.5f}, {-0.5f,  0.5f,  0.5f},
+    {-0.5f,  0.5f, -0.5f}, { 0.5f,  0.5f, -0.5f},   { 0.5f,  0.5f, -0.5f}, { 0.5f, -0.5f, -0.5f},
+    { 0.5f, -0.5f, -0.5f}, {-0.5f, -0.5f, -0.5f},   {-0.5f, -0.5f, -0.5f}, {-0.5f,  0.5f, -0.5f},
+    {-0.5f,  0.5f,  0.5f}, {-0.5f,  0.5f, -0.5f},   { 0.5f,  0.5f,  0.5f}, { 0.5f,  0.5f, -0.5f},
+    { 0.5f, -0.5f,  0.5f}, { 0.5f, -0.5f, -0.5f},   {-0.5f, -0.5f,  0.5f}, {-0.5f, -0.5f, -0.5f}
+};
+
+static void vertex(std::vector<GLfloat>& out, const vec3& v) {
+    out.push_back(v.x);
+    out.push_back(v.y);
+    out.push_back(v.z);
+}
+
+MeshData Meshes::build(MeshShape shape, int detail) {
+    MeshData mesh;
+    detail = std::min(std::max(detail, minDetail), maxDetail);
+    switch (shape) {
+        case MESH_BOX: box(mesh); break;
+        case MESH_SPHERE: sphere(mesh, detail); break;
+        case MESH_CYLINDER: cylinder(mesh, detail, false); break;
+        case MESH_CONE: cylinder(mesh, detail, true); break;
+        default: break;
+    }
+    return mesh;
+}
+
+int Meshes::autoDetail(float diameter) {
+    // Aim for edges about 12 pixels long around the circumference
+    int wanted = (int) ceilf(PI*diameter/12.0f);
+    int detail = autoMinDetail;
+    while (detail < wanted && detail < autoMaxDetail) detail *= 2;
+    return detail;
+}
+
+void Meshes::box(MeshData& mesh) {
+    // Triangulate the quads: (a, b, c, d) -> (a, b, c) (a, c, d)
+    const int order[6] = {0, 1, 2, 0, 2, 3};
+    for (const auto& face : cubeQuads)
+        for (int i : order) vertex(mesh.triangles, {face[i][0], face[i][1], face[i][2]});
+    for (const auto& v : cubeEdges) vertex(mesh.lines, {v[0], v[1], v[2]});
+}
+
+void Meshes::sphere(MeshData& mesh, int detail) {
+    int rings = std::max(2, detail/2);
+    // Rings from the top pole (y = 0.5) to the bottom one, detail points around each
+    std::vector<vec3> grid((size_t) (rings + 1) * detail);
+    for (int r = 0; r <= rings; r++) {
+        float phi = PI*r/rings;
+        for (int i = 0; i < detail; i++) {
+            float theta = TWO_PI*i/detail;
+            grid[(size_t) r*detail + i] = vec3(sinf(phi)*cosf(theta), cosf(phi), sinf(phi)*sinf(theta))*0.5f;
+        }
+    }
+    auto at = [&](int r, int i) { return grid[(size_t) r*detail + i%detail]; };
+
+    for (int r = 0; r < rings; r++) {
+        for (int i = 0; i < detail; i++) {
+            vec3 a = at(r, i), b = at(r, i + 1), c = at(r + 1, i + 1), d = at(r + 1, i);
+            if (r > 0) { // At the poles a and b are the same point
+                vertex(mesh.triangles, a); vertex(mesh.triangles, b); vertex(mesh.triangles, c);
+            }
+            if (r < rings - 1) {
+                vertex(mesh.triangles, a); vertex(mesh.triangles, c); vertex(mesh.triangles, d);
+            }
+            // Meridians, and every ring but the poles
+            vertex(mesh.lines, a); vertex(mesh.lines, d);
+            if (r > 0) {
+                vertex(mesh.lines, a); vertex(mesh.lines, b);
+            }
+        }
+    }
+}
+
+void Meshes::cylinder(MeshData& mesh, int detail, bool cone) {
+    // Along y, the cone's tip at -0.5 so it points up on the screen
+    const vec3 top(0.0f, -0.5f, 0.0f), bottom(0.0f, 0.5f, 0.0f);
+    for (int i = 0; i < detail; i++) {
+        float t0 = TWO_PI*i/detail, t1 = TWO_PI*(i + 1)/detail;
+        vec3 b0(0.5f*cosf(t0), 0.5f, 0.5f*sinf(t0)), b1(0.5f*cosf(t1), 0.5f, 0.5f*sinf(t1));
+
+        vertex(mesh.triangles, bottom); vertex(mesh.triangles, b0); vertex(mesh.triangles, b1);
+        vertex(mesh.lines, b0); vertex(mesh.lines, b1);
+        if (cone) {
+            vertex(mesh.triangles, b0); vertex(mesh.triangles, b1); vertex(mesh.triangles, top);
+            vertex(mesh.lines, b0); vertex(mesh.lines, top);
+            continue;
+        }
+        vec3 t0v(b0.x, -0.5f, b0.z), t1v(b1.x, -0.5f, b1.z);
+        vertex(mesh.triangles, top); vertex(mesh.triangles, t1v); vertex(mesh.triangles, t0v);
+        vertex(mesh.triangles, b0); vertex(mesh.triangles, b1); vertex(mesh.triangles, t1v);
+        vertex(mesh.triangles, b0); vertex(mesh.triangles, t1v); vertex(mesh.triangles, t0v);
+        vertex(mesh.lines, t0v); vertex(mesh.lines, t1v);
+        vertex(mesh.lines, b0); vertex(mesh.lines, t0v);
+    }
+}
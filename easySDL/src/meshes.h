@@ -0,0 +1,53 @@
+
+/** @file
+ * @brief Tessellation of the 3D primitives, see Batch3D for how they're drawn.
+ */
+
+#ifndef EASYSDL_MESHES_H
+#define EASYSDL_MESHES_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <vector>
+
+enum MeshShape : Uint8 {
+    MESH_BOX,
+    MESH_SPHERE,
+    MESH_CYLINDER,
+    MESH_CONE,
+    MESH_SHAPE_COUNT
+};
+
+/// @brief Unit sized geometry (fits -0.5..0.5 on every axis), xyz per vertex.
+struct MeshData {
+    std::vector<GLfloat> triangles;
+    std::vector<GLfloat> lines; // Pairs, for the stroke
+};
+
+/** @class Meshes
+ * @brief Builds the vertices of box(), sphere(), cylinder() and cone().
+ *
+ * Curved shapes take a detail, the number of segments around. Building one is all the
+ * sin()/cos() work, Batch3D does it once per shape and detail and keeps the result.
+ */
+class Meshes {
+public:
+    Meshes() = delete;
+
+    static const int minDetail = 3;
+    static const int maxDetail = 128;
+    static const int autoMinDetail = 8;  // Automatic detail never goes lower, spheres would look like boxes
+    static const int autoMaxDetail = 64; // 64 * 32 * 2 = 4096 triangles for a sphere
+
+    static MeshData build(MeshShape shape, int detail);
+    /// @brief Segments for something about diameter pixels across, a power of 2 so there are few meshes.
+    static int autoDetail(float diameter);
+
+private:
+    static void box(MeshData& mesh);
+    static void sphere(MeshData& mesh, int detail);
+    static void cylinder(MeshData& mesh, int detail, bool cone);
+};
+
+#endif //EASYSDL_MESHES_H
@@ -0,0 +1,247 @@
+
+/** @file
+ * @brief Noise implementation.
+ */
+
+#include "noise.h"
+#include "easySDL.h"
+#include "jobs.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+float Noise::table[Noise::tableSize];
+float Noise::blendTable[360];
+bool Noise::seeded = false;
+bool Noise::chosen = false;
+int Noise::octaves = 4;
+float Noise::falloff = 0.5f;
+std::vector<Uint32> Noise::cells;
+std::vector<float> Noise::blends;
+
+// Offsets of one step in y and z in the table, from Processing
+static const int yWrapBits = 4;
+static const int zWrapBits = 8;
+static const Uint32 yWrap = 1 << yWrapBits;
+static const Uint32 zWrap = 1 << zWrapBits;
+static const Uint32 mask = Noise::tableSize - 1;
+
+// Rows per chunk for about this many points, smaller pieces aren't worth a worker
+static const size_t minPoints = 16384;
+
+void Noise::seed(Uint64 s, bool bySketch) {
+    for (float& value : table) value = (float) (Random::splitmix(s) >> 40)*(1.0f/16777216.0f);
+    // 0.5*(1 - cos) over half a turn in half degree steps, like Processing's cosine table
+    for (int i = 0; i < 360; i++) blendTable[i] = 0.5f*(1.0f - (float) cos((double) ((float) i*(PI/180.0f)*0.5f)));
+    seeded = true;
+    if (bySketch) chosen = true;
+}
+
+void Noise::set_detail(int lod, float amplitudeFalloff) {
+    if (lod > 0) octaves = std::min(lod, maxOctaves);
+    if (amplitudeFalloff > 0) falloff = amplitudeFalloff;
+}
+
+// Integer and fraction of |v|, the way Processing splits it
+static inline void split(float v, Uint32& i, float& f) {
+    v = fabsf(v);
+    Sint64 whole = (Sint64) v;
+    i = (Uint32) whole;
+    f = v - (float) whole;
+}
+
+// Next octave: double the coordinate, carry the fraction over
+static inline void twice(Uint32& i, float& f) {
+    i <<= 1;
+    f *= 2.0f;
+    if (f >= 1.0f) {
+        i++;
+        f -= 1.0f;
+    }
+}
+
+float Noise::get(float x, float y, float z) {
+    if (!seeded) seed(SDL_GetPerformanceCounter());
+    Uint32 xi, yi, zi;
+    float xf, yf, zf;
+    split(x, xi, xf);
+    split(y, yi, yf);
+    split(z, zi, zf);
+
+    float r = 0.0f, amplitude = 0.5f;
+    for (int o = 0; o < octaves; o++) {
+        Uint32 of = xi + (yi << yWrapBits) + (zi << zWrapBits);
+        float rxf = blend(xf), ryf = blend(yf);
+        float n1 = table[of & mask];
+        n1 += rxf*(table[(of + 1) & mask] - n1);
+        float n2 = table[(of + yWrap) & mask];
+        n2 += rxf*(table[(of + yWrap + 1) & mask] - n2);
+        n1 += ryf*(n2 - n1);
+        of += zWrap;
+        n2 = table[of & mask];
+        n2 += rxf*(table[(of + 1) & mask] - n2);
+        float n3 = table[(of + yWrap) & mask];
+        n3 += rxf*(table[(of + yWrap + 1) & mask] - n3);
+        n2 += ryf*(n3 - n2);
+        n1 += blend(zf)*(n2 - n1);
+        r += n1*amplitude;
+        amplitude *= falloff;
+        twice(xi, xf);
+        twice(yi, yf);
+        twice(zi, zf);
+    }
+    return r;
+}
+
+void Noise::axis(float start, float step, int count, Uint32* axisCells, float* axisBlends) {
+    for (int i = 0; i < count; i++) {
+        Uint32 cell;
+        float f;
+        split(start + (float) i*step, cell, f);
+        for (int o = 0; o < octaves; o++) {
+            axisCells[o*count + i] = cell;
+            axisBlends[o*count + i] = blend(f);
+            twice(cell, f);
+        }
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128 gather(const float* t, const Uint32* of, Uint32 offset) {
+    return _mm_setr_ps(t[(of[0] + offset) & mask], t[(of[1] + offset) & mask],
+                       t[(of[2] + offset) & mask], t[(of[3] + offset) & mask]);
+}
+
+// a + t*(b - a), in the same order as the scalar code so the results match
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t) {
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+#endif
+
+void Noise::rows2D(size_t begin, size_t end, void* data) {
+    const Field& f = *(const Field*) data;
+    for (size_t row = begin; row < end; row++) {
+        float* out = f.out + row*f.cols;
+        std::fill(out, out + f.cols, 0.0f);
+        float amplitude = 0.5f;
+        for (int o = 0; o < octaves; o++) {
+            // With z = 0 the z blend is 0 and the second plane drops out exactly
+            Uint32 yOffset = f.rowCells[o*f.rows + row] << yWrapBits;
+            float ryf = f.rowBlends[o*f.rows + row];
+            const Uint32* xCells = f.colCells + o*f.cols;
+            const float* xBlends = f.colBlends + o*f.cols;
+            int c = 0;
+#ifdef __SSE2__
+            __m128 ry = _mm_set1_ps(ryf), amp = _mm_set1_ps(amplitude);
+            for (; c + 4 <= f.cols; c += 4) {
+                Uint32 of[4] = {xCells[c] + yOffset, xCells[c + 1] + yOffset, xCells[c + 2] + yOffset, xCells[c + 3] + yOffset};
+                __m128 rx = _mm_loadu_ps(xBlends + c);
+                __m128 n1 = lerp4(gather(table, of, 0), gather(table, of, 1), rx);
+                __m128 n2 = lerp4(gather(table, of, yWrap), gather(table, of, yWrap + 1), rx);
+                n1 = lerp4(n1, n2, ry);
+                _mm_storeu_ps(out + c, _mm_add_ps(_mm_loadu_ps(out + c), _mm_mul_ps(n1, amp)));
+            }
+#endif
+            for (; c < f.cols; c++) {
+                Uint32 of = xCells[c] + yOffset;
+                float rxf = xBlends[c];
+                float n1 = table[of & mask];
+                n1 += rxf*(table[(of + 1) & mask] - n1);
+                float n2 = table[(of + yWrap) & mask];
+                n2 += rxf*(table[(of + yWrap + 1) & mask] - n2);
+                n1 += ryf*(n2 - n1);
+                out[c] += n1*amplitude;
+            }
+            amplitude *= falloff;
+        }
+    }
+}
+
+void Noise::rows3D(size_t begin, size_t end, void* data) {
+    const Field& f = *(const Field*) data;
+    for (size_t index = begin; index < end; index++) {
+        int layer = (int) (index/f.rows), row = (int) (index%f.rows);
+        float* out = f.out + index*f.cols;
+        std::fill(out, out + f.cols, 0.0f);
+        float amplitude = 0.5f;
+        for (int o = 0; o < octaves; o++) {
+            Uint32 yzOffset = (f.rowCells[o*f.rows + row] << yWrapBits) + (f.layerCells[o*f.layers + layer] << zWrapBits);
+            float ryf = f.rowBlends[o*f.rows + row], rzf = f.layerBlends[o*f.layers + layer];
+            const Uint32* xCells = f.colCells + o*f.cols;
+            const float* xBlends = f.colBlends + o*f.cols;
+            int c = 0;
+#ifdef __SSE2__
+            __m128 ry = _mm_set1_ps(ryf), rz = _mm_set1_ps(rzf), amp = _mm_set1_ps(amplitude);
+            for (; c + 4 <= f.cols; c += 4) {
+                Uint32 of[4] = {xCells[c] + yzOffset, xCells[c + 1] + yzOffset, xCells[c + 2] + yzOffset, xCells[c + 3] + yzOffset};
+                __m128 rx = _mm_loadu_ps(xBlends + c);
+                __m128 n1 = lerp4(gather(table, of, 0), gather(table, of, 1), rx);
+                __m128 n2 = lerp4(gather(table, of, yWrap), gather(table, of, yWrap + 1), rx);
+                n1 = lerp4(n1, n2, ry);
+                n2 = lerp4(gather(table, of, zWrap), gather(table, of, zWrap + 1), rx);
+                __m128 n3 = lerp4(gather(table, of, zWrap + yWrap), gather(table, of, zWrap + yWrap + 1), rx);
+                n2 = lerp4(n2, n3, ry);
+                n1 = lerp4(n1, n2, rz);
+                _mm_storeu_ps(out + c, _mm_add_ps(_mm_loadu_ps(out + c), _mm_mul_ps(n1, amp)));
+            }
+#endif
+            for (; c < f.cols; c++) {
+                Uint32 of = xCells[c] + yzOffset;
+                float rxf = xBlends[c];
+                float n1 = table[of & mask];
+                n1 += rxf*(table[(of + 1) & mask] - n1);
+                float n2 = table[(of + yWrap) & mask];
+                n2 += rxf*(table[(of + yWrap + 1) & mask] - n2);
+                n1 += ryf*(n2 - n1);
+                of += zWrap;
+                n2 = table[of & mask];
+                n2 += rxf*(table[(of + 1) & mask] - n2);
+                float n3 = table[(of + yWrap) & mask];
+                n3 += rxf*(table[(of + yWrap + 1) & mask] - n3);
+                n2 += ryf*(n3 - n2);
+                n1 += rzf*(n2 - n1);
+                out[c] += n1*amplitude;
+            }
+            amplitude *= falloff;
+        }
+    }
+}
+
+void Noise::field(float* out, int cols, int rows, float x, float y, float step) {
+    if (!seeded) seed(SDL_GetPerformanceCounter());
+    size_t total = (size_t) (cols + rows)*octaves;
+    if (cells.size() < total) {
+        cells.resize(total);
+        blends.resize(total);
+    }
+    Field f = {out, cols, rows, 1,
+               cells.data(), blends.data(),
+               cells.data() + cols*octaves, blends.data() + cols*octaves,
+               nullptr, nullptr};
+    axis(x, step, cols, cells.data(), blends.data());
+    axis(y, step, rows, cells.data() + cols*octaves, blends.data() + cols*octaves);
+    Jobs::parallelFor((size_t) rows, std::max(minPoints/cols, (size_t) 1), rows2D, &f);
+}
+
+void Noise::field(float* out, int cols, int rows, int layers, float x, float y, float z, float step) {
+    if (!seeded) seed(SDL_GetPerformanceCounter());
+    size_t total = (size_t) (cols + rows + layers)*octaves;
+    if (cells.size() < total) {
+        cells.resize(total);
+        blends.resize(total);
+    }
+    size_t rowStart = (size_t) cols*octaves, layerStart = rowStart + (size_t) rows*octaves;
+    Field f = {out, cols, rows, layers,
+               cells.data(), blends.data(),
+               cells.data() + rowStart, blends.data() + rowStart,
+               cells.data() + layerStart, blends.data() + layerStart};
+    axis(x, step, cols, cells.data(), blends.data());
+    axis(y, step, rows, cells.data() + rowStart, blends.data() + rowStart);
+    axis(z, step, layers, cells.data() + layerStart, blends.data() + layerStart);
+    Jobs::parallelFor((size_t) rows*layers, std::max(minPoints/cols, (size_t) 1), rows3D, &f);
+}
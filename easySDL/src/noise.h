@@ -0,0 +1,66 @@
+
+/** @file
+ * @brief Processing's Perlin noise, one value at a time or a whole grid at once, see noise() in easySDL.h.
+ */
+
+#ifndef EASYSDL_NOISE_H
+#define EASYSDL_NOISE_H
+
+#include <SDL2/SDL.h>
+
+#include <vector>
+
+/** @class Noise
+ * @brief Same algorithm as Processing's noise(): a 4096 value random table, blended with a
+ * quantized cosine curve, octaves summed with falling amplitude.
+ *
+ * The field functions give the same values as calling get() for every point, but work out
+ * the integer and blend part of each column, row and layer only once per octave, then run
+ * the lookups and blends four points at a time with SSE2, rows split across cores by Jobs.
+ */
+class Noise {
+public:
+    Noise() = delete;
+
+    static const int tableSize = 4096;
+    static const int maxOctaves = 16;
+
+    static float get(float x, float y, float z);
+    /// @param bySketch True if the sketch picked the seed with noiseSeed().
+    static void seed(Uint64 seed, bool bySketch = false);
+    /// @brief True once the sketch picked a seed, not for the lazy one or the one of an input log.
+    static bool get_chosen() { return chosen; };
+    static void set_detail(int octaves, float falloff);
+
+    /// @brief out[row*cols + col] = get(x + col*step, y + row*step, 0).
+    static void field(float* out, int cols, int rows, float x, float y, float step);
+    /// @brief out[(layer*rows + row)*cols + col] = get(x + col*step, y + row*step, z + layer*step).
+    static void field(float* out, int cols, int rows, int layers, float x, float y, float z, float step);
+
+private:
+    struct Field {
+        float* out;
+        int cols, rows, layers;
+        const Uint32* colCells; const float* colBlends;     // [octave*cols + col]
+        const Uint32* rowCells; const float* rowBlends;     // [octave*rows + row]
+        const Uint32* layerCells; const float* layerBlends; // [octave*layers + layer]
+    };
+
+    static float table[tableSize];
+    static float blendTable[360];
+    static bool seeded;
+    static bool chosen;
+    static int octaves;
+    static float falloff;
+
+    // Reused between calls, so a field every frame doesn't allocate
+    static std::vector<Uint32> cells;
+    static std::vector<float> blends;
+
+    static float blend(float f) { return blendTable[(int) (f*360.0f)]; };
+    static void axis(float start, float step, int count, Uint32* cells, float* blends);
+    static void rows2D(size_t begin, size_t end, void* field);
+    static void rows3D(size_t begin, size_t end, void* field);
+};
+
+#endif //EASYSDL_NOISE_H
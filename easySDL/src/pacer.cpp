@@ -0,0 +1,83 @@
+
+/** @file
+ * @brief Frame pacing implementation.
+ */
+
+#include "pacer.h"
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define EASYSDL_CPU_RELAX() _mm_pause()
+#else
+#define EASYSDL_CPU_RELAX() do {} while (0)
+#endif
+
+Uint64 FramePacer::frequency = 1;
+Uint64 FramePacer::period = 0;
+Uint64 FramePacer::deadline = 0;
+Uint64 FramePacer::lastTick = 0;
+float FramePacer::targetRate = 0;
+double FramePacer::sleepMean = 0.002; // Pessimistic until measured
+double FramePacer::sleepM2 = 0;
+Uint64 FramePacer::sleepSamples = 1;
+
+void FramePacer::init() {
+    frequency = SDL_GetPerformanceFrequency();
+    set_targetRate(targetRate);
+}
+
+void FramePacer::start() {
+    lastTick = now();
+    deadline = lastTick + period;
+}
+
+void FramePacer::set_targetRate(float fps) {
+    targetRate = fps > 0 ? fps : 0;
+    period = targetRate > 0 ? (Uint64) llround(frequency / (double) targetRate) : 0;
+    deadline = now() + period;
+}
+
+void FramePacer::wait() {
+    if (period == 0) return;
+
+    Uint64 t = now();
+    if (t >= deadline) {
+        // Late by more than a whole frame? Don't try to catch up with a burst of frames
+        deadline = (t - deadline > period) ? t + period : deadline + period;
+        return;
+    }
+
+    // Sleep while the remaining time is safely above what a 1 ms sleep can cost (mean + 2 sigma)
+    while (true) {
+        double remaining = toSeconds(deadline - t);
+        double sleepCost = sleepMean + 2 * sqrt(sleepM2 / sleepSamples);
+        if (remaining <= sleepCost) break;
+
+        SDL_Delay(1);
+        Uint64 after = now();
+        double slept = toSeconds(after - t);
+        t = after;
+
+        if (sleepSamples < 1000) { // Enough to be stable, stop adapting after that
+            sleepSamples++;
+            double d = slept - sleepMean;
+            sleepMean += d / sleepSamples;
+            sleepM2 += d * (slept - sleepMean);
+        }
+        if (t >= deadline) break;
+    }
+
+    // Spin the rest, it's below the sleep granularity
+    while (now() < deadline) EASYSDL_CPU_RELAX();
+
+    deadline += period;
+}
+
+double FramePacer::tick() {
+    Uint64 t = now();
+    double delta = toSeconds(t - lastTick);
+    lastTick = t;
+    return delta;
+}
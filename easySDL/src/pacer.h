@@ -0,0 +1,52 @@
+
+/** @file
+ * @brief High resolution frame pacing on top of SDL_GetPerformanceCounter().
+ */
+
+#ifndef EASYSDL_PACER_H
+#define EASYSDL_PACER_H
+
+#include <SDL2/SDL.h>
+
+/** @class FramePacer
+ * @brief Keeps frames on a fixed schedule with a sleep-then-spin wait.
+ *
+ * Deadlines advance by exactly one period each frame, so rounding never accumulates
+ * (60 FPS is 60 FPS, not 1000/16). The wait sleeps with SDL_Delay(1) while it's safe
+ * and spins on the performance counter for the rest. How long SDL_Delay(1) really takes
+ * is measured as we go, so the spin part stays short on systems with precise sleeps.
+ */
+class FramePacer {
+public:
+    FramePacer() = delete;
+
+    static void init();
+    /// @brief Restarts the schedule from now, call right before the first frame.
+    static void start();
+
+    /// @brief 0 means uncapped.
+    static void set_targetRate(float fps);
+    static float get_targetRate() { return targetRate; };
+
+    /// @brief Waits until the next frame is due. Does nothing if uncapped.
+    static void wait();
+    /// @brief Marks the start of a frame, returns seconds since the previous tick().
+    static double tick();
+
+    static Uint64 now() { return SDL_GetPerformanceCounter(); };
+    static double toSeconds(Uint64 ticks) { return (double) ticks / frequency; };
+
+private:
+    static Uint64 frequency;
+    static Uint64 period; // In performance counter ticks, 0 if uncapped
+    static Uint64 deadline;
+    static Uint64 lastTick;
+    static float targetRate;
+
+    // Running estimate of how long SDL_Delay(1) actually takes (Welford)
+    static double sleepMean;
+    static double sleepM2;
+    static Uint64 sleepSamples;
+};
+
+#endif //EASYSDL_PACER_H
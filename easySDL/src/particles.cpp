@@ -0,0 +1,258 @@
+
+/** @file
+ * @brief Particle system implementation.
+ */
+
+#include "particles.h"
+#include "batch3d.h"
+#include "displaylist.h"
+#include "easySDL.h"
+#include "glstate.h"
+#include "internal.h"
+#include "jobs.h"
+#include "matrix3d.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+Particles::System* Particles::systems[Particles::maxSystems] = {};
+
+// Squared distance added in attractor falloff, so particles passing through one don't shoot off
+static const float softening = 100.0f; // 10 pixels
+
+// Smaller pieces aren't worth waking a worker for
+static const size_t minChunk = 16384;
+
+int Particles::create(int capacity) {
+    if (capacity <= 0) {
+        Warn("particleSystem(): capacity must be positive!");
+        return -1;
+    }
+    int id = 0;
+    while (id < maxSystems && systems[id] != nullptr) id++;
+    if (id == maxSystems) {
+        Error("Too many particle systems!");
+        return -1;
+    }
+
+    System* s = new System();
+    s->capacity = capacity;
+    s->count = 0;
+    for (std::vector<float>* array : {&s->px, &s->py, &s->pz, &s->vx, &s->vy, &s->vz, &s->life})
+        array->resize((size_t) capacity);
+    s->color.resize((size_t) capacity);
+    s->packed[0].resize((size_t) capacity);
+    s->packed[1].resize((size_t) capacity);
+    s->packIndex = 0;
+    s->packFrame = frameCount - 1;
+    s->packValid = false;
+    s->gravity[0] = s->gravity[1] = s->gravity[2] = 0.0f;
+    s->drag = 0.0f;
+    for (Attractor& a : s->attractors) a = {0.0f, 0.0f, 0.0f, 0.0f};
+    s->random = 0x9E3779B9u ^ (Uint32) id;
+    systems[id] = s;
+    return id;
+}
+
+void Particles::quit() {
+    for (System*& s : systems) {
+        delete s;
+        s = nullptr;
+    }
+}
+
+void Particles::emit(int id, const GLfloat position[3], const GLfloat velocity[3], float life, SDL_Color color) {
+    System& s = *systems[id];
+    if (s.count == s.capacity) return;
+    int i = s.count++;
+    s.packValid = false;
+    s.px[i] = position[0]; s.py[i] = position[1]; s.pz[i] = position[2];
+    s.vx[i] = velocity[0]; s.vy[i] = velocity[1]; s.vz[i] = velocity[2];
+    s.life[i] = life;
+    memcpy(&s.color[i], &color, 4);
+}
+
+void Particles::burst(int id, int count, const GLfloat position[3], float speed, float life, SDL_Color color) {
+    System& s = *systems[id];
+    auto next = [&s]() { // xorshift32, [0, 1)
+        s.random ^= s.random << 13;
+        s.random ^= s.random >> 17;
+        s.random ^= s.random << 5;
+        return (float) (s.random >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int n = 0; n < count && s.count < s.capacity; n++) {
+        // Uniform on the sphere: z uniform in [-1, 1], angle uniform around it
+        float z = 2.0f*next() - 1.0f, angle = TWO_PI*next();
+        float r = sqrtf(1.0f - z*z), v = speed*(0.5f + 0.5f*next());
+        GLfloat velocity[3] = {r*cosf(angle)*v, r*sinf(angle)*v, z*v};
+        emit(id, position, velocity, life, color);
+    }
+}
+
+void Particles::set_gravity(int id, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat* g = systems[id]->gravity;
+    g[0] = x; g[1] = y; g[2] = z;
+}
+
+void Particles::set_drag(int id, float drag) {
+    systems[id]->drag = std::min(std::max(drag, 0.0f), 1.0f);
+}
+
+void Particles::set_attractor(int id, int index, GLfloat x, GLfloat y, GLfloat z, float strength) {
+    if (index < 0 || index >= maxAttractors) {
+        Warn("particleAttractor(): index must be 0 to " + std::to_string(maxAttractors - 1) + "!");
+        return;
+    }
+    systems[id]->attractors[index] = {x, y, z, strength};
+}
+
+void Particles::integrate(size_t begin, size_t end, void* data) {
+    const Step& step = *(const Step*) data;
+    System& s = *step.system;
+    float* px = s.px.data(); float* py = s.py.data(); float* pz = s.pz.data();
+    float* vx = s.vx.data(); float* vy = s.vy.data(); float* vz = s.vz.data();
+    float* life = s.life.data();
+    const float dt = step.dt;
+    const float gx = s.gravity[0]*dt, gy = s.gravity[1]*dt, gz = s.gravity[2]*dt;
+
+    size_t i = begin;
+#ifdef __SSE2__
+    const __m128 dt4 = _mm_set1_ps(dt), damping4 = _mm_set1_ps(step.damping);
+    const __m128 gx4 = _mm_set1_ps(gx), gy4 = _mm_set1_ps(gy), gz4 = _mm_set1_ps(gz);
+    const __m128 soft4 = _mm_set1_ps(softening);
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i), z = _mm_loadu_ps(pz + i);
+        __m128 ux = _mm_add_ps(_mm_loadu_ps(vx + i), gx4);
+        __m128 uy = _mm_add_ps(_mm_loadu_ps(vy + i), gy4);
+        __m128 uz = _mm_add_ps(_mm_loadu_ps(vz + i), gz4);
+        for (int a = 0; a < step.attractorCount; a++) {
+            const Attractor& at = step.attractors[a];
+            // Inverse square: d / |d|^3, softened
+            __m128 dx = _mm_sub_ps(_mm_set1_ps(at.x), x);
+            __m128 dy = _mm_sub_ps(_mm_set1_ps(at.y), y);
+            __m128 dz = _mm_sub_ps(_mm_set1_ps(at.z), z);
+            __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_add_ps(_mm_mul_ps(dz, dz), soft4));
+            __m128 k = _mm_div_ps(_mm_set1_ps(at.strength*dt), _mm_mul_ps(r2, _mm_sqrt_ps(r2)));
+            ux = _mm_add_ps(ux, _mm_mul_ps(dx, k));
+            uy = _mm_add_ps(uy, _mm_mul_ps(dy, k));
+            uz = _mm_add_ps(uz, _mm_mul_ps(dz, k));
+        }
+        ux = _mm_mul_ps(ux, damping4);
+        uy = _mm_mul_ps(uy, damping4);
+        uz = _mm_mul_ps(uz, damping4);
+        _mm_storeu_ps(vx + i, ux);
+        _mm_storeu_ps(vy + i, uy);
+        _mm_storeu_ps(vz + i, uz);
+        _mm_storeu_ps(px + i, _mm_add_ps(x, _mm_mul_ps(ux, dt4)));
+        _mm_storeu_ps(py + i, _mm_add_ps(y, _mm_mul_ps(uy, dt4)));
+        _mm_storeu_ps(pz + i, _mm_add_ps(z, _mm_mul_ps(uz, dt4)));
+        _mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), dt4));
+    }
+#endif
+    for (; i < end; i++) {
+        float ux = vx[i] + gx, uy = vy[i] + gy, uz = vz[i] + gz;
+        for (int a = 0; a < step.attractorCount; a++) {
+            const Attractor& at = step.attractors[a];
+            float dx = at.x - px[i], dy = at.y - py[i], dz = at.z - pz[i];
+            float r2 = dx*dx + dy*dy + dz*dz + softening;
+            float k = at.strength*dt / (r2*sqrtf(r2));
+            ux += dx*k; uy += dy*k; uz += dz*k;
+        }
+        vx[i] = ux*step.damping; vy[i] = uy*step.damping; vz[i] = uz*step.damping;
+        px[i] += vx[i]*dt; py[i] += vy[i]*dt; pz[i] += vz[i]*dt;
+        life[i] -= dt;
+    }
+}
+
+void Particles::update(int id, float dt) {
+    System& s = *systems[id];
+    if (s.count == 0 || dt <= 0.0f) return;
+
+    Step step;
+    step.system = &s;
+    step.dt = dt;
+    step.damping = powf(1.0f - s.drag, dt);
+    step.attractorCount = 0;
+    for (const Attractor& a : s.attractors)
+        if (a.strength != 0.0f) step.attractors[step.attractorCount++] = a;
+    Jobs::parallelFor((size_t) s.count, minChunk, integrate, &step);
+    s.packValid = false;
+
+    // Move the last live particle into every hole, live ones stay packed at the front
+    int i = 0;
+    while (i < s.count) {
+        if (s.life[i] > 0.0f) {
+            i++;
+            continue;
+        }
+        int last = --s.count;
+        s.px[i] = s.px[last]; s.py[i] = s.py[last]; s.pz[i] = s.pz[last];
+        s.vx[i] = s.vx[last]; s.vy[i] = s.vy[last]; s.vz[i] = s.vz[last];
+        s.life[i] = s.life[last];
+        s.color[i] = s.color[last];
+    }
+    FrameSkipper::invalidate(); // The draw command looks the same, what it draws doesn't
+}
+
+void Particles::packRange(size_t begin, size_t end, void* data) {
+    System& s = *(System*) data;
+    const float* px = s.px.data(); const float* py = s.py.data(); const float* pz = s.pz.data();
+    const Uint32* color = s.color.data();
+    PackedParticle* out = s.packed[s.packIndex].data();
+
+    size_t i = begin;
+#ifdef __SSE2__
+    // Four x, four y, four z and four colors in, four particles out
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i), z = _mm_loadu_ps(pz + i);
+        __m128 c = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*) (color + i)));
+        _MM_TRANSPOSE4_PS(x, y, z, c);
+        _mm_storeu_ps(&out[i].x, x);
+        _mm_storeu_ps(&out[i + 1].x, y);
+        _mm_storeu_ps(&out[i + 2].x, z);
+        _mm_storeu_ps(&out[i + 3].x, c);
+    }
+#endif
+    for (; i < end; i++) {
+        out[i].x = px[i]; out[i].y = py[i]; out[i].z = pz[i];
+        memcpy(&out[i].color, &color[i], 4);
+    }
+}
+
+int Particles::pack(int id) {
+    System& s = *systems[id];
+    if (s.packFrame != frameCount) {
+        // The other buffer, the render thread may still draw last frame's
+        s.packFrame = frameCount;
+        s.packIndex = 1 - s.packIndex;
+        s.packValid = false;
+    }
+    if (!s.packValid) Jobs::parallelFor((size_t) s.count, minChunk, packRange, &s);
+    s.packValid = true;
+    return s.packIndex;
+}
+
+void Particles::draw(int id, int buffer, int count, float size) {
+    if (!valid(id) || count <= 0) return;
+    const PackedParticle* p = systems[id]->packed[buffer].data();
+
+    Batch3D::flush(); // Whatever was queued before is drawn before, like with immediate drawing
+    MatrixStack3D::upload();
+    GLState::useProgram(0);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+    GLState::set_enabled(GL_TEXTURE_2D, false);
+    GLState::set_clientState(GL_TEXTURE_COORD_ARRAY, false);
+    GLState::set_clientState(GL_VERTEX_ARRAY, true);
+    GLState::set_clientState(GL_COLOR_ARRAY, true);
+    glPointSize(size);
+    glVertexPointer(3, GL_FLOAT, sizeof(PackedParticle), &p[0].x);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(PackedParticle), &p[0].color);
+    glDrawArrays(GL_POINTS, 0, count);
+    GLState::invalidateColor();
+    GLState::set_clientState(GL_VERTEX_ARRAY, false); // Aliases generic attribute 0 for Batch3D
+}
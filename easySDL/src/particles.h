@@ -0,0 +1,98 @@
+
+/** @file
+ * @brief Particle systems, see particleSystem() in easySDL.h.
+ */
+
+#ifndef EASYSDL_PARTICLES_H
+#define EASYSDL_PARTICLES_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <vector>
+
+/// @brief One particle as it's drawn, 16 bytes so four of them are one SSE transpose.
+struct PackedParticle {
+    GLfloat x, y, z;
+    SDL_Color color;
+};
+
+/** @class Particles
+ * @brief Structure of arrays storage, SIMD update across the Jobs workers and GL_POINTS drawing.
+ *
+ * Every system allocates its arrays once, in create(). Live particles are kept packed at
+ * the front: when one dies the last one is moved into its place, so the update loop never
+ * has holes to skip and emitting is just appending.
+ *
+ * pack() copies positions and colors into one of two PackedParticle buffers, which are
+ * what draw() hands to GL. Two, so the render thread in threadedMode() can draw the
+ * previous frame's while the main thread fills the other one. The buffers switch once per
+ * frame, more draws of a system in the same frame share its buffer.
+ */
+class Particles {
+public:
+    Particles() = delete;
+
+    static const int maxSystems = 64;
+    static const int maxAttractors = 8;
+
+    static int create(int capacity);
+    static void quit();
+    static bool valid(int id) { return id >= 0 && id < maxSystems && systems[id] != nullptr; };
+
+    /// @brief Adds a particle, does nothing if the system is full.
+    static void emit(int id, const GLfloat position[3], const GLfloat velocity[3], float life, SDL_Color color);
+    /// @brief Adds count particles at a point, flying off in random directions.
+    static void burst(int id, int count, const GLfloat position[3], float speed, float life, SDL_Color color);
+
+    static void set_gravity(int id, GLfloat x, GLfloat y, GLfloat z);
+    static void set_drag(int id, float drag);
+    static void set_attractor(int id, int index, GLfloat x, GLfloat y, GLfloat z, float strength);
+
+    /// @brief Moves every particle dt seconds forward and removes the dead ones.
+    static void update(int id, float dt);
+    /// @brief Fills this frame's draw buffer, returns its index. Reused as is if nothing changed since.
+    static int pack(int id);
+    /// @brief Draws count particles from a packed buffer as size pixel points, on the thread that draws.
+    static void draw(int id, int buffer, int count, float size);
+
+    static int get_count(int id) { return systems[id]->count; };
+
+private:
+    struct Attractor {
+        GLfloat x, y, z;
+        float strength; // 0 if unused
+    };
+
+    struct System {
+        int capacity;
+        int count;
+        std::vector<float> px, py, pz;
+        std::vector<float> vx, vy, vz;
+        std::vector<float> life;
+        std::vector<Uint32> color;
+        GLfloat gravity[3];
+        float drag; // Fraction of the velocity lost per second
+        Attractor attractors[maxAttractors];
+        std::vector<PackedParticle> packed[2];
+        int packIndex;
+        Uint32 packFrame;   // frameCount when packIndex was last switched
+        bool packValid;     // packed[packIndex] matches the particles
+        Uint32 random; // xorshift32 state for burst()
+    };
+
+    struct Step {
+        System* system;
+        float dt;
+        float damping;
+        Attractor attractors[maxAttractors];
+        int attractorCount;
+    };
+
+    static System* systems[maxSystems];
+
+    static void integrate(size_t begin, size_t end, void* step);
+    static void packRange(size_t begin, size_t end, void* system);
+};
+
+#endif //EASYSDL_PARTICLES_H
@@ -0,0 +1,258 @@
+
+/** @file
+ * @brief Picking implementation.
+ */
+
+#include "picking.h"
+#include "easySDL.h"
+#include "internal.h"
+#include "matrix2d.h"
+#include "matrix3d.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+SDL_mutex* Picking::mutex = nullptr;
+std::vector<Picking::Entry> Picking::building;
+std::vector<Picking::Entry> Picking::published;
+bool Picking::dirty = false;
+float Picking::originX = 0.0f;
+float Picking::originY = 0.0f;
+float Picking::cellSize = 1.0f;
+int Picking::cellsX = 0;
+int Picking::cellsY = 0;
+std::vector<int> Picking::cellStart;
+std::vector<int> Picking::cellObjects;
+std::vector<int> Picking::objectCells;
+std::vector<int> Picking::large;
+float Picking::reach = 0.0f;
+std::vector<Picking::Hit> Picking::hits;
+
+void Picking::init() {
+    mutex = SDL_CreateMutex();
+    if (mutex == nullptr) ErrorSDL("Failed to create the picking mutex!");
+}
+
+void Picking::quit() {
+    if (mutex != nullptr) SDL_DestroyMutex(mutex);
+    mutex = nullptr;
+    building.clear();
+    published.clear();
+    cellStart.clear();
+    cellObjects.clear();
+    objectCells.clear();
+    large.clear();
+    cellsX = cellsY = 0;
+    dirty = false;
+}
+
+void Picking::add(int id, float x0, float y0, float x1, float y1, float depth) {
+    building.push_back({std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1), depth, id});
+}
+
+void Picking::addRect(int id, GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
+    if (!easySDL::get_mode3d()) {
+        SDL_FPoint corners[4] = {{x, y}, {x + w, y}, {x, y + h}, {x + w, y + h}};
+        MatrixStack2D::transformPoints(corners, corners, 4);
+        float x0 = corners[0].x, y0 = corners[0].y, x1 = x0, y1 = y0;
+        for (int i = 1; i < 4; i++) {
+            x0 = std::min(x0, corners[i].x); x1 = std::max(x1, corners[i].x);
+            y0 = std::min(y0, corners[i].y); y1 = std::max(y1, corners[i].y);
+        }
+        add(id, x0, y0, x1, y1, 0.0f);
+        return;
+    }
+
+    // A flat box: center and half axes in clip space, then to pixels
+    const mat4& m = MatrixStack3D::get_current();
+    vec3 center = m.transformPoint({x + w/2, y + h/2, 0.0f});
+    vec4 ax = m.column(0)*(w/2), ay = m.column(1)*(h/2);
+    float ex = fabsf(ax.x) + fabsf(ay.x), ey = fabsf(ax.y) + fabsf(ay.y), ez = fabsf(ax.z) + fabsf(ay.z);
+    float halfW = MatrixStack3D::get_width()/2.0f, halfH = MatrixStack3D::get_height()/2.0f;
+    float sx = (center.x + 1.0f)*halfW, sy = (1.0f - center.y)*halfH;
+    add(id, sx - ex*halfW, sy - ey*halfH, sx + ex*halfW, sy + ey*halfH, center.z - ez);
+}
+
+void Picking::addBox(int id, GLfloat w, GLfloat h, GLfloat d) {
+    const mat4& m = MatrixStack3D::get_current();
+    vec4 center = m.column(3);
+    vec4 axes[3] = {m.column(0)*(w/2), m.column(1)*(h/2), m.column(2)*(d/2)};
+    float ex = 0.0f, ey = 0.0f, ez = 0.0f;
+    for (const vec4& a : axes) {
+        ex += fabsf(a.x);
+        ey += fabsf(a.y);
+        ez += fabsf(a.z);
+    }
+    float halfW = MatrixStack3D::get_width()/2.0f, halfH = MatrixStack3D::get_height()/2.0f;
+    float sx = (center.x + 1.0f)*halfW, sy = (1.0f - center.y)*halfH;
+    add(id, sx - ex*halfW, sy - ey*halfH, sx + ex*halfW, sy + ey*halfH, center.z - ez);
+}
+
+void Picking::endFrame() {
+    if (mutex != nullptr) SDL_LockMutex(mutex);
+    // A steady scene registers the same objects every frame, the grid stays valid then
+    bool same = building.size() == published.size() &&
+                (building.empty() || memcmp(building.data(), published.data(), building.size()*sizeof(Entry)) == 0);
+    if (!same) {
+        building.swap(published);
+        dirty = true;
+    }
+    if (mutex != nullptr) SDL_UnlockMutex(mutex);
+    building.clear();
+}
+
+void Picking::cellRange(float x0, float y0, float x1, float y1, int& cx0, int& cy0, int& cx1, int& cy1) {
+    float inverse = 1.0f/cellSize;
+    cx0 = std::min(std::max((int) floorf((x0 - originX)*inverse), 0), cellsX - 1);
+    cy0 = std::min(std::max((int) floorf((y0 - originY)*inverse), 0), cellsY - 1);
+    cx1 = std::min(std::max((int) floorf((x1 - originX)*inverse), 0), cellsX - 1);
+    cy1 = std::min(std::max((int) floorf((y1 - originY)*inverse), 0), cellsY - 1);
+}
+
+void Picking::build() {
+    dirty = false;
+    large.clear();
+    if (published.empty()) {
+        cellsX = cellsY = 0;
+        return;
+    }
+
+    float x0 = published[0].x0, y0 = published[0].y0, x1 = published[0].x1, y1 = published[0].y1;
+    double extents = 0.0;
+    for (const Entry& e : published) {
+        x0 = std::min(x0, e.x0); y0 = std::min(y0, e.y0);
+        x1 = std::max(x1, e.x1); y1 = std::max(y1, e.y1);
+        extents += (double) (e.x1 - e.x0) + (double) (e.y1 - e.y0);
+    }
+    // About one object per cell, but cells no smaller than a typical object, within maxCells
+    float w = std::max(x1 - x0, 1.0f), h = std::max(y1 - y0, 1.0f);
+    float typical = (float) (extents/(2.0*(double) published.size()));
+    originX = x0;
+    originY = y0;
+    cellSize = std::max(std::max(sqrtf(w*h/(float) published.size()), std::min(typical, std::max(w, h))), 1.0f);
+    while (true) {
+        cellsX = (int) (w/cellSize) + 1;
+        cellsY = (int) (h/cellSize) + 1;
+        if (cellsX*cellsY <= maxCells) break;
+        cellSize *= 1.25f;
+    }
+
+    // Each object goes in the cell of its center, counting sort by cell: count into
+    // cellStart[cell + 1], prefix sum, then fill while advancing the starts
+    int cells = cellsX*cellsY;
+    float inverse = 1.0f/cellSize, limit = maxReach*cellSize;
+    reach = 0.0f;
+    cellStart.assign((size_t) cells + 1, 0);
+    objectCells.resize(published.size());
+    for (int i = 0; i < (int) published.size(); i++) {
+        const Entry& e = published[i];
+        float halfW = (e.x1 - e.x0)*0.5f, halfH = (e.y1 - e.y0)*0.5f;
+        if (!(halfW <= limit && halfH <= limit)) { // NaN bounds end up here too
+            objectCells[i] = -1;
+            large.push_back(i);
+            continue;
+        }
+        reach = std::max(reach, std::max(halfW, halfH));
+        int cx = std::min((int) ((e.x0 + halfW - originX)*inverse), cellsX - 1);
+        int cy = std::min((int) ((e.y0 + halfH - originY)*inverse), cellsY - 1);
+        objectCells[i] = cy*cellsX + cx;
+        cellStart[objectCells[i] + 1]++;
+    }
+    for (int c = 0; c < cells; c++) cellStart[c + 1] += cellStart[c];
+    cellObjects.resize((size_t) cellStart[cells]);
+    for (int i = 0; i < (int) published.size(); i++)
+        if (objectCells[i] >= 0) cellObjects[cellStart[objectCells[i]]++] = i;
+    for (int c = cells; c > 0; c--) cellStart[c] = cellStart[c - 1];
+    cellStart[0] = 0;
+}
+
+template<typename Test>
+void Picking::collect(float x0, float y0, float x1, float y1, Test test) {
+    if (dirty) build();
+    hits.clear();
+
+    // Objects stick out of their cell by up to reach, look that much further
+    x0 -= reach; y0 -= reach;
+    x1 += reach; y1 += reach;
+    if (cellsX > 0 && x1 >= originX && y1 >= originY &&
+        x0 <= originX + (float) cellsX*cellSize && y0 <= originY + (float) cellsY*cellSize) {
+        int cx0, cy0, cx1, cy1;
+        cellRange(x0, y0, x1, y1, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; cy++) {
+            int first = cellStart[cy*cellsX + cx0], last = cellStart[cy*cellsX + cx1 + 1];
+            for (int k = first; k < last; k++) test(cellObjects[k]); // A row of cells is contiguous
+        }
+    }
+    for (int i : large) test(i);
+}
+
+int Picking::sortHits(int* ids, int maxIds) {
+    std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) {
+        return a.key != b.key ? a.key < b.key : a.order > b.order;
+    });
+    int count = std::min((int) hits.size(), maxIds);
+    for (int i = 0; i < count; i++) ids[i] = hits[i].id;
+    return count;
+}
+
+int Picking::pick(float x, float y) {
+    if (mutex != nullptr) SDL_LockMutex(mutex);
+    collect(x, y, x, y, [x, y](int i) {
+        const Entry& e = published[i];
+        if (x >= e.x0 && x <= e.x1 && y >= e.y0 && y <= e.y1) hits.push_back({e.depth, i, e.id});
+    });
+    int id = -1;
+    const Hit* best = nullptr;
+    for (const Hit& h : hits)
+        if (best == nullptr || h.key < best->key || (h.key == best->key && h.order > best->order)) best = &h;
+    if (best != nullptr) id = best->id;
+    if (mutex != nullptr) SDL_UnlockMutex(mutex);
+    return id;
+}
+
+int Picking::pickAll(float x, float y, int* ids, int maxIds) {
+    if (mutex != nullptr) SDL_LockMutex(mutex);
+    collect(x, y, x, y, [x, y](int i) {
+        const Entry& e = published[i];
+        if (x >= e.x0 && x <= e.x1 && y >= e.y0 && y <= e.y1) hits.push_back({e.depth, i, e.id});
+    });
+    int count = sortHits(ids, maxIds);
+    if (mutex != nullptr) SDL_UnlockMutex(mutex);
+    return count;
+}
+
+int Picking::pickRect(float x, float y, float w, float h, int* ids, int maxIds) {
+    float x0 = std::min(x, x + w), y0 = std::min(y, y + h), x1 = std::max(x, x + w), y1 = std::max(y, y + h);
+    if (mutex != nullptr) SDL_LockMutex(mutex);
+    collect(x0, y0, x1, y1, [x0, y0, x1, y1](int i) {
+        const Entry& e = published[i];
+        if (e.x0 <= x1 && e.x1 >= x0 && e.y0 <= y1 && e.y1 >= y0) hits.push_back({e.depth, i, e.id});
+    });
+    int count = sortHits(ids, maxIds);
+    if (mutex != nullptr) SDL_UnlockMutex(mutex);
+    return count;
+}
+
+int Picking::pickRadius(float x, float y, float radius, int* ids, int maxIds) {
+    float r2 = radius*radius;
+    if (mutex != nullptr) SDL_LockMutex(mutex);
+    collect(x - radius, y - radius, x + radius, y + radius, [x, y, r2](int i) {
+        const Entry& e = published[i];
+        // Distance to the closest point of the bounds, 0 inside
+        float dx = std::max(std::max(e.x0 - x, x - e.x1), 0.0f);
+        float dy = std::max(std::max(e.y0 - y, y - e.y1), 0.0f);
+        float d2 = dx*dx + dy*dy;
+        if (d2 <= r2) hits.push_back({d2, i, e.id});
+    });
+    int count = sortHits(ids, maxIds);
+    if (mutex != nullptr) SDL_UnlockMutex(mutex);
+    return count;
+}
+
+int Picking::get_count() {
+    if (mutex != nullptr) SDL_LockMutex(mutex);
+    int count = (int) published.size();
+    if (mutex != nullptr) SDL_UnlockMutex(mutex);
+    return count;
+}
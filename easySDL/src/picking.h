@@ -0,0 +1,90 @@
+
+/** @file
+ * @brief Screen space index of pickable objects, see pickable() in easySDL.h.
+ */
+
+#ifndef EASYSDL_PICKING_H
+#define EASYSDL_PICKING_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <vector>
+
+/** @class Picking
+ * @brief Bounds of the objects drawn last frame, in window pixels, bucketed into a uniform grid.
+ *
+ * add() runs wherever drawing happens (the render thread with threadedMode(), or when a
+ * recorded frame or display list is replayed), so bounds go through the same matrix as
+ * what they belong to. endFrame() publishes the frame's objects, queries on the main thread
+ * see the last published frame, which is the one on screen.
+ *
+ * The grid is loose: every object is in the one cell its center is in, so building it is a
+ * counting sort into one flat array, and queries look as far around them as the biggest
+ * object reaches. It's built on the first query after a publish, and if a frame registers
+ * exactly the same objects as the previous one, the old grid is kept as it is.
+ */
+class Picking {
+public:
+    Picking() = delete;
+
+    static const int maxCells = 1 << 16;
+    static const int maxReach = 4; // In cells from the center, bigger objects go to a list every query checks
+
+    static void init();
+    static void quit();
+
+    /// @brief Rectangle like rect(), in the current matrix.
+    static void addRect(int id, GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+    /// @brief Box like box(), centered on the current matrix. 3D mode only.
+    static void addBox(int id, GLfloat w, GLfloat h, GLfloat d);
+    /// @brief Publishes what was added since the last call. Once per drawn frame, on the drawing thread.
+    static void endFrame();
+
+    /// @brief Front-most object containing the point, -1 if none.
+    static int pick(float x, float y);
+    /// @brief Objects containing the point, front to back. Returns how many were written to ids.
+    static int pickAll(float x, float y, int* ids, int maxIds);
+    /// @brief Objects overlapping the rectangle, front to back.
+    static int pickRect(float x, float y, float w, float h, int* ids, int maxIds);
+    /// @brief Objects within radius of the point, nearest first.
+    static int pickRadius(float x, float y, float radius, int* ids, int maxIds);
+
+    static int get_count();
+
+private:
+    struct Entry {
+        float x0, y0, x1, y1; // Window pixels
+        float depth;          // Clip space z, smaller is in front. 0 in 2D
+        int id;
+    };
+
+    struct Hit {
+        float key; // Sorted ascending
+        int order; // Later added wins ties, it's drawn on top
+        int id;
+    };
+
+    static SDL_mutex* mutex;
+    static std::vector<Entry> building;  // Drawing thread
+    static std::vector<Entry> published; // Under mutex
+    static bool dirty;                   // Published changed since the grid was built
+
+    // The grid, CSR style: objects of cell i are cellObjects[cellStart[i]..cellStart[i + 1]]
+    static float originX, originY, cellSize;
+    static int cellsX, cellsY;
+    static std::vector<int> cellStart;
+    static std::vector<int> cellObjects;
+    static std::vector<int> objectCells; // Cell of every object, -1 for large ones
+    static std::vector<int> large;
+    static float reach; // Half size of the biggest object in the grid
+    static std::vector<Hit> hits;
+
+    static void add(int id, float x0, float y0, float x1, float y1, float depth);
+    static void build();
+    static void cellRange(float x0, float y0, float x1, float y1, int& cx0, int& cy0, int& cx1, int& cy1);
+    template<typename Test> static void collect(float x0, float y0, float x1, float y1, Test test);
+    static int sortHits(int* ids, int maxIds);
+};
+
+#endif //EASYSDL_PICKING_H
@@ -0,0 +1,229 @@
+
+/** @file
+ * @brief Pixels implementation.
+ */
+
+#include "pixels.h"
+#include "batch2d.h"
+#include "batch3d.h"
+#include "easySDL.h"
+#include "glext.h"
+#include "glstate.h"
+#include "internal.h"
+#include "matrix3d.h"
+
+#include <algorithm>
+#include <cstring>
+
+SDL_Renderer* Pixels::renderer = nullptr;
+bool Pixels::mode3d = false;
+int Pixels::width = 0;
+int Pixels::height = 0;
+Pixels::Storage Pixels::storage = Pixels::STORAGE_NONE;
+Uint32* Pixels::data = nullptr;
+std::vector<Uint32> Pixels::memory;
+SDL_Texture* Pixels::texture = nullptr;
+bool Pixels::locked = false;
+GLuint Pixels::glTexture = 0;
+GLuint Pixels::buffer = 0;
+GLsync Pixels::fence = nullptr;
+std::atomic<int> Pixels::pending(0);
+SDL_sem* Pixels::uploaded = nullptr;
+
+// The software renderer draws straight from a streaming texture's memory, locking hands it out
+static const char* sharingRenderer = "software";
+
+void Pixels::init(SDL_Renderer* r, bool m3d) {
+    renderer = r;
+    mode3d = m3d;
+    uploaded = SDL_CreateSemaphore(0);
+    if (uploaded == nullptr) ErrorSDL("Failed to create the pixels semaphore!");
+}
+
+void Pixels::quit() {
+    if (storage == STORAGE_MAPPED) {
+        if (fence != nullptr) GLExt::DeleteSync(fence);
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        GLExt::UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLExt::DeleteBuffers(1, &buffer);
+    }
+    if (glTexture != 0) {
+        GLState::forgetTexture(glTexture);
+        glDeleteTextures(1, &glTexture);
+    }
+    if (locked) SDL_UnlockTexture(texture);
+    locked = false;
+    if (texture != nullptr) SDL_DestroyTexture(texture);
+    if (uploaded != nullptr) SDL_DestroySemaphore(uploaded);
+    uploaded = nullptr;
+    texture = nullptr;
+    glTexture = buffer = 0;
+    fence = nullptr;
+    data = nullptr;
+    memory.clear();
+    storage = STORAGE_NONE;
+    pending = 0;
+}
+
+void Pixels::createGLTexture() {
+    glGenTextures(1, &glTexture);
+    GLState::bindTexture(glTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // BGRA with the reversed packing is ARGB8888 as a Uint32 on any endianness, the fast path for most drivers
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+}
+
+void Pixels::create() {
+    width = (int) ::width;
+    height = (int) ::height;
+    size_t bytes = (size_t) width*height*4;
+
+    if (!mode3d) {
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (texture == nullptr) {
+            ErrorSDL("Failed to create the pixels texture!");
+            return;
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        SDL_RendererInfo info;
+        void* memory;
+        int pitch;
+        bool shares = SDL_GetRendererInfo(renderer, &info) == 0 && strcmp(info.name, sharingRenderer) == 0;
+        if (shares && SDL_LockTexture(texture, nullptr, &memory, &pitch) == 0) {
+            if (pitch == width*4) storage = STORAGE_TEXTURE; // acquire() locks it again for the pointer
+            memset(memory, 0, (size_t) pitch*height);
+            SDL_UnlockTexture(texture);
+        }
+    } else if (!easySDL::get_threaded() && GLExt::loadStorage()) {
+        // Readable too, sketches read their last frame back. Client storage asks for cached memory
+        createGLTexture();
+        GLExt::GenBuffers(1, &buffer);
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLExt::BufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) bytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        data = (Uint32*) GLExt::MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) bytes, flags);
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (data != nullptr) {
+            memset(data, 0, bytes);
+            storage = STORAGE_MAPPED;
+        } else {
+            Warn("Failed to map the pixel buffer, pixels[] goes through memory instead!");
+            GLExt::DeleteBuffers(1, &buffer);
+            buffer = 0;
+        }
+    }
+
+    if (storage == STORAGE_NONE) {
+        memory.assign((size_t) width*height, 0);
+        data = memory.data();
+        storage = STORAGE_MEMORY;
+    }
+}
+
+Uint32* Pixels::load() {
+    // With threadedMode() the render thread may still be uploading the last frame from here
+    while (pending > 0) SDL_SemWait(uploaded);
+    return acquire();
+}
+
+Uint32* Pixels::acquire() {
+    if (storage == STORAGE_NONE) create();
+    if (storage == STORAGE_TEXTURE && !locked) {
+        // SDL only promises the pointer until the unlock, so it's fetched again every time
+        void* memory;
+        int pitch;
+        if (SDL_LockTexture(texture, nullptr, &memory, &pitch) == 0) {
+            data = (Uint32*) memory;
+            locked = true;
+        } else {
+            ErrorSDL("Failed to lock the pixels texture!");
+            return nullptr;
+        }
+    }
+    if (fence != nullptr) { // Usually long signaled, the upload was queued a frame ago
+        GLExt::ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        GLExt::DeleteSync(fence);
+        fence = nullptr;
+    }
+    return data;
+}
+
+void Pixels::upload(int x, int y, int w, int h) {
+    if (!mode3d) {
+        if (storage == STORAGE_TEXTURE) {
+            // The renderer draws from this memory, unlocking is all it takes
+            if (locked) SDL_UnlockTexture(texture);
+            locked = false;
+        } else {
+            SDL_Rect area = {x, y, w, h};
+            SDL_UpdateTexture(texture, &area, data + (size_t) y*width + x, width*4);
+        }
+        return;
+    }
+
+    GLState::bindTexture(glTexture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width); // Rows of the area are width pixels apart
+    if (storage == STORAGE_MAPPED) {
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                        (const void*) (((size_t) y*width + x)*4));
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // Other uploads come from client memory
+        if (fence != nullptr) GLExt::DeleteSync(fence);
+        fence = GLExt::FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                        data + (size_t) y*width + x);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+void Pixels::draw(int x, int y, int w, int h, bool queued) {
+    if (storage != STORAGE_NONE) {
+        // Clipped to the layer
+        w += std::min(x, 0);
+        h += std::min(y, 0);
+        x = std::max(x, 0);
+        y = std::max(y, 0);
+        w = std::min(w, width - x);
+        h = std::min(h, height - y);
+        bool changed = w > 0 && h > 0;
+
+        if (!mode3d) {
+            if (texture != nullptr) {
+                Batch2D::flush();
+                if (changed || locked) upload(x, y, w, h);
+                SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+            }
+        } else {
+            Batch3D::flush();
+            if (glTexture == 0) createGLTexture();
+            if (changed) upload(x, y, w, h);
+
+            // A window sized quad straight in clip space, over everything drawn so far.
+            // Fixed function: Batch3D leaves its instancing program and buffer bound after meshes
+            GLState::useProgram(0);
+            GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+            glLoadIdentity();
+            MatrixStack3D::invalidate();
+            GLState::set_enabled(GL_DEPTH_TEST, false);
+            GLState::set_enabled(GL_ALPHA_TEST, false);
+            GLState::set_enabled(GL_TEXTURE_2D, true);
+            GLState::color({255, 255, 255, 255});
+            glBegin(GL_TRIANGLE_STRIP);
+            glTexCoord2f(0, 0); glVertex2f(-1, 1);
+            glTexCoord2f(1, 0); glVertex2f(1, 1);
+            glTexCoord2f(0, 1); glVertex2f(-1, -1);
+            glTexCoord2f(1, 1); glVertex2f(1, -1);
+            glEnd();
+            GLState::set_enabled(GL_TEXTURE_2D, false);
+            GLState::set_enabled(GL_DEPTH_TEST, true); // Everything else expects it on
+        }
+    }
+
+    // Recorded for the render thread: this one is done reading, let load() go on
+    if (queued) release();
+}
@@ -0,0 +1,75 @@
+
+/** @file
+ * @brief The pixels[] layer, see loadPixels() in easySDL.h.
+ */
+
+#ifndef EASYSDL_PIXELS_H
+#define EASYSDL_PIXELS_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <atomic>
+#include <vector>
+
+/** @class Pixels
+ * @brief A window sized ARGB8888 texture whose memory the sketch writes into directly.
+ *
+ * Where pixels[] lives depends on what the renderer offers:
+ * - window3d() with ARB_buffer_storage, drawn on the main thread: a persistently mapped
+ *   pixel buffer, uploads are DMA from it. A fence keeps writes from racing an upload.
+ * - window() on the software renderer: the streaming texture's own memory, which is the
+ *   surface it draws from, so there is nothing to upload. load() locks the texture and
+ *   draw() unlocks it, the pointer is only good while it's locked.
+ * - Otherwise: plain memory, uploaded with glTexSubImage2D()/SDL_UpdateTexture(). With
+ *   threadedMode() load() waits until the render thread is done uploading from it.
+ *
+ * Either way the pixels keep their values between frames and only the updated area is uploaded.
+ */
+class Pixels {
+public:
+    Pixels() = delete;
+
+    static void init(SDL_Renderer* renderer, bool mode3d);
+    static void quit();
+
+    /// @brief Makes the buffer ready for writing and returns it, main thread only.
+    static Uint32* load();
+    /// @brief load() without waiting for queued draws, for the drawing thread that runs them.
+    static Uint32* acquire();
+    /// @brief Counts a draw() recorded for the render thread, load() waits for it.
+    static void queue() { pending++; };
+    /// @brief Uploads the w*h area at (x, y) and draws the layer over the window, on the drawing thread.
+    /// queued says if it was counted by queue().
+    static void draw(int x, int y, int w, int h, bool queued);
+    /// @brief Ends a draw() counted by queue() that didn't happen after all.
+    static void release() { if (--pending == 0 && uploaded != nullptr) SDL_SemPost(uploaded); };
+
+    static int get_width() { return width; };
+    static int get_height() { return height; };
+
+private:
+    enum Storage { STORAGE_NONE, STORAGE_MEMORY, STORAGE_TEXTURE, STORAGE_MAPPED };
+
+    static SDL_Renderer* renderer;
+    static bool mode3d;
+    static int width, height;
+    static Storage storage;
+    static Uint32* data;
+    static std::vector<Uint32> memory;
+
+    static SDL_Texture* texture; // window()
+    static bool locked;          // STORAGE_TEXTURE, data is valid
+    static GLuint glTexture;     // window3d(), created by whichever thread draws first
+    static GLuint buffer;
+    static GLsync fence;         // After the last upload from buffer
+
+    static std::atomic<int> pending;
+    static SDL_sem* uploaded;
+
+    static void create();
+    static void createGLTexture();
+    static void upload(int x, int y, int w, int h);
+};
+
+#endif //EASYSDL_PIXELS_H
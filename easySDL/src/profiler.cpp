@@ -0,0 +1,110 @@
+
+/** @file
+ * @brief Frame profiler and histogram implementation.
+ */
+
+#include "profiler.h"
+#include "internal.h"
+
+#include <cstdio>
+#include <cstring>
+
+Histogram Profiler::histograms[Profiler::phaseCount];
+std::string Profiler::outputPath;
+
+static const char* phaseNames[Profiler::phaseCount] = {"events", "update", "present", "frame"};
+
+int Histogram::bucketOf(Uint32 us) {
+    if (us < 64) return (int) us;
+    int exponent = 31 - __builtin_clz(us); // 6..31
+    int sub = (int) (us >> (exponent - 5)) & 31;
+    return 64 + (exponent - 6) * 32 + sub;
+}
+
+double Histogram::bucketMiddle(int bucket) {
+    if (bucket < 64) return bucket;
+    int exponent = (bucket - 64) / 32 + 6;
+    int sub = (bucket - 64) % 32;
+    double width = (double) (1u << (exponent - 5));
+    return (32 + sub) * width + width / 2;
+}
+
+void Histogram::record(Uint32 us) {
+    buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(us, std::memory_order_relaxed);
+    Uint32 current = maxValue.load(std::memory_order_relaxed);
+    while (us > current && !maxValue.compare_exchange_weak(current, us, std::memory_order_relaxed)) {}
+}
+
+void Histogram::reset() {
+    for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+double Histogram::percentile(double p) const {
+    Uint64 total = get_count();
+    if (total == 0) return 0;
+    Uint64 target = (Uint64) (p / 100 * total + 0.5);
+    if (target < 1) target = 1;
+    Uint64 seen = 0;
+    for (int i = 0; i < bucketCount; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) return bucketMiddle(i);
+    }
+    return max();
+}
+
+double Histogram::mean() const {
+    Uint64 total = get_count();
+    return total ? (double) sum.load(std::memory_order_relaxed) / total : 0;
+}
+
+void Profiler::record(int phase, Uint64 ticks) {
+    Uint64 us = ticks * 1000000 / SDL_GetPerformanceFrequency();
+    histograms[phase].record(us > 0xFFFFFFFFu ? 0xFFFFFFFFu : (Uint32) us);
+}
+
+void Profiler::reset() {
+    for (auto& histogram : histograms) histogram.reset();
+}
+
+bool Profiler::save(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        Error(std::string("Can't open profile output ") + path);
+        return false;
+    }
+
+    size_t length = strlen(path);
+    bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+
+    // All times in milliseconds
+    if (json) fprintf(file, "{\n");
+    else fprintf(file, "phase,count,mean,p50,p95,p99,max\n");
+    for (int i = 0; i < phaseCount; i++) {
+        const Histogram& h = histograms[i];
+        if (json) {
+            fprintf(file, "  \"%s\": {\"count\": %llu, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, "
+                          "\"p99\": %.4f, \"max\": %.4f}%s\n",
+                    phaseNames[i], (unsigned long long) h.get_count(), h.mean() / 1000,
+                    h.percentile(50) / 1000, h.percentile(95) / 1000, h.percentile(99) / 1000,
+                    h.max() / 1000.0, i + 1 < phaseCount ? "," : "");
+        } else {
+            fprintf(file, "%s,%llu,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+                    phaseNames[i], (unsigned long long) h.get_count(), h.mean() / 1000,
+                    h.percentile(50) / 1000, h.percentile(95) / 1000, h.percentile(99) / 1000,
+                    h.max() / 1000.0);
+        }
+    }
+    if (json) fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
+
+void Profiler::quit() {
+    if (!outputPath.empty()) save(outputPath.c_str());
+}
@@ -0,0 +1,71 @@
+
+/** @file
+ * @brief Per-phase frame timing with lock-free histograms.
+ */
+
+#ifndef EASYSDL_PROFILER_H
+#define EASYSDL_PROFILER_H
+
+#include <SDL2/SDL.h>
+
+#include <atomic>
+#include <string>
+
+/** @class Histogram
+ * @brief Log-linear histogram of microsecond values, safe to record from any thread.
+ *
+ * Values below 64 us get their own bucket, above that every power of two is split
+ * into 32 buckets, so percentiles are within ~3% up to an hour.
+ * Recording is a single relaxed atomic increment, no locks.
+ */
+class Histogram {
+public:
+    static const int bucketCount = 64 + 26 * 32;
+
+    Histogram() { reset(); };
+
+    void record(Uint32 us);
+    void reset();
+
+    Uint64 get_count() const { return count.load(std::memory_order_relaxed); };
+    /// @brief Value (in microseconds) below which p percent (0-100) of the samples are.
+    double percentile(double p) const;
+    double mean() const;
+    Uint32 max() const { return maxValue.load(std::memory_order_relaxed); };
+
+private:
+    std::atomic<Uint32> buckets[bucketCount];
+    std::atomic<Uint64> count;
+    std::atomic<Uint64> sum;
+    std::atomic<Uint32> maxValue;
+
+    static int bucketOf(Uint32 us);
+    static double bucketMiddle(int bucket);
+};
+
+/** @class Profiler
+ * @brief Histograms for each phase of the frame, see ProfilePhase in easySDL.h.
+ */
+class Profiler {
+public:
+    Profiler() = delete;
+
+    static const int phaseCount = 4;
+
+    /// @brief Records a phase that took the given amount of performance counter ticks.
+    static void record(int phase, Uint64 ticks);
+    static const Histogram& get_histogram(int phase) { return histograms[phase]; };
+    static void reset();
+
+    /// @brief Writes a summary to path, JSON if it ends in .json, CSV otherwise.
+    static bool save(const char* path);
+    static void set_outputPath(const char* path) { outputPath = path ? path : ""; };
+    /// @brief Called from super_quit(), saves to the output path if one was set.
+    static void quit();
+
+private:
+    static Histogram histograms[phaseCount];
+    static std::string outputPath;
+};
+
+#endif //EASYSDL_PROFILER_H
@@ -0,0 +1,68 @@
+
+/** @file
+ * @brief Random implementation.
+ */
+
+#include "random.h"
+
+#include <cmath>
+
+Uint32 Random::state[4] = {};
+bool Random::seeded = false;
+bool Random::chosen = false;
+bool Random::haveSpare = false;
+float Random::spare = 0.0f;
+
+Uint64 Random::splitmix(Uint64& s) {
+    Uint64 z = (s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void Random::seed(Uint64 s, bool bySketch) {
+    Uint64 a = splitmix(s), b = splitmix(s);
+    state[0] = (Uint32) a;
+    state[1] = (Uint32) (a >> 32);
+    state[2] = (Uint32) b;
+    state[3] = (Uint32) (b >> 32);
+    if ((state[0] | state[1] | state[2] | state[3]) == 0) state[0] = 1; // All zero never leaves zero
+    seeded = true;
+    if (bySketch) chosen = true;
+    haveSpare = false;
+}
+
+static inline Uint32 rotl(Uint32 x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+Uint32 Random::next() {
+    if (!seeded) seed(SDL_GetPerformanceCounter());
+    Uint32 result = rotl(state[1]*5, 7)*9;
+    Uint32 t = state[1] << 9;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 11);
+    return result;
+}
+
+float Random::nextGaussian() {
+    if (haveSpare) {
+        haveSpare = false;
+        return spare;
+    }
+    // Marsaglia polar method, two normal numbers per accepted pair
+    float u, v, s;
+    do {
+        u = 2.0f*nextFloat() - 1.0f;
+        v = 2.0f*nextFloat() - 1.0f;
+        s = u*u + v*v;
+    } while (s >= 1.0f || s == 0.0f);
+    float k = sqrtf(-2.0f*logf(s)/s);
+    spare = v*k;
+    haveSpare = true;
+    return u*k;
+}
@@ -0,0 +1,43 @@
+
+/** @file
+ * @brief Seeded pseudo-random numbers, see random() in easySDL.h.
+ */
+
+#ifndef EASYSDL_RANDOM_H
+#define EASYSDL_RANDOM_H
+
+#include <SDL2/SDL.h>
+
+/** @class Random
+ * @brief xoshiro128** generator, seeded through splitmix64.
+ *
+ * A few shifts, rotates and one multiply per number, with a period of 2^128 - 1.
+ * Seeded from the performance counter the first time it's used, unless seed() came first.
+ * Main thread only, like the rest of the drawing API.
+ */
+class Random {
+public:
+    Random() = delete;
+
+    /// @param bySketch True if the sketch picked the seed with randomSeed().
+    static void seed(Uint64 seed, bool bySketch = false);
+    /// @brief True once the sketch picked a seed, not for the lazy one or the one of an input log.
+    static bool get_chosen() { return chosen; };
+    static Uint32 next();
+    /// @brief Uniform in [0, 1), 24 bits so every value is exact.
+    static float nextFloat() { return (float) (next() >> 8) * (1.0f/16777216.0f); };
+    /// @brief Normal distribution, mean 0 and deviation 1.
+    static float nextGaussian();
+
+    /// @brief splitmix64 step, also used to expand other seeds.
+    static Uint64 splitmix(Uint64& state);
+
+private:
+    static Uint32 state[4];
+    static bool seeded;
+    static bool chosen;
+    static bool haveSpare; // nextGaussian() makes two at a time
+    static float spare;
+};
+
+#endif //EASYSDL_RANDOM_H
@@ -0,0 +1,103 @@
+
+/** @file
+ * @brief Framebuffer readback implementation.
+ */
+
+#include "readback.h"
+#include "internal.h"
+
+#include <SDL2/SDL_opengl.h>
+
+#include <algorithm>
+#include <cstring>
+
+SDL_Renderer* Readback::renderer = nullptr;
+bool Readback::mode3d = false;
+std::atomic<bool> Readback::enabled(false);
+std::atomic<bool> Readback::valid(false);
+std::atomic<bool> Readback::fresh(false);
+int Readback::capturedWidth = 0;
+int Readback::capturedHeight = 0;
+int Readback::publishedWidth = 0;
+int Readback::publishedHeight = 0;
+std::vector<Uint8> Readback::captured;
+std::vector<Uint8> Readback::published;
+std::vector<Uint8> Readback::row;
+
+void Readback::init(SDL_Renderer* r, bool is3d) {
+    renderer = r;
+    mode3d = is3d;
+}
+
+void Readback::quit() {
+    captured = {}; published = {}; row = {};
+    enabled = false;
+    valid = false;
+    fresh = false;
+    renderer = nullptr;
+}
+
+bool Readback::read(Uint8* dst, int w, int h) {
+    return read(dst, w, h, GL_RGBA, GL_UNSIGNED_BYTE, SDL_PIXELFORMAT_RGBA32);
+}
+
+bool Readback::read(Uint32* dst, int w, int h) {
+    return read(dst, w, h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, SDL_PIXELFORMAT_ARGB8888);
+}
+
+bool Readback::read(void* dst, int w, int h, GLenum glFormat, GLenum glType, Uint32 sdlFormat) {
+    if (mode3d) {
+        int drawableWidth = 0, drawableHeight = 0;
+        SDL_GL_GetDrawableSize(SDL_GL_GetCurrentWindow(), &drawableWidth, &drawableHeight);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, std::max(drawableHeight - h, 0), w, h, glFormat, glType, dst);
+
+        // GL starts at the bottom
+        size_t pitch = (size_t) w * 4;
+        row.resize(pitch);
+        Uint8* bytes = (Uint8*) dst;
+        for (int y = 0; y < h / 2; y++) {
+            Uint8* top = bytes + y * pitch;
+            Uint8* bottom = bytes + (h - 1 - y) * pitch;
+            memcpy(row.data(), top, pitch);
+            memcpy(top, bottom, pitch);
+            memcpy(bottom, row.data(), pitch);
+        }
+        return glGetError() == GL_NO_ERROR;
+    }
+    SDL_Rect area = {0, 0, w, h};
+    if (SDL_RenderReadPixels(renderer, &area, sdlFormat, dst, w * 4) < 0) {
+        ErrorSDL("Failed to read back the frame!");
+        return false;
+    }
+    return true;
+}
+
+void Readback::capture() {
+    if (!enabled) return;
+
+    int w = 0, h = 0;
+    if (mode3d) {
+        SDL_GL_GetDrawableSize(SDL_GL_GetCurrentWindow(), &w, &h);
+    } else {
+        SDL_GetRendererOutputSize(renderer, &w, &h);
+    }
+    if (w <= 0 || h <= 0) return;
+
+    captured.resize((size_t) w * h * 4);
+    capturedWidth = w; capturedHeight = h;
+    fresh = read(captured.data(), w, h);
+}
+
+void Readback::publish() {
+    if (!fresh) return; // Nothing new was presented, skipped frames and such
+    captured.swap(published);
+    publishedWidth = capturedWidth; publishedHeight = capturedHeight;
+    fresh = false;
+    valid = true;
+}
+
+const Uint8* Readback::get_pixels() {
+    enabled = true;
+    return valid ? published.data() : nullptr;
+}
@@ -0,0 +1,64 @@
+
+/** @file
+ * @brief Copying finished frames back from the GPU/renderer into memory.
+ */
+
+#ifndef EASYSDL_READBACK_H
+#define EASYSDL_READBACK_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include <atomic>
+#include <vector>
+
+/** @class Readback
+ * @brief Reads the finished frame right before it's presented.
+ *
+ * Nothing is read until someone asks for framebuffer() once, after that every frame
+ * is copied (RGBA, top row first) so the pixels always belong to the last presented frame.
+ *
+ * Double-buffered: capture() fills one buffer on the drawing thread, publish() swaps it
+ * with the one framebuffer() hands out. publish() runs on the main thread while the
+ * drawing thread is idle (RenderThread::submit() or right after capture() without a
+ * render thread), so update() never sees a buffer that's being written.
+ */
+class Readback {
+public:
+    Readback() = delete;
+
+    static void init(SDL_Renderer* renderer, bool mode3d);
+    static void quit();
+
+    /// @brief Called after all batched drawing was flushed, before swap/present.
+    static void capture();
+    /// @brief Main thread, drawing thread idle. Hands the last captured frame to framebuffer().
+    static void publish();
+
+    /// @brief Turns readback on. Returns the last frame or nullptr if none was captured yet.
+    static const Uint8* get_pixels();
+    static bool get_valid() { return valid; };
+    static int get_width() { return publishedWidth; };
+    static int get_height() { return publishedHeight; };
+
+    /// @brief Reads the current back buffer into dst (width*height*4 bytes, RGBA, top row first).
+    static bool read(Uint8* dst, int w, int h);
+    /// @brief Same for the top left w*h of it as ARGB8888 words, the pixels[] format.
+    static bool read(Uint32* dst, int w, int h);
+
+private:
+    static SDL_Renderer* renderer;
+    static bool mode3d;
+    static std::atomic<bool> enabled;
+    static std::atomic<bool> valid;   // published holds a frame
+    static std::atomic<bool> fresh;   // captured holds a frame that wasn't published yet
+    static int capturedWidth, capturedHeight;
+    static int publishedWidth, publishedHeight;
+    static std::vector<Uint8> captured;  // Drawing thread
+    static std::vector<Uint8> published; // Main thread, what framebuffer() returns
+    static std::vector<Uint8> row; // Scratch for flipping GL's bottom-up rows
+
+    static bool read(void* dst, int w, int h, GLenum glFormat, GLenum glType, Uint32 sdlFormat);
+};
+
+#endif //EASYSDL_READBACK_H
@@ -0,0 +1,107 @@
+
+/** @file
+ * @brief Render thread implementation.
+ */
+
+#include "renderthread.h"
+#include "batch3d.h"
+#include "capture.h"
+#include "easySDL.h"
+#include "glstate.h"
+#include "images.h"
+#include "internal.h"
+#include "pacer.h"
+#include "picking.h"
+#include "profiler.h"
+#include "readback.h"
+
+SDL_Thread* RenderThread::thread = nullptr;
+SDL_sem* RenderThread::frameReady = nullptr;
+SDL_sem* RenderThread::renderIdle = nullptr;
+std::atomic<bool> RenderThread::stopping(false);
+CommandList RenderThread::lists[2];
+int RenderThread::writeIndex = 0;
+int RenderThread::readIndex = 1;
+SDL_Window* RenderThread::window = nullptr;
+SDL_GLContext RenderThread::context = nullptr;
+
+bool RenderThread::start(SDL_Window* w, SDL_GLContext c) {
+    if (thread != nullptr) return true;
+    window = w;
+    context = c;
+
+    frameReady = SDL_CreateSemaphore(0);
+    renderIdle = SDL_CreateSemaphore(1);
+    stopping = false;
+    writeIndex = 0;
+    readIndex = 1;
+    lists[0].clear();
+    lists[1].clear();
+
+    SDL_GL_MakeCurrent(window, nullptr); // A context can only be current on one thread
+    thread = SDL_CreateThread(run, "easySDL render", nullptr);
+    if (thread == nullptr) {
+        ErrorSDL("Failed to start the render thread!");
+        SDL_GL_MakeCurrent(window, context);
+        SDL_DestroySemaphore(frameReady);
+        SDL_DestroySemaphore(renderIdle);
+        return false;
+    }
+    return true;
+}
+
+void RenderThread::stop() {
+    if (thread == nullptr) return;
+
+    SDL_SemWait(renderIdle); // A submitted frame still goes out, run() only sees stopping after it
+    stopping = true;
+    SDL_SemPost(frameReady);
+    SDL_WaitThread(thread, nullptr);
+    thread = nullptr;
+
+    SDL_DestroySemaphore(frameReady);
+    SDL_DestroySemaphore(renderIdle);
+    frameReady = nullptr;
+    renderIdle = nullptr;
+
+    SDL_GL_MakeCurrent(window, context);
+}
+
+void RenderThread::submit() {
+    SDL_SemWait(renderIdle); // The other list is free once the previous frame is on screen
+    Readback::publish(); // The frame just presented, for the next update()
+    Capture::commit(); // Requests made while recording this list go with it
+    readIndex = writeIndex;
+    writeIndex = 1 - writeIndex;
+    lists[writeIndex].clear();
+    SDL_SemPost(frameReady);
+}
+
+int RenderThread::run(void*) {
+    SDL_GL_MakeCurrent(window, context);
+
+    while (true) {
+        SDL_SemWait(frameReady);
+        if (stopping) break;
+
+        // Replay counts as present here, it's where the GL work happens now
+        Uint64 start = FramePacer::now();
+        easySDL::resetMatrix();
+        Images::lock(); // The main thread places and evicts images in between
+        lists[readIndex].replay();
+        Batch3D::flush();
+        Images::unlock();
+        GLState::endFrame();
+        Batch3D::endFrame();
+        Picking::endFrame();
+        Readback::capture();
+        Capture::capture();
+        SDL_GL_SwapWindow(window);
+        Profiler::record(PROFILE_PRESENT, FramePacer::now() - start);
+
+        SDL_SemPost(renderIdle);
+    }
+
+    SDL_GL_MakeCurrent(window, nullptr);
+    return 0;
+}
@@ -0,0 +1,48 @@
+
+/** @file
+ * @brief Render thread for threaded mode, see threadedMode() in easySDL.h.
+ */
+
+#ifndef EASYSDL_RENDERTHREAD_H
+#define EASYSDL_RENDERTHREAD_H
+
+#include "commands.h"
+
+#include <atomic>
+
+/** @class RenderThread
+ * @brief Owns the GL context and replays the previous frame while update() records the next one.
+ *
+ * Two command lists take turns: the main thread records into one while this thread
+ * replays the other. submit() only waits if the render thread is still busy with the
+ * frame before, so simulation is never more than one frame ahead of the screen.
+ */
+class RenderThread {
+public:
+    RenderThread() = delete;
+
+    /// @brief Moves the GL context to a new thread. Call from the thread that has it current.
+    static bool start(SDL_Window* window, SDL_GLContext context);
+    /// @brief Finishes the frame in flight, joins and makes the context current on the caller again.
+    static void stop();
+    static bool get_running() { return thread != nullptr; };
+
+    static CommandList* get_recordList() { return &lists[writeIndex]; };
+    /// @brief Hands the recorded list to the render thread.
+    static void submit();
+
+private:
+    static SDL_Thread* thread;
+    static SDL_sem* frameReady;
+    static SDL_sem* renderIdle;
+    static std::atomic<bool> stopping;
+    static CommandList lists[2];
+    static int writeIndex;
+    static int readIndex;
+    static SDL_Window* window;
+    static SDL_GLContext context;
+
+    static int run(void* data);
+};
+
+#endif //EASYSDL_RENDERTHREAD_H
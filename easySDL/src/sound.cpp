@@ -0,0 +1,625 @@
+
+/** @file
+ * @brief Sound implementation.
+ */
+
+#include "sound.h"
+#include "easySDL.h"
+#include "internal.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef EASYSDL_MIXER
+#include <SDL2/SDL_mixer.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool Sound::opened = false;
+bool Sound::failed = false;
+SDL_AudioDeviceID Sound::device = 0;
+int Sound::rate = 48000;
+int Sound::deviceFrames = 0;
+
+std::vector<Sound::Sample> Sound::samples;
+std::vector<Sound::Music*> Sound::musics;
+int Sound::nextHandle = 1;
+const Sound::Music* Sound::currentMusic = nullptr;
+size_t Sound::prefetchEnd = 0;
+size_t Sound::releaseEnd = 0;
+
+Sound::Command Sound::queue[commandCapacity];
+std::atomic<Uint32> Sound::queueHead(0);
+std::atomic<Uint32> Sound::queueTail(0);
+std::atomic<int> Sound::processedHandle(0);
+
+Sound::Voice Sound::voices[maxVoices];
+Uint32 Sound::playCounter = 0;
+const Sound::Music* Sound::music = nullptr;
+bool Sound::musicLoop = false;
+Uint64 Sound::musicPosition = 0;
+Uint64 Sound::musicStep = (Uint64) 1 << 32;
+std::atomic<Uint32> Sound::musicFrame(0);
+
+std::atomic<float> Sound::musicVolume(1.0f);
+std::atomic<float> Sound::masterVolume(1.0f);
+
+const int scratchFrames = 1024;
+static volatile Uint8 prefetchSink; // Keeps the page touching from being optimized out
+
+
+// Mapped files
+
+bool MappedFile::open(const char* path) {
+    close();
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(f);
+        return false;
+    }
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m == nullptr) {
+        CloseHandle(f);
+        return false;
+    }
+    data = (const Uint8*) MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    mapping = m;
+    size = (size_t) fileSize.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file alive
+    if (address == MAP_FAILED) return false;
+    madvise(address, (size_t) info.st_size, MADV_SEQUENTIAL);
+    data = (const Uint8*) address;
+    size = (size_t) info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (data == nullptr) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    mapping = nullptr;
+    file = nullptr;
+#else
+    munmap((void*) data, size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+size_t MappedFile::pageSize() {
+#ifdef _WIN32
+    static const size_t page = [] {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (size_t) info.dwPageSize;
+    }();
+#else
+    static const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+#endif
+    return page;
+}
+
+void MappedFile::release(size_t offset, size_t length) const {
+    size_t page = pageSize();
+    size_t start = offset / page * page;
+    if (data == nullptr || start >= size) return;
+    length = std::min(length + (offset - start), size - start);
+#ifdef _WIN32
+    // Unlocking pages that were never locked takes them out of the working set, they stay in the file cache
+    VirtualUnlock((void*) (data + start), length);
+#else
+    madvise((void*) (data + start), length, MADV_DONTNEED); // Clean file pages, just read again if needed
+#endif
+}
+
+
+// Mixing kernels
+
+// out += src * (gainL, gainR), both interleaved stereo
+static void addScaled(float* out, const float* src, int frames, float gainL, float gainR) {
+    int n = frames * 2;
+    int i = 0;
+#ifdef __SSE2__
+    __m128 gain = _mm_setr_ps(gainL, gainR, gainL, gainR);
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(src + i), gain));
+        __m128 b = _mm_add_ps(_mm_loadu_ps(out + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), gain));
+        _mm_storeu_ps(out + i, a);
+        _mm_storeu_ps(out + i + 4, b);
+    }
+#endif
+    for (; i < n; i += 2) {
+        out[i] += src[i] * gainL;
+        out[i + 1] += src[i + 1] * gainR;
+    }
+}
+
+static void scaleClamp(float* out, int n, float gain) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128 g = _mm_set1_ps(gain);
+    __m128 lo = _mm_set1_ps(-1.0f);
+    __m128 hi = _mm_set1_ps(1.0f);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(out + i), g), lo), hi));
+#endif
+    for (; i < n; i++) out[i] = std::min(std::max(out[i] * gain, -1.0f), 1.0f);
+}
+
+static void s16ToFloat(float* dst, const Uint8* src, int n) {
+    const float scale = 1.0f / 32768.0f;
+    int i = 0;
+#ifdef __SSE2__
+    __m128 s = _mm_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + i * 2));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); // Sign extend
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+    }
+#endif
+    for (; i < n; i++) {
+        Sint16 v;
+        memcpy(&v, src + i * 2, 2);
+        dst[i] = (float) (Sint16) SDL_SwapLE16(v) * scale;
+    }
+}
+
+
+// Device
+
+bool Sound::init() {
+    if (opened) return true;
+    if (failed) return false; // Don't retry on every playSound()
+
+    // SDL only picks dummy/disk when asked, SDL_AUDIODRIVER in the environment still wins
+    if (easySDL::get_headless() && SDL_GetHint(SDL_HINT_AUDIODRIVER) == nullptr)
+        SDL_SetHint(SDL_HINT_AUDIODRIVER, "dummy");
+    if (!easySDL::initSubsystem(SDL_INIT_AUDIO, "audio")) {
+        failed = true;
+        return false;
+    }
+
+#ifdef EASYSDL_MIXER
+    // SDL_mixer owns the device and decodes files, the voices are mixed in its post-mix hook
+    Mix_Init(MIX_INIT_OGG | MIX_INIT_MP3 | MIX_INIT_FLAC); // Whatever is available
+    if (Mix_OpenAudioDevice(48000, AUDIO_F32SYS, 2, bufferFrames, nullptr, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE) < 0) {
+        ErrorSDL("Failed to open audio device!");
+        failed = true;
+        return false;
+    }
+    Uint16 format;
+    int channels;
+    Mix_QuerySpec(&rate, &format, &channels);
+    deviceFrames = bufferFrames;
+    Mix_SetPostMix(postMixCallback, nullptr);
+#else
+    SDL_AudioSpec want = {}, have = {};
+    want.freq = 48000;
+    want.format = AUDIO_F32SYS;
+    want.channels = 2;
+    want.samples = bufferFrames;
+    want.callback = deviceCallback;
+    device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (device == 0) {
+        ErrorSDL("Failed to open audio device!");
+        failed = true;
+        return false;
+    }
+    rate = have.freq;
+    deviceFrames = have.samples;
+    SDL_PauseAudioDevice(device, 0);
+#endif
+
+    opened = true;
+    return true;
+}
+
+void Sound::quit() {
+    if (!opened) return;
+#ifdef EASYSDL_MIXER
+    Mix_SetPostMix(nullptr, nullptr);
+    Mix_CloseAudio();
+    Mix_Quit();
+#else
+    SDL_CloseAudioDevice(device);
+    device = 0;
+#endif
+    opened = false;
+
+    samples.clear();
+    for (Music* m : musics) {
+        m->file.close();
+        delete m;
+    }
+    musics.clear();
+    currentMusic = nullptr;
+    music = nullptr;
+    for (Voice& v : voices) v.handle = 0;
+    queueHead = 0;
+    queueTail = 0;
+}
+
+float Sound::get_latency() {
+    return opened ? 1000.0f * (float) deviceFrames / (float) rate : 0.0f;
+}
+
+void Sound::deviceCallback(void*, Uint8* stream, int len) {
+    memset(stream, 0, (size_t) len);
+    mix((float*) stream, len / (int) (2 * sizeof(float)));
+}
+
+void Sound::postMixCallback(void*, Uint8* stream, int len) {
+    mix((float*) stream, len / (int) (2 * sizeof(float))); // Adds on top of whatever SDL_mixer played
+}
+
+
+// Main thread side
+
+bool Sound::push(const Command& command) {
+    Uint32 head = queueHead.load(std::memory_order_relaxed);
+    if (head - queueTail.load(std::memory_order_acquire) == commandCapacity) {
+        Warn("Sound command queue is full, dropping a command!");
+        return false;
+    }
+    queue[head & (commandCapacity - 1)] = command;
+    queueHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+int Sound::load(const char* path, int voices) {
+    if (!init()) return -1;
+
+    Sample sample;
+    sample.maxVoices = std::max(1, std::min(voices, (int) maxVoices));
+#ifdef EASYSDL_MIXER
+    Mix_Chunk* chunk = Mix_LoadWAV(path); // Already converted to the device format
+    if (chunk == nullptr) {
+        ErrorSDL(std::string("Failed to load sound ") + path + "!");
+        return -1;
+    }
+    sample.data.assign((const float*) chunk->abuf, (const float*) (chunk->abuf + chunk->alen));
+    Mix_FreeChunk(chunk);
+#else
+    SDL_AudioSpec spec;
+    Uint8* buffer;
+    Uint32 length;
+    if (SDL_LoadWAV(path, &spec, &buffer, &length) == nullptr) {
+        ErrorSDL(std::string("Failed to load sound ") + path + "!");
+        return -1;
+    }
+    SDL_AudioCVT cvt;
+    if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq, AUDIO_F32SYS, 2, rate) < 0) {
+        ErrorSDL(std::string("Can't convert sound ") + path + "!");
+        SDL_FreeWAV(buffer);
+        return -1;
+    }
+    std::vector<Uint8> converted((size_t) length * (size_t) std::max(cvt.len_mult, 1));
+    memcpy(converted.data(), buffer, length);
+    SDL_FreeWAV(buffer);
+    cvt.len = (int) length;
+    cvt.buf = converted.data();
+    if (cvt.needed && SDL_ConvertAudio(&cvt) < 0) {
+        ErrorSDL(std::string("Can't convert sound ") + path + "!");
+        return -1;
+    }
+    int bytes = cvt.needed ? cvt.len_cvt : cvt.len;
+    sample.data.assign((const float*) converted.data(), (const float*) (converted.data() + bytes));
+#endif
+    sample.frames = (Uint32) (sample.data.size() / 2);
+    samples.push_back(std::move(sample));
+    return (int) samples.size() - 1;
+}
+
+int Sound::play(int sound, float volume, float pan) {
+    if (!opened || sound < 0 || sound >= (int) samples.size()) return -1;
+    const Sample& sample = samples[sound];
+
+    pan = std::min(std::max(pan, -1.0f), 1.0f);
+    Command command = {};
+    command.type = CMD_SOUND_PLAY;
+    command.handle = nextHandle;
+    command.sound = sound;
+    command.maxVoices = sample.maxVoices;
+    command.data = sample.data.data(); // Never moves, samples are only freed in quit()
+    command.frames = sample.frames;
+    command.gainL = volume * std::min(1.0f, 1.0f - pan);
+    command.gainR = volume * std::min(1.0f, 1.0f + pan);
+    if (!push(command)) return -1;
+    return nextHandle++;
+}
+
+void Sound::stop(int voice) {
+    if (!opened || voice <= 0) return;
+    Command command = {};
+    command.type = CMD_SOUND_STOP;
+    command.handle = voice;
+    push(command);
+}
+
+bool Sound::get_playing(int voice) {
+    if (!opened || voice <= 0) return false;
+    if (voice > processedHandle.load(std::memory_order_acquire)) return true; // Still in the queue
+    for (const Voice& v : voices)
+        if (v.handle.load(std::memory_order_relaxed) == voice) return true;
+    return false;
+}
+
+int Sound::loadMusic(const char* path) {
+    if (!init()) return -1;
+
+    Music* m = new Music();
+    if (!m->file.open(path)) {
+        Error(std::string("Failed to open music ") + path + "!");
+        delete m;
+        return -1;
+    }
+    if (!parseWav(*m)) {
+        Error(std::string("Can't stream ") + path + ", only 16-bit or float WAV files can be streamed!");
+        m->file.close();
+        delete m;
+        return -1;
+    }
+    musics.push_back(m);
+    return (int) musics.size() - 1;
+}
+
+void Sound::playMusic(int index, bool loop) {
+    if (!opened || index < 0 || index >= (int) musics.size()) return;
+    Command command = {};
+    command.type = CMD_MUSIC_PLAY;
+    command.music = musics[index];
+    command.loop = loop;
+    if (!push(command)) return;
+    currentMusic = musics[index];
+    prefetchEnd = 0;
+    releaseEnd = 0;
+}
+
+void Sound::stopMusic() {
+    if (!opened) return;
+    Command command = {};
+    command.type = CMD_MUSIC_STOP;
+    if (push(command)) currentMusic = nullptr;
+}
+
+void Sound::update() {
+    const Music* m = currentMusic;
+    if (!opened || m == nullptr) return;
+
+    // Touch the next second of the file so the audio thread doesn't wait on the disk,
+    // and let go of what's more than a second behind, so memory doesn't grow with the track
+    const size_t page = MappedFile::pageSize();
+    size_t start = (size_t) (m->pcm - m->file.get_data());
+    size_t end = start + (size_t) m->frames * m->frameBytes;
+    size_t window = (size_t) m->rate * m->frameBytes;
+    size_t offset = start + (size_t) musicFrame.load(std::memory_order_relaxed) * m->frameBytes;
+
+    if (prefetchEnd < offset || prefetchEnd > offset + window) prefetchEnd = offset; // Started over
+    size_t ahead = std::min(offset + window, end);
+    const Uint8* data = m->file.get_data();
+    Uint8 sum = 0;
+    for (; prefetchEnd < ahead; prefetchEnd += page) sum += data[prefetchEnd];
+    prefetchSink = sum;
+
+    if (releaseEnd > offset) releaseEnd = start; // Looped
+    if (offset > start + 2 * window) {
+        size_t behind = offset - window;
+        if (releaseEnd < behind) {
+            m->file.release(releaseEnd, behind - releaseEnd);
+            releaseEnd = behind;
+        }
+    }
+}
+
+bool Sound::parseWav(Music& m) {
+    const Uint8* data = m.file.get_data();
+    size_t size = m.file.get_size();
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) return false;
+
+    Uint16 format = 0, channels = 0, bits = 0;
+    Uint32 sampleRate = 0;
+    size_t p = 12;
+    while (p + 8 <= size) {
+        Uint32 length;
+        memcpy(&length, data + p + 4, 4);
+        length = SDL_SwapLE32(length);
+        const Uint8* body = data + p + 8;
+        size_t available = size - p - 8;
+
+        if (memcmp(data + p, "fmt ", 4) == 0 && available >= 16) {
+            memcpy(&format, body, 2);
+            memcpy(&channels, body + 2, 2);
+            memcpy(&sampleRate, body + 4, 4);
+            memcpy(&bits, body + 14, 2);
+            format = SDL_SwapLE16(format);
+            channels = SDL_SwapLE16(channels);
+            sampleRate = SDL_SwapLE32(sampleRate);
+            bits = SDL_SwapLE16(bits);
+            if (format == 0xFFFE && available >= 26) { // WAVE_FORMAT_EXTENSIBLE, real format is in the GUID
+                memcpy(&format, body + 24, 2);
+                format = SDL_SwapLE16(format);
+            }
+        } else if (memcmp(data + p, "data", 4) == 0) {
+            bool pcm16 = format == 1 && bits == 16;
+            bool float32 = format == 3 && bits == 32;
+            if ((!pcm16 && !float32) || channels < 1 || channels > 2 || sampleRate == 0) return false;
+            m.pcm = body;
+            m.channels = channels;
+            m.isFloat = float32;
+            m.rate = (int) sampleRate;
+            m.frameBytes = channels * bits / 8;
+            m.frames = (Uint32) (std::min((size_t) length, available) / m.frameBytes);
+            return m.frames > 0;
+        }
+        p += 8 + (size_t) length + (length & 1); // Chunks are padded to even sizes
+    }
+    return false;
+}
+
+
+// Audio thread side
+
+void Sound::processCommands() {
+    Uint32 tail = queueTail.load(std::memory_order_relaxed);
+    Uint32 head = queueHead.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+        const Command& c = queue[tail & (commandCapacity - 1)];
+        switch (c.type) {
+            case CMD_SOUND_PLAY: {
+                // Steal the oldest voice of the same sound if it has all it may have,
+                // otherwise take a free one, otherwise steal the oldest overall
+                int free = -1, oldest = -1, oldestSame = -1, same = 0;
+                for (int i = 0; i < maxVoices; i++) {
+                    const Voice& v = voices[i];
+                    if (v.handle.load(std::memory_order_relaxed) == 0) {
+                        if (free < 0) free = i;
+                        continue;
+                    }
+                    if (oldest < 0 || (Sint32) (v.started - voices[oldest].started) < 0) oldest = i;
+                    if (v.sound == c.sound) {
+                        same++;
+                        if (oldestSame < 0 || (Sint32) (v.started - voices[oldestSame].started) < 0) oldestSame = i;
+                    }
+                }
+                int slot = same >= c.maxVoices ? oldestSame : (free >= 0 ? free : oldest);
+                Voice& v = voices[slot];
+                v.data = c.data;
+                v.frames = c.frames;
+                v.position = 0;
+                v.sound = c.sound;
+                v.started = playCounter++;
+                v.gainL = c.gainL;
+                v.gainR = c.gainR;
+                v.handle.store(c.handle, std::memory_order_relaxed);
+                processedHandle.store(c.handle, std::memory_order_release);
+                break;
+            }
+            case CMD_SOUND_STOP:
+                for (Voice& v : voices)
+                    if (v.handle.load(std::memory_order_relaxed) == c.handle) v.handle.store(0, std::memory_order_relaxed);
+                break;
+            case CMD_MUSIC_PLAY:
+                music = c.music;
+                musicLoop = c.loop;
+                musicPosition = 0;
+                musicStep = ((Uint64) music->rate << 32) / (Uint64) rate;
+                break;
+            case CMD_MUSIC_STOP:
+                music = nullptr;
+                break;
+        }
+    }
+    queueTail.store(tail, std::memory_order_release);
+}
+
+static void readFrame(const Uint8* pcm, int channels, bool isFloat, Uint32 index, float& l, float& r) {
+    if (isFloat) {
+        float v[2];
+        memcpy(v, pcm + (size_t) index * channels * 4, (size_t) channels * 4);
+        l = v[0];
+        r = v[channels - 1];
+    } else {
+        Sint16 v[2];
+        memcpy(v, pcm + (size_t) index * channels * 2, (size_t) channels * 2);
+        l = (float) (Sint16) SDL_SwapLE16(v[0]) / 32768.0f;
+        r = (float) (Sint16) SDL_SwapLE16(v[channels - 1]) / 32768.0f;
+    }
+}
+
+int Sound::readMusic(float* dst, int frames) {
+    const Music* m = music;
+    int done = 0;
+    while (done < frames && m != nullptr) {
+        Uint32 index = (Uint32) (musicPosition >> 32);
+        if (index >= m->frames) {
+            if (!musicLoop) {
+                music = nullptr;
+                break;
+            }
+            musicPosition -= (Uint64) m->frames << 32;
+            continue;
+        }
+
+        if (musicStep == (Uint64) 1 << 32 && !m->isFloat && m->channels == 2) {
+            // Same rate 16-bit stereo, the usual case, straight conversion
+            int n = (int) std::min((Uint32) (frames - done), m->frames - index);
+            s16ToFloat(dst + done * 2, m->pcm + (size_t) index * 4, n * 2);
+            done += n;
+            musicPosition += (Uint64) n << 32;
+            continue;
+        }
+
+        // Anything else, one frame at a time with linear interpolation
+        Uint32 next = index + 1 < m->frames ? index + 1 : (musicLoop ? 0 : index);
+        float t = (float) (musicPosition & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+        float l0, r0, l1, r1;
+        readFrame(m->pcm, m->channels, m->isFloat, index, l0, r0);
+        readFrame(m->pcm, m->channels, m->isFloat, next, l1, r1);
+        dst[done * 2] = l0 + (l1 - l0) * t;
+        dst[done * 2 + 1] = r0 + (r1 - r0) * t;
+        done++;
+        musicPosition += musicStep;
+    }
+    if (music != nullptr) musicFrame.store((Uint32) (musicPosition >> 32), std::memory_order_relaxed);
+    return done;
+}
+
+void Sound::mix(float* out, int frames) {
+    processCommands();
+
+    for (Voice& v : voices) {
+        if (v.handle.load(std::memory_order_relaxed) == 0) continue;
+        int n = (int) std::min((Uint32) frames, v.frames - v.position);
+        addScaled(out, v.data + (size_t) v.position * 2, n, v.gainL, v.gainR);
+        v.position += (Uint32) n;
+        if (v.position >= v.frames) v.handle.store(0, std::memory_order_relaxed);
+    }
+
+    if (music != nullptr) {
+        alignas(16) float scratch[scratchFrames * 2];
+        float volume = musicVolume.load(std::memory_order_relaxed);
+        for (int done = 0; done < frames && music != nullptr;) {
+            int n = readMusic(scratch, std::min(frames - done, scratchFrames));
+            addScaled(out + done * 2, scratch, n, volume, volume);
+            done += n;
+        }
+    }
+
+    scaleClamp(out, frames * 2, masterVolume.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,154 @@
+
+/** @file
+ * @brief Sound effects and streamed music, see loadSound() in easySDL.h.
+ */
+
+#ifndef EASYSDL_SOUND_H
+#define EASYSDL_SOUND_H
+
+#include <SDL2/SDL.h>
+
+#include <atomic>
+#include <vector>
+
+/** @class MappedFile
+ * @brief Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+    bool open(const char* path);
+    void close();
+    /// @brief Tell the OS the range won't be needed soon, it can drop those pages.
+    void release(size_t offset, size_t length) const;
+    /// @brief The OS page size, what release() and prefetching step by.
+    static size_t pageSize();
+
+    const Uint8* get_data() const { return data; };
+    size_t get_size() const { return size; };
+
+private:
+    const Uint8* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+/** @class Sound
+ * @brief Own mixer on a small fixed audio buffer.
+ *
+ * Sounds are decoded once to float stereo at the device rate, music is streamed
+ * straight out of a memory-mapped WAV. The main thread talks to the audio thread
+ * only through a lock-free command queue, so it never waits on the device lock.
+ */
+class Sound {
+public:
+    Sound() = delete;
+
+    static const int maxVoices = 32;
+    static const int bufferFrames = 256; // 5.3 ms at 48 kHz
+    static const int commandCapacity = 256; // Power of two
+
+    static bool init();
+    static void quit();
+    /// @brief Called every frame, pages music in ahead of the audio thread and drops what's played.
+    static void update();
+    /// @brief Adds frames of float stereo to out. Runs on the audio thread.
+    static void mix(float* out, int frames);
+
+    static int load(const char* path, int voices);
+    static int play(int sound, float volume, float pan);
+    static void stop(int voice);
+    static bool get_playing(int voice);
+
+    static int loadMusic(const char* path);
+    static void playMusic(int music, bool loop);
+    static void stopMusic();
+
+    static void set_musicVolume(float volume) { musicVolume = volume; };
+    static void set_masterVolume(float volume) { masterVolume = volume; };
+    /// @brief Length of one device buffer in milliseconds, 0 if audio isn't open.
+    static float get_latency();
+
+private:
+    struct Sample {
+        std::vector<float> data; // Interleaved stereo at the device rate
+        Uint32 frames;
+        int maxVoices;
+    };
+
+    struct Voice {
+        std::atomic<int> handle; // 0 when free, read by the main thread for soundPlaying()
+        const float* data;
+        Uint32 frames;
+        Uint32 position;
+        int sound;
+        Uint32 started;
+        float gainL, gainR;
+    };
+
+    struct Music {
+        MappedFile file;
+        const Uint8* pcm;
+        Uint32 frames;
+        int channels;
+        bool isFloat;
+        int rate;
+        int frameBytes;
+    };
+
+    enum CommandType { CMD_SOUND_PLAY, CMD_SOUND_STOP, CMD_MUSIC_PLAY, CMD_MUSIC_STOP };
+
+    struct Command {
+        CommandType type;
+        int handle;
+        int sound;
+        int maxVoices;
+        const float* data;
+        Uint32 frames;
+        float gainL, gainR;
+        const Music* music;
+        bool loop;
+    };
+
+    static bool push(const Command& command);
+    static void processCommands();
+    static int readMusic(float* dst, int frames);
+    static bool parseWav(Music& music);
+
+    static void deviceCallback(void* userdata, Uint8* stream, int len);
+    static void postMixCallback(void* userdata, Uint8* stream, int len);
+
+    static bool opened;
+    static bool failed;
+    static SDL_AudioDeviceID device;
+    static int rate;
+    static int deviceFrames;
+
+    static std::vector<Sample> samples;
+    static std::vector<Music*> musics;
+    static int nextHandle;
+    static const Music* currentMusic; // Main thread's idea of what's playing
+    static size_t prefetchEnd;
+    static size_t releaseEnd;
+
+    static Command queue[commandCapacity];
+    static std::atomic<Uint32> queueHead;
+    static std::atomic<Uint32> queueTail;
+    static std::atomic<int> processedHandle;
+
+    // Audio thread state
+    static Voice voices[maxVoices];
+    static Uint32 playCounter;
+    static const Music* music;
+    static bool musicLoop;
+    static Uint64 musicPosition; // 32.32 fixed point, in source frames
+    static Uint64 musicStep;
+    static std::atomic<Uint32> musicFrame; // Published for update()
+
+    static std::atomic<float> musicVolume;
+    static std::atomic<float> masterVolume;
+};
+
+#endif //EASYSDL_SOUND_H
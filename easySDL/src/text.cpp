@@ -0,0 +1,204 @@
+
+/** @file
+ * @brief Text implementation.
+ */
+
+#include "text.h"
+#include "easySDL.h"
+#include "images.h"
+#include "internal.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef EASYSDL_TTF
+#include <SDL2/SDL_ttf.h>
+#endif
+
+bool Text::initialized = false;
+std::vector<Text::Font> Text::fonts;
+int Text::font = -1;
+int Text::size = 12;
+std::unordered_map<Uint64, Text::Glyph> Text::glyphs;
+std::unordered_map<Uint64, TextRun> Text::runs;
+
+#ifdef EASYSDL_TTF
+// Next code point of a UTF-8 string, invalid bytes come out as U+FFFD
+static Uint32 nextCodepoint(const char*& s) {
+    const Uint8* p = (const Uint8*) s;
+    Uint32 c = p[0];
+    int length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+    if (length == 0) {
+        s++;
+        return 0xFFFD;
+    }
+    if (length > 1) c &= 0x3F >> (length - 1);
+    for (int i = 1; i < length; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            s += i;
+            return 0xFFFD;
+        }
+        c = (c << 6) | (p[i] & 0x3F);
+    }
+    s += length;
+    return c;
+}
+#endif
+
+static Uint64 fnv1a(Uint64 hash, const void* data, size_t length) {
+    const Uint8* bytes = (const Uint8*) data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+int Text::loadFont(const char* path) {
+#ifdef EASYSDL_TTF
+    if (!initialized) {
+        if (TTF_Init() < 0) {
+            ErrorSDL("Failed to initialize SDL_ttf!");
+            return -1;
+        }
+        initialized = true;
+    }
+    // Opened for real per size, check now that the file is any good
+    TTF_Font* ttf = TTF_OpenFont(path, size);
+    if (ttf == nullptr) {
+        ErrorSDL(std::string("Failed to load font ") + path + "!");
+        return -1;
+    }
+    fonts.push_back({path, {}});
+    fonts.back().sizes[size] = ttf;
+    if (font < 0) font = (int) fonts.size() - 1;
+    return (int) fonts.size() - 1;
+#else
+    Warn(std::string("SDL_ttf not found when easySDL was built, can't load ") + path + "!");
+    return -1;
+#endif
+}
+
+void Text::quit() {
+#ifdef EASYSDL_TTF
+    for (Font& f : fonts)
+        for (auto& entry : f.sizes) TTF_CloseFont(entry.second);
+    if (initialized) TTF_Quit();
+#endif
+    initialized = false;
+    fonts.clear();
+    glyphs.clear();
+    runs.clear();
+    font = -1;
+}
+
+void Text::set_font(int id) {
+    if (id < 0 || id >= (int) fonts.size()) {
+        Warn("textFont(): no such font!");
+        return;
+    }
+    font = id;
+}
+
+void Text::set_size(float s) {
+    size = std::max(1, (int) (s + 0.5f)); // Glyphs are cached per whole pixel size
+}
+
+_TTF_Font* Text::get_ttf(int id, int px) {
+#ifdef EASYSDL_TTF
+    Font& f = fonts[id];
+    auto found = f.sizes.find(px);
+    if (found != f.sizes.end()) return found->second;
+    TTF_Font* ttf = TTF_OpenFont(f.path.c_str(), px);
+    if (ttf == nullptr) ErrorSDL("Failed to open " + f.path + " at size " + std::to_string(px) + "!");
+    f.sizes[px] = ttf; // Even if it failed, don't try again every frame
+    return ttf;
+#else
+    (void) id;
+    (void) px;
+    return nullptr;
+#endif
+}
+
+const Text::Glyph& Text::glyph(_TTF_Font* ttf, Uint32 codepoint) {
+    Uint64 key = ((Uint64) font << 48) ^ ((Uint64) size << 32) ^ codepoint;
+    auto found = glyphs.find(key);
+    if (found != glyphs.end()) return found->second;
+
+    Glyph g = {-1, 0, 0, 0, 0};
+#ifdef EASYSDL_TTF
+    int minx, maxx, miny, maxy, advance;
+    if (TTF_GlyphMetrics32(ttf, codepoint, &minx, &maxx, &miny, &maxy, &advance) == 0) {
+        g.advance = advance;
+        if (maxx > minx && maxy > miny) {
+            // White, the fill color tints it when drawn
+            SDL_Surface* surface = TTF_RenderGlyph32_Blended(ttf, codepoint, {255, 255, 255, 255});
+            if (surface != nullptr) {
+                g.image = Images::add(surface, true);
+                g.left = std::min(minx, 0); // The surface starts at the pen, or left of it for overhangs
+                g.width = surface->w;
+                g.height = surface->h;
+                SDL_FreeSurface(surface);
+            }
+        }
+    }
+#else
+    (void) ttf;
+#endif
+    return glyphs.emplace(key, g).first->second;
+}
+
+const TextRun* Text::layout(const char* str) {
+    if (font < 0) return nullptr;
+
+    Uint64 key = fnv1a(14695981039346656037ull, str, strlen(str));
+    key = fnv1a(key, &font, sizeof(font));
+    key = fnv1a(key, &size, sizeof(size));
+    auto found = runs.find(key);
+    if (found != runs.end() && found->second.font == font && found->second.size == size && found->second.text == str) {
+        found->second.lastUsed = frameCount;
+        return &found->second;
+    }
+
+    _TTF_Font* ttf = get_ttf(font, size);
+    if (ttf == nullptr) return nullptr;
+
+    if (runs.size() >= maxRuns) {
+        for (auto it = runs.begin(); it != runs.end();) {
+            if (it->second.lastUsed != frameCount) it = runs.erase(it);
+            else ++it;
+        }
+    }
+
+    TextRun run = {str, font, size, {}, 0.0f, frameCount};
+#ifdef EASYSDL_TTF
+    // Glyph images are font height tall with the ascent on top, so they all go one ascent up
+    float top = (float) -TTF_FontAscent(ttf);
+    float lineSkip = (float) TTF_FontLineSkip(ttf);
+    bool kerning = TTF_GetFontKerning(ttf) != 0;
+    float penX = 0, penY = 0;
+    Uint32 previous = 0;
+    for (const char* s = str; *s != '\0';) {
+        Uint32 c = nextCodepoint(s);
+        if (c == '\n') {
+            run.width = std::max(run.width, penX);
+            penX = 0;
+            penY += lineSkip;
+            previous = 0;
+            continue;
+        }
+        if (kerning && previous != 0) penX += (float) TTF_GetFontKerningSizeGlyphs32(ttf, previous, c);
+        const Glyph& g = glyph(ttf, c);
+        if (g.image >= 0)
+            run.glyphs.push_back({g.image, penX + (float) g.left, penY + top, (float) g.width, (float) g.height});
+        penX += (float) g.advance;
+        previous = c;
+    }
+    run.width = std::max(run.width, penX);
+#endif
+
+    // Replaces a hash collision, if that's what it was
+    TextRun& stored = runs[key];
+    stored = std::move(run);
+    return &stored;
+}
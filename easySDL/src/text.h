@@ -0,0 +1,79 @@
+
+/** @file
+ * @brief Text layout and glyph caching, see text() in easySDL.h.
+ */
+
+#ifndef EASYSDL_TEXT_H
+#define EASYSDL_TEXT_H
+
+#include <SDL2/SDL.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct _TTF_Font; // SDL_ttf is optional, only text.cpp includes it
+
+/// @brief One glyph of a laid out string, relative to the start of its baseline.
+struct TextGlyph {
+    int image;
+    float x, y, w, h;
+};
+
+/// @brief A laid out string: which glyph image goes where.
+struct TextRun {
+    std::string text;
+    int font;
+    int size;
+    std::vector<TextGlyph> glyphs;
+    float width;
+    Uint32 lastUsed;
+};
+
+/** @class Text
+ * @brief Fonts, a glyph cache and a cache of laid out strings.
+ *
+ * Every glyph is rasterized once per font and size with SDL_ttf and added to Images
+ * as a pinned image, so it shares atlas pages with other glyphs and never gets evicted.
+ * Laid out strings are cached by font, size and text, so drawing the same label again
+ * is a hash lookup and a few image() calls, which batch like any other image.
+ */
+class Text {
+public:
+    Text() = delete;
+
+    static const size_t maxRuns = 4096; // Past that, runs not drawn this frame are dropped
+
+    static int loadFont(const char* path);
+    static void quit();
+
+    static void set_font(int id);
+    static void set_size(float size);
+    /// @brief The string in the current font and size, nullptr if there is no font.
+    static const TextRun* layout(const char* str);
+
+private:
+    struct Font {
+        std::string path;
+        std::unordered_map<int, _TTF_Font*> sizes;
+    };
+
+    struct Glyph {
+        int image; // -1 for blank ones like space
+        int left;  // Of the image, relative to the pen
+        int width, height;
+        int advance;
+    };
+
+    static bool initialized;
+    static std::vector<Font> fonts;
+    static int font;
+    static int size;
+    static std::unordered_map<Uint64, Glyph> glyphs;
+    static std::unordered_map<Uint64, TextRun> runs;
+
+    static _TTF_Font* get_ttf(int font, int size);
+    static const Glyph& glyph(_TTF_Font* ttf, Uint32 codepoint);
+};
+
+#endif //EASYSDL_TEXT_H
@@ -0,0 +1,44 @@
+
+/** @file
+ * @brief Startup trace implementation.
+ */
+
+#include "trace.h"
+#include "internal.h"
+
+#include <cstdio>
+#include <cstring>
+
+bool StartupTrace::enabled = false;
+bool StartupTrace::finished = false;
+StartupTrace::Stage StartupTrace::stages[StartupTrace::maxStages];
+int StartupTrace::stageCount = 0;
+
+static float toMs(Uint64 ticks) {
+    return (float) ((double) ticks * 1000 / SDL_GetPerformanceFrequency());
+}
+
+void StartupTrace::record(const char* stage, Uint64 start, Uint64 end) {
+    if (finished || stageCount == maxStages) return; // Only startup, a late audio init isn't startup
+    stages[stageCount++] = {stage, toMs(end - start)};
+}
+
+void StartupTrace::finish(Uint64 mainStart) {
+    if (finished) return;
+    record("first frame", mainStart, SDL_GetPerformanceCounter());
+    finished = true;
+
+    if (!enabled) return;
+    Log("Startup trace:");
+    for (int i = 0; i < stageCount; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "  %-14s %9.3f ms", stages[i].name, stages[i].ms);
+        Log(line);
+    }
+}
+
+float StartupTrace::get_stage(const char* stage) {
+    for (int i = 0; i < stageCount; i++)
+        if (strcmp(stages[i].name, stage) == 0) return stages[i].ms;
+    return -1;
+}
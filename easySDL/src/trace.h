@@ -0,0 +1,41 @@
+
+/** @file
+ * @brief Startup timing, see startupTrace() in easySDL.h.
+ */
+
+#ifndef EASYSDL_TRACE_H
+#define EASYSDL_TRACE_H
+
+#include <SDL2/SDL.h>
+
+/** @class StartupTrace
+ * @brief Remembers how long each initialization stage took, prints them after the first frame.
+ */
+class StartupTrace {
+public:
+    StartupTrace() = delete;
+
+    static const int maxStages = 16;
+
+    static void record(const char* stage, Uint64 start, Uint64 end);
+    /// @brief Called after the first frame, prints the trace if enabled.
+    static void finish(Uint64 mainStart);
+
+    static void set_enabled(bool enable) { enabled = enable; };
+    static bool get_enabled() { return enabled; };
+    /// @brief Milliseconds the stage took, -1 if it didn't happen (yet).
+    static float get_stage(const char* stage);
+
+private:
+    struct Stage {
+        const char* name;
+        float ms;
+    };
+
+    static bool enabled;
+    static bool finished;
+    static Stage stages[maxStages];
+    static int stageCount;
+};
+
+#endif //EASYSDL_TRACE_H